@@ -0,0 +1,383 @@
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "xdiff.h"
+
+#include "core.h"
+#include "cpu.h"
+
+// Allocation counters. On Linux the benchmark is linked with --wrap for the
+// allocator, so every allocation made by xdiff and the binding core is
+// counted, otherwise the counters stay at zero.
+static uint64_t bare_xdiff_bench_allocations;
+static uint64_t bare_xdiff_bench_allocated;
+
+#ifdef BARE_XDIFF_BENCH_WRAP_MALLOC
+void *
+__real_malloc(size_t size);
+
+void *
+__real_calloc(size_t count, size_t size);
+
+void *
+__real_realloc(void *ptr, size_t size);
+
+void *
+__wrap_malloc(size_t size) {
+  bare_xdiff_bench_allocations++;
+  bare_xdiff_bench_allocated += size;
+  return __real_malloc(size);
+}
+
+void *
+__wrap_calloc(size_t count, size_t size) {
+  bare_xdiff_bench_allocations++;
+  bare_xdiff_bench_allocated += count * size;
+  return __real_calloc(count, size);
+}
+
+void *
+__wrap_realloc(void *ptr, size_t size) {
+  bare_xdiff_bench_allocations++;
+  bare_xdiff_bench_allocated += size;
+  return __real_realloc(ptr, size);
+}
+#endif
+
+// Input of a benchmark case, with an ancestor for merges
+typedef struct {
+  const char *name;
+  mmfile_t a;
+  mmfile_t b;
+  mmfile_t o;
+} bare_xdiff_bench_case_t;
+
+// Totals of the runs of a benchmark case
+typedef struct {
+  uint64_t elapsed_ns;
+  uint64_t prepare_ns;
+  uint64_t search_ns;
+  uint64_t emit_ns;
+  uint64_t allocations;
+  uint64_t allocated;
+  bare_xdiff_stats_t last;
+} bare_xdiff_bench_result_t;
+
+static const struct {
+  const char *name;
+  uint32_t flags;
+} bare_xdiff_bench_algorithms[] = {
+  {"myers", 0},
+  {"patience", XDF_PATIENCE_DIFF},
+  {"histogram", XDF_HISTOGRAM_DIFF},
+};
+
+// Deterministic xorshift generator, so that corpora are the same every run
+static uint64_t
+bare_xdiff_bench_random(uint64_t *state) {
+  uint64_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  return *state = x;
+}
+
+// Generate lines of source-like text
+static mmfile_t
+bare_xdiff_bench_generate(size_t lines, uint64_t seed) {
+  static const char *words[] = {"const", "let", "return", "if", "for", "value", "result", "buffer", "length", "offset", "index", "error", "callback", "options", "data"};
+  size_t words_len = sizeof(words) / sizeof(words[0]);
+  
+  bare_xdiff_output_t output = {NULL, 0, 0};
+  uint64_t state = seed;
+  
+  for (size_t i = 0; i < lines; i++) {
+    uint64_t r = bare_xdiff_bench_random(&state);
+    size_t indent = (r % 4) * 2;
+    size_t count = 1 + (r >> 8) % 8;
+    
+    for (size_t j = 0; j < indent; j++) bare_xdiff_output_append(&output, " ", 1);
+    
+    for (size_t j = 0; j < count; j++) {
+      const char *word = words[bare_xdiff_bench_random(&state) % words_len];
+      if (j > 0) bare_xdiff_output_append(&output, " ", 1);
+      bare_xdiff_output_append(&output, word, strlen(word));
+    }
+    
+    char suffix[32];
+    int len = snprintf(suffix, sizeof(suffix), " %" PRIu64 "\n", r % 1000);
+    bare_xdiff_output_append(&output, suffix, len);
+  }
+  
+  mmfile_t file = {output.data, (long)output.len};
+  return file;
+}
+
+// Apply seeded edits to about one in every rate lines: replacements,
+// insertions and deletions
+static mmfile_t
+bare_xdiff_bench_edit(mmfile_t base, size_t rate, uint64_t seed) {
+  bare_xdiff_output_t output = {NULL, 0, 0};
+  uint64_t state = seed;
+  
+  const char *ptr = base.ptr, *end = base.ptr + base.size;
+  
+  while (ptr < end) {
+    const char *next = memchr(ptr, '\n', end - ptr);
+    next = next ? next + 1 : end;
+    
+    uint64_t r = bare_xdiff_bench_random(&state);
+    
+    if (r % rate != 0) {
+      bare_xdiff_output_append(&output, ptr, next - ptr);
+    } else {
+      switch ((r >> 32) % 3) {
+      case 0: // Replace
+        bare_xdiff_output_append(&output, "  changed ", 10);
+        bare_xdiff_output_append(&output, ptr, next - ptr);
+        break;
+      case 1: // Insert
+        bare_xdiff_output_append(&output, "  inserted line\n", 16);
+        bare_xdiff_output_append(&output, ptr, next - ptr);
+        break;
+      case 2: // Delete
+        break;
+      }
+    }
+    
+    ptr = next;
+  }
+  
+  mmfile_t file = {output.data, (long)output.len};
+  return file;
+}
+
+// Read a whole file into memory
+static int
+bare_xdiff_bench_read(const char *path, mmfile_t *file) {
+  FILE *fp = fopen(path, "rb");
+  if (!fp) return -1;
+  
+  bare_xdiff_output_t output = {NULL, 0, 0};
+  char chunk[65536];
+  size_t len;
+  
+  while ((len = fread(chunk, 1, sizeof(chunk), fp)) > 0) {
+    if (bare_xdiff_output_append(&output, chunk, len) < 0) {
+      fclose(fp);
+      free(output.data);
+      return -1;
+    }
+  }
+  
+  fclose(fp);
+  
+  file->ptr = output.data;
+  file->size = (long)output.len;
+  return 0;
+}
+
+// Run a diff or merge of a case once, collecting stats if not NULL
+static int
+bare_xdiff_bench_once(bare_xdiff_bench_case_t *c, uint32_t flags, bare_xdiff_stats_t *stats) {
+  int ret;
+  
+  if (c->o.ptr) {
+    xmparam_t xmp;
+    memset(&xmp, 0, sizeof(xmp));
+    xmp.xpp.flags = flags;
+    xmp.marker_size = 7;
+    
+    mmbuffer_t merged = {NULL, 0};
+    ret = bare_xdiff_run_merge(&c->o, &c->a, &c->b, &xmp, &merged, stats);
+    free(merged.ptr);
+  } else {
+    bare_xdiff_diff_options_t options = {
+      .flags = flags,
+      .granularity = BARE_XDIFF_GRANULARITY_LINE,
+      .encoding = BARE_XDIFF_ENCODING_UNIFIED,
+      .stats = stats != NULL,
+    };
+    bare_xdiff_output_t output = {NULL, 0, 0};
+    ret = bare_xdiff_run_diff(&c->a, &c->b, &options, &output, stats);
+    free(output.data);
+  }
+  
+  return ret;
+}
+
+// Run a diff or merge of a case the given number of times. Time and
+// allocations are measured on plain runs, and the phases on separate runs
+// with stats, which prepare the inputs once more.
+static int
+bare_xdiff_bench_run(bare_xdiff_bench_case_t *c, uint32_t flags, int iterations, bare_xdiff_bench_result_t *result) {
+  memset(result, 0, sizeof(*result));
+  
+  uint64_t allocations = bare_xdiff_bench_allocations;
+  uint64_t allocated = bare_xdiff_bench_allocated;
+  uint64_t start = bare_xdiff_hrtime();
+  
+  for (int i = 0; i < iterations; i++) {
+    if (bare_xdiff_bench_once(c, flags, NULL) < 0) return -1;
+  }
+  
+  result->elapsed_ns = bare_xdiff_hrtime() - start;
+  result->allocations = bare_xdiff_bench_allocations - allocations;
+  result->allocated = bare_xdiff_bench_allocated - allocated;
+  
+  for (int i = 0; i < iterations; i++) {
+    bare_xdiff_stats_t stats;
+    memset(&stats, 0, sizeof(stats));
+    
+    if (bare_xdiff_bench_once(c, flags, &stats) < 0) return -1;
+    
+    result->prepare_ns += stats.prepare_ns;
+    result->search_ns += stats.search_ns;
+    result->emit_ns += stats.emit_ns;
+    result->last = stats;
+  }
+  
+  return 0;
+}
+
+// Print the averages of the runs of a case
+static void
+bare_xdiff_bench_report(bare_xdiff_bench_case_t *c, const char *algorithm, int iterations, bare_xdiff_bench_result_t *result) {
+  double bytes = (double)c->a.size + (double)c->b.size + (c->o.ptr ? (double)c->o.size : 0);
+  double elapsed = (double)result->elapsed_ns / iterations;
+  
+  printf(
+    "%-20s %-10s %10.1f MB/s %10.3f ms %10.3f %10.3f %10.3f %8" PRIu64 " %10" PRIu64 " %8" PRIu64 " %12" PRIu64 " %12" PRIu64 "\n",
+    c->name,
+    algorithm,
+    elapsed > 0 ? bytes / elapsed * 1e3 : 0,
+    elapsed / 1e6,
+    (double)result->prepare_ns / iterations / 1e6,
+    (double)result->search_ns / iterations / 1e6,
+    (double)result->emit_ns / iterations / 1e6,
+    result->last.hunks,
+    result->last.bytes,
+    result->allocations / iterations,
+    result->allocated / iterations,
+    result->last.estimated_memory
+  );
+}
+
+// Print the command line usage
+static void
+bare_xdiff_bench_usage(const char *argv0) {
+  fprintf(stderr, "usage: %s [--iterations n] [--algorithm myers|patience|histogram] [a b [o]]\n", argv0);
+  fprintf(stderr, "Without files, synthetic corpora are diffed and merged. With o, a and b are merged.\n");
+}
+
+int
+main(int argc, char **argv) {
+  int iterations = 10;
+  const char *algorithm = NULL;
+  const char *paths[3];
+  int paths_len = 0;
+  
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+      iterations = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--algorithm") == 0 && i + 1 < argc) {
+      algorithm = argv[++i];
+    } else if (argv[i][0] != '-' && paths_len < 3) {
+      paths[paths_len++] = argv[i];
+    } else {
+      bare_xdiff_bench_usage(argv[0]);
+      return 1;
+    }
+  }
+  
+  bool known = algorithm == NULL;
+  
+  for (size_t j = 0; !known && j < sizeof(bare_xdiff_bench_algorithms) / sizeof(bare_xdiff_bench_algorithms[0]); j++) {
+    known = strcmp(algorithm, bare_xdiff_bench_algorithms[j].name) == 0;
+  }
+  
+  if (iterations < 1 || paths_len == 1 || !known) {
+    bare_xdiff_bench_usage(argv[0]);
+    return 1;
+  }
+  
+  bare_xdiff_bench_case_t cases[4];
+  size_t cases_len = 0;
+  
+  if (paths_len > 0) {
+    bare_xdiff_bench_case_t c;
+    memset(&c, 0, sizeof(c));
+    c.name = paths_len == 3 ? "merge" : "diff";
+    
+    if (bare_xdiff_bench_read(paths[0], &c.a) < 0 || bare_xdiff_bench_read(paths[1], &c.b) < 0 || (paths_len == 3 && bare_xdiff_bench_read(paths[2], &c.o) < 0)) {
+      fprintf(stderr, "Failed to read input files\n");
+      return 1;
+    }
+    
+    cases[cases_len++] = c;
+  } else {
+    static const struct {
+      const char *name;
+      size_t lines;
+      size_t rate;
+    } corpora[] = {
+      {"diff 1k lines", 1000, 20},
+      {"diff 100k lines", 100000, 50},
+      {"diff 1m lines", 1000000, 200},
+    };
+    
+    for (size_t i = 0; i < sizeof(corpora) / sizeof(corpora[0]); i++) {
+      bare_xdiff_bench_case_t c;
+      memset(&c, 0, sizeof(c));
+      c.name = corpora[i].name;
+      c.a = bare_xdiff_bench_generate(corpora[i].lines, 0x9e3779b97f4a7c15ULL + i);
+      c.b = bare_xdiff_bench_edit(c.a, corpora[i].rate, 0x2545f4914f6cdd1dULL + i);
+      cases[cases_len++] = c;
+    }
+    
+    bare_xdiff_bench_case_t merge;
+    memset(&merge, 0, sizeof(merge));
+    merge.name = "merge 100k lines";
+    merge.o = bare_xdiff_bench_generate(100000, 0x853c49e6748fea9bULL);
+    merge.a = bare_xdiff_bench_edit(merge.o, 100, 0xda3e39cb94b95bdbULL);
+    merge.b = bare_xdiff_bench_edit(merge.o, 100, 0x5851f42d4c957f2dULL);
+    cases[cases_len++] = merge;
+  }
+  
+  bare_xdiff_cpu_init();
+  
+  uint32_t kernels = bare_xdiff_cpu_kernels();
+  printf("kernels: %s\n\n", kernels == BARE_XDIFF_CPU_AVX512 ? "avx512" : kernels == BARE_XDIFF_CPU_AVX2 ? "avx2" : kernels == BARE_XDIFF_CPU_NEON ? "neon" : "scalar");
+  
+  printf(
+    "%-20s %-10s %15s %13s %10s %10s %10s %8s %10s %8s %12s %12s\n",
+    "case", "algorithm", "throughput", "time", "prepare", "search", "emit", "hunks", "bytes", "allocs", "allocated", "est. memory"
+  );
+  
+  for (size_t i = 0; i < cases_len; i++) {
+    for (size_t j = 0; j < sizeof(bare_xdiff_bench_algorithms) / sizeof(bare_xdiff_bench_algorithms[0]); j++) {
+      if (algorithm && strcmp(algorithm, bare_xdiff_bench_algorithms[j].name) != 0) continue;
+      
+      bare_xdiff_bench_result_t result;
+      
+      if (bare_xdiff_bench_run(&cases[i], bare_xdiff_bench_algorithms[j].flags, iterations, &result) < 0) {
+        fprintf(stderr, "%s failed with %s\n", cases[i].name, bare_xdiff_bench_algorithms[j].name);
+        return 1;
+      }
+      
+      bare_xdiff_bench_report(&cases[i], bare_xdiff_bench_algorithms[j].name, iterations, &result);
+    }
+  }
+  
+  for (size_t i = 0; i < cases_len; i++) {
+    free(cases[i].a.ptr);
+    free(cases[i].b.ptr);
+    free(cases[i].o.ptr);
+  }
+  
+  return 0;
+}
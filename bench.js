@@ -1,5 +1,6 @@
 const { diff, merge, diffSync, mergeSync } = require('.')
 const process = require('process')
+const fs = require('fs')
 const top = require('process-top')
 const b4a = require('b4a')
 
@@ -34,6 +35,38 @@ function generateModifiedData(original) {
   return b4a.from(modifiedLines.join('\n'))
 }
 
+// Time a single async operation from submission to resolution
+async function measureAsync(fn) {
+  const start = process.hrtime.bigint()
+  const result = await fn()
+  const end = process.hrtime.bigint()
+  return { time: Number(end - start) / 1000000, result }
+}
+
+// Nearest-rank percentile of an ascending array
+function percentile(sorted, p) {
+  const index = Math.ceil((p / 100) * sorted.length) - 1
+  return sorted[Math.min(sorted.length - 1, Math.max(0, index))]
+}
+
+// Latency distribution of a set of operation times in milliseconds. When the
+// wall clock time of the whole run is given, throughput is reported in
+// operations per second
+function summarize(times, elapsed = 0) {
+  const sorted = [...times].sort((a, b) => a - b)
+  
+  return {
+    count: sorted.length,
+    min: sorted[0],
+    avg: sorted.reduce((a, b) => a + b, 0) / sorted.length,
+    p50: percentile(sorted, 50),
+    p95: percentile(sorted, 95),
+    p99: percentile(sorted, 99),
+    max: sorted[sorted.length - 1],
+    throughput: elapsed > 0 ? sorted.length / (elapsed / 1000) : 0
+  }
+}
+
 // Benchmark configuration
 const sizes = [
   { name: '4KB', bytes: 4 * 1024 },
@@ -69,25 +102,17 @@ async function benchmarkDiff(name, size, iterations = 5) {
   console.log(`Data size: ${(size / 1024).toFixed(1)}KB`)
   console.log(`Running ${iterations} iterations...`)
   
-  // Benchmark async diff - run all iterations in parallel
+  // Benchmark async diff - run all iterations in parallel, timing each
+  // operation from submission to resolution
   const asyncPromises = []
-  const asyncTimes = []
   
   for (let i = 0; i < iterations; i++) {
-    asyncPromises.push(diff(original, modified))
+    asyncPromises.push(measureAsync(() => diff(original, modified)))
   }
   
-  const batchStart = process.hrtime.bigint()
-  const asyncResults = await Promise.all(asyncPromises)
-  const batchEnd = process.hrtime.bigint()
-  
-  const totalBatchTime = Number(batchEnd - batchStart) / 1000000
-  const avgTimePerOperation = totalBatchTime / iterations
-  
-  // Fill the times array with the average time
-  for (let i = 0; i < iterations; i++) {
-    asyncTimes.push(avgTimePerOperation)
-  }
+  const asyncMeasurements = await Promise.all(asyncPromises)
+  const asyncResults = asyncMeasurements.map((m) => m.result)
+  const asyncTimes = asyncMeasurements.map((m) => m.time)
   
   console.log(`Diff output size: ${(asyncResults[0].length / 1024).toFixed(1)}KB`)
   
@@ -106,9 +131,11 @@ async function benchmarkDiff(name, size, iterations = 5) {
   const syncAvg = syncTimes.reduce((a, b) => a + b, 0) / syncTimes.length
   const asyncMin = Math.min(...asyncTimes)
   const syncMin = Math.min(...syncTimes)
+  const asyncStats = summarize(asyncTimes)
+  const syncStats = summarize(syncTimes)
   
-  console.log(`Async diff: ${asyncAvg.toFixed(2)}ms avg, ${asyncMin.toFixed(2)}ms min`)
-  console.log(`Sync diff:  ${syncAvg.toFixed(2)}ms avg, ${syncMin.toFixed(2)}ms min`)
+  console.log(`Async diff: ${asyncAvg.toFixed(2)}ms avg, ${asyncMin.toFixed(2)}ms min, ${asyncStats.p50.toFixed(2)}ms p50, ${asyncStats.p99.toFixed(2)}ms p99`)
+  console.log(`Sync diff:  ${syncAvg.toFixed(2)}ms avg, ${syncMin.toFixed(2)}ms min, ${syncStats.p50.toFixed(2)}ms p50, ${syncStats.p99.toFixed(2)}ms p99`)
   
   return {
     size: name,
@@ -117,7 +144,9 @@ async function benchmarkDiff(name, size, iterations = 5) {
     syncAvg,
     asyncMin,
     syncMin,
-    diffOutputSize: 0 // Will be set by first iteration
+    asyncStats,
+    syncStats,
+    diffOutputSize: asyncResults[0].length
   }
 }
 
@@ -133,25 +162,17 @@ async function benchmarkMerge(name, size, iterations = 5) {
   console.log(`Data size: ${(size / 1024).toFixed(1)}KB`)
   console.log(`Running ${iterations} iterations...`)
   
-  // Benchmark async merge - run all iterations in parallel
+  // Benchmark async merge - run all iterations in parallel, timing each
+  // operation from submission to resolution
   const asyncPromises = []
-  const asyncTimes = []
   
   for (let i = 0; i < iterations; i++) {
-    asyncPromises.push(merge(ancestor, ours, theirs))
+    asyncPromises.push(measureAsync(() => merge(ancestor, ours, theirs)))
   }
   
-  const batchStart = process.hrtime.bigint()
-  const asyncResults = await Promise.all(asyncPromises)
-  const batchEnd = process.hrtime.bigint()
-  
-  const totalBatchTime = Number(batchEnd - batchStart) / 1000000
-  const avgTimePerOperation = totalBatchTime / iterations
-  
-  // Fill the times array with the average time
-  for (let i = 0; i < iterations; i++) {
-    asyncTimes.push(avgTimePerOperation)
-  }
+  const asyncMeasurements = await Promise.all(asyncPromises)
+  const asyncResults = asyncMeasurements.map((m) => m.result)
+  const asyncTimes = asyncMeasurements.map((m) => m.time)
   
   console.log(`Merge output size: ${(asyncResults[0].output.length / 1024).toFixed(1)}KB`)
   
@@ -170,9 +191,11 @@ async function benchmarkMerge(name, size, iterations = 5) {
   const syncAvg = syncTimes.reduce((a, b) => a + b, 0) / syncTimes.length
   const asyncMin = Math.min(...asyncTimes)
   const syncMin = Math.min(...syncTimes)
+  const asyncStats = summarize(asyncTimes)
+  const syncStats = summarize(syncTimes)
   
-  console.log(`Async merge: ${asyncAvg.toFixed(2)}ms avg, ${asyncMin.toFixed(2)}ms min`)
-  console.log(`Sync merge:  ${syncAvg.toFixed(2)}ms avg, ${syncMin.toFixed(2)}ms min`)
+  console.log(`Async merge: ${asyncAvg.toFixed(2)}ms avg, ${asyncMin.toFixed(2)}ms min, ${asyncStats.p50.toFixed(2)}ms p50, ${asyncStats.p99.toFixed(2)}ms p99`)
+  console.log(`Sync merge:  ${syncAvg.toFixed(2)}ms avg, ${syncMin.toFixed(2)}ms min, ${syncStats.p50.toFixed(2)}ms p50, ${syncStats.p99.toFixed(2)}ms p99`)
   
   return {
     size: name,
@@ -180,10 +203,99 @@ async function benchmarkMerge(name, size, iterations = 5) {
     asyncAvg,
     syncAvg,
     asyncMin,
-    syncMin
+    syncMin,
+    asyncStats,
+    syncStats
   }
 }
 
+// Run `operations` async operations keeping `concurrency` of them in flight
+// at all times, timing each one individually
+async function runConcurrent(fn, concurrency, operations) {
+  const times = []
+  let started = 0
+  
+  async function worker() {
+    while (started < operations) {
+      started++
+      const { time } = await measureAsync(fn)
+      times.push(time)
+    }
+  }
+  
+  const start = process.hrtime.bigint()
+  const workers = []
+  for (let i = 0; i < concurrency; i++) workers.push(worker())
+  await Promise.all(workers)
+  const end = process.hrtime.bigint()
+  
+  return summarize(times, Number(end - start) / 1000000)
+}
+
+// Sync operations block the event loop, so they can only ever run one at a
+// time and are measured once as the reference for the async sweep
+function runSequential(fn, operations) {
+  const times = []
+  
+  const start = process.hrtime.bigint()
+  for (let i = 0; i < operations; i++) {
+    const operationStart = process.hrtime.bigint()
+    fn()
+    const operationEnd = process.hrtime.bigint()
+    times.push(Number(operationEnd - operationStart) / 1000000)
+  }
+  const end = process.hrtime.bigint()
+  
+  return summarize(times, Number(end - start) / 1000000)
+}
+
+function printLatency(label, stats) {
+  console.log(
+    `${label.padEnd(11)} | ${stats.p50.toFixed(2).padStart(8)}ms | ${stats.p95.toFixed(2).padStart(8)}ms | ${stats.p99.toFixed(2).padStart(8)}ms | ${stats.max.toFixed(2).padStart(8)}ms | ${stats.throughput.toFixed(1).padStart(9)}`
+  )
+}
+
+async function benchmarkConcurrency(name, size, { levels = [1, 2, 4, 8, 16, 32], operations = 64 } = {}) {
+  console.log(`\n=== Concurrency Sweep: ${name} ===`)
+  
+  const original = generateRandomData(size)
+  const modified = generateModifiedData(original)
+  const theirs = b4a.from(b4a.toString(generateModifiedData(original)) + '_theirs')
+  
+  console.log(`Data size: ${(size / 1024).toFixed(1)}KB, ${operations} operations per level`)
+  
+  const results = { size: name, bytes: size, diff: [], merge: [] }
+  
+  const operationsByName = {
+    diff: {
+      sync: () => diffSync(original, modified),
+      async: () => diff(original, modified)
+    },
+    merge: {
+      sync: () => mergeSync(original, modified, theirs),
+      async: () => merge(original, modified, theirs)
+    }
+  }
+  
+  for (const [operation, { sync, async }] of Object.entries(operationsByName)) {
+    console.log(`\n${operation}:`)
+    console.log('In flight   |      p50   |      p95   |      p99   |      max   |     ops/s')
+    console.log('------------|------------|------------|------------|------------|----------')
+    
+    const syncStats = runSequential(sync, operations)
+    printLatency('sync', syncStats)
+    results[operation].push({ concurrency: 'sync', ...syncStats })
+    
+    for (const concurrency of levels) {
+      const asyncStats = await runConcurrent(async, concurrency, operations)
+      printLatency(`async ${concurrency}`, asyncStats)
+      results[operation].push({ concurrency, ...asyncStats })
+    }
+  }
+  
+  return results
+}
+
 async function benchmarkAlgorithms(name, size) {
   console.log(`\n=== Algorithm Comparison: ${name} ===`)
   
@@ -309,12 +421,325 @@ async function benchmarkMemoryUsage() {
   return memoryResults
 }
 
+// Seeded pseudo random number generator (mulberry32), so corpora are
+// identical across runs and machines
+function createRandom(seed) {
+  let state = seed >>> 0
+  
+  return function random() {
+    state = (state + 0x6d2b79f5) >>> 0
+    let t = state
+    t = Math.imul(t ^ (t >>> 15), t | 1)
+    t ^= t + Math.imul(t ^ (t >>> 7), t | 61)
+    return ((t ^ (t >>> 14)) >>> 0) / 4294967296
+  }
+}
+
+function pick(random, list) {
+  return list[Math.floor(random() * list.length)]
+}
+
+const words = [
+  'the', 'of', 'and', 'to', 'in', 'is', 'that', 'for', 'it', 'with', 'as',
+  'was', 'on', 'be', 'by', 'this', 'are', 'from', 'or', 'have', 'an', 'they',
+  'which', 'one', 'you', 'were', 'all', 'we', 'when', 'there', 'can', 'been',
+  'file', 'change', 'line', 'system', 'result', 'value', 'patch', 'history',
+  'revision', 'merge', 'conflict', 'buffer', 'record', 'update', 'review'
+]
+
+const identifiers = [
+  'buffer', 'offset', 'length', 'result', 'options', 'entry', 'index', 'count',
+  'node', 'value', 'state', 'output', 'input', 'hunk', 'line', 'record', 'key',
+  'handle', 'request', 'callback', 'error', 'status', 'size', 'next', 'prev'
+]
+
+// Source code like lines: functions with bodies, blank lines and closing
+// braces that repeat often, which is what the histogram and patience
+// algorithms are designed for
+function generateSourceLines(count, random) {
+  const lines = []
+  
+  while (lines.length < count) {
+    const name = pick(random, identifiers) + '_' + Math.floor(random() * 1000)
+    const args = [pick(random, identifiers), pick(random, identifiers)]
+    lines.push(`function ${name}(${args.join(', ')}) {`)
+    
+    const body = 2 + Math.floor(random() * 12)
+    for (let i = 0; i < body; i++) {
+      const indent = random() < 0.3 ? '    ' : '  '
+      const r = random()
+      if (r < 0.15) lines.push(`${indent}if (${pick(random, identifiers)} === null) return`)
+      else if (r < 0.25) lines.push(`${indent}}`)
+      else if (r < 0.3) lines.push('')
+      else lines.push(`${indent}const ${pick(random, identifiers)} = ${pick(random, identifiers)}.${pick(random, identifiers)}(${Math.floor(random() * 100)})`)
+    }
+    
+    lines.push('}')
+    lines.push('')
+  }
+  
+  return lines.slice(0, count)
+}
+
+// Prose: long lines of words wrapped at paragraph boundaries
+function generateProseLines(count, random) {
+  const lines = []
+  
+  while (lines.length < count) {
+    const sentence = []
+    const length = 8 + Math.floor(random() * 30)
+    for (let i = 0; i < length; i++) sentence.push(pick(random, words))
+    lines.push(sentence.join(' ') + '.')
+    if (random() < 0.2) lines.push('')
+  }
+  
+  return lines.slice(0, count)
+}
+
+// Logs: almost every line is unique because of the timestamp prefix
+function generateLogLines(count, random) {
+  const levels = ['DEBUG', 'INFO', 'INFO', 'INFO', 'WARN', 'ERROR']
+  const lines = []
+  let time = 1700000000000
+  
+  for (let i = 0; i < count; i++) {
+    time += Math.floor(random() * 5000)
+    const message = []
+    const length = 4 + Math.floor(random() * 10)
+    for (let j = 0; j < length; j++) message.push(pick(random, words))
+    lines.push(`${new Date(time).toISOString()} ${pick(random, levels)} [${pick(random, identifiers)}] ${message.join(' ')} id=${Math.floor(random() * 0xffffffff).toString(16)}`)
+  }
+  
+  return lines
+}
+
+// Replace, insert and delete roughly `rate` of the lines
+function applyEdits(lines, rate, random, generate) {
+  const result = []
+  
+  for (const line of lines) {
+    const r = random()
+    if (r < rate / 3) continue
+    if (r < rate * 2 / 3) {
+      result.push(generate(1, random)[0])
+      continue
+    }
+    result.push(line)
+    if (r < rate) result.push(generate(1, random)[0])
+  }
+  
+  return result
+}
+
+// Move `count` blocks of up to 50 lines to random positions
+function moveBlocks(lines, count, random) {
+  const result = [...lines]
+  
+  for (let i = 0; i < count; i++) {
+    const length = 1 + Math.floor(random() * 50)
+    const from = Math.floor(random() * Math.max(1, result.length - length))
+    const block = result.splice(from, length)
+    const to = Math.floor(random() * result.length)
+    result.splice(to, 0, ...block)
+  }
+  
+  return result
+}
+
+// Generate the benchmark corpora. Every corpus is derived from `seed` so
+// that results can be compared against a saved baseline
+function generateCorpora(lines, seed) {
+  const corpora = []
+  const join = (lines) => b4a.from(lines.join('\n') + '\n')
+  
+  const generators = [
+    { name: 'source', generate: generateSourceLines },
+    { name: 'prose', generate: generateProseLines },
+    { name: 'logs', generate: generateLogLines }
+  ]
+  
+  for (const { name, generate } of generators) {
+    const random = createRandom(seed)
+    const a = generate(lines, random)
+    const b = applyEdits(a, 0.05, random, generate)
+    corpora.push({ name, a: join(a), b: join(b) })
+  }
+  
+  {
+    const random = createRandom(seed)
+    const a = generateProseLines(Math.ceil(lines / 8), random).join(' ')
+    const tokens = a.split(' ')
+    for (let i = 0; i < tokens.length; i++) {
+      if (random() < 0.01) tokens[i] = pick(random, words)
+    }
+    corpora.push({ name: 'minified', a: b4a.from(a), b: b4a.from(tokens.join(' ')) })
+  }
+  
+  {
+    const random = createRandom(seed)
+    const a = generateSourceLines(lines, random)
+    const b = moveBlocks(a, Math.max(1, Math.floor(lines / 200)), random)
+    corpora.push({ name: 'heavy-move', a: join(a), b: join(b) })
+  }
+  
+  {
+    const random = createRandom(seed)
+    const a = generateSourceLines(lines, random)
+    const b = [...a]
+    b[Math.floor(random() * b.length)] += ' // changed'
+    corpora.push({ name: 'near-identical', a: join(a), b: join(b) })
+  }
+  
+  {
+    const a = generateSourceLines(lines, createRandom(seed))
+    const b = generateSourceLines(lines, createRandom(seed + 1))
+    corpora.push({ name: 'fully-different', a: join(a), b: join(b) })
+  }
+  
+  return corpora
+}
+
+async function benchmarkCorpora({ lines = 100000, seed = 1, iterations = 5 } = {}) {
+  console.log(`\n=== Corpus Benchmark: ${lines} lines, seed ${seed} ===`)
+  
+  const algorithms = ['myers', 'minimal', 'patience', 'histogram']
+  const results = []
+  
+  for (const corpus of generateCorpora(lines, seed)) {
+    const bytes = corpus.a.byteLength + corpus.b.byteLength
+    
+    for (const algorithm of algorithms) {
+      const options = algorithm === 'myers' ? {} : { algorithm }
+      const times = []
+      let outputSize = 0
+      
+      for (let i = 0; i < iterations; i++) {
+        const start = process.hrtime.bigint()
+        const result = diffSync(corpus.a, corpus.b, options)
+        const end = process.hrtime.bigint()
+        times.push(Number(end - start) / 1000000)
+        outputSize = result.byteLength
+      }
+      
+      times.sort((a, b) => a - b)
+      
+      const median = times[Math.floor(times.length / 2)]
+      const min = times[0]
+      const throughput = bytes / (1024 * 1024) / (median / 1000)
+      
+      console.log(`${corpus.name.padEnd(15)} ${algorithm.padEnd(9)} ${median.toFixed(2).padStart(10)}ms median, ${min.toFixed(2).padStart(10)}ms min, ${throughput.toFixed(2).padStart(8)}MB/s, output: ${(outputSize / 1024).toFixed(1)}KB`)
+      
+      results.push({ corpus: corpus.name, algorithm, bytes, median, min, throughput, outputSize })
+    }
+  }
+  
+  return {
+    platform: process.platform,
+    arch: process.arch,
+    lines,
+    seed,
+    iterations,
+    results
+  }
+}
+
+// Compare corpus results against a baseline produced by an earlier run with
+// the same settings. Returns the entries whose median time grew by more than
+// `threshold`, or whose output changed, which would mean the results are no
+// longer comparable
+function compareBaseline(current, baseline, threshold = 0.1) {
+  const regressions = []
+  
+  if (current.lines !== baseline.lines || current.seed !== baseline.seed) {
+    throw new Error('Baseline was recorded with different corpus settings')
+  }
+  
+  console.log(`\n=== Baseline Comparison: threshold ${(threshold * 100).toFixed(0)}% ===`)
+  
+  for (const result of current.results) {
+    const previous = baseline.results.find((entry) => entry.corpus === result.corpus && entry.algorithm === result.algorithm)
+    
+    // A run the baseline has no entry for cannot be checked, so it fails
+    if (!previous) {
+      console.log(`${result.corpus.padEnd(15)} ${result.algorithm.padEnd(9)} MISSING FROM BASELINE`)
+      regressions.push({ ...result, missing: true })
+      continue
+    }
+    
+    const change = result.median / previous.median - 1
+    const regressed = change > threshold
+    const changed = result.outputSize !== previous.outputSize
+    
+    console.log(`${result.corpus.padEnd(15)} ${result.algorithm.padEnd(9)} ${previous.median.toFixed(2).padStart(10)}ms -> ${result.median.toFixed(2).padStart(10)}ms ${((change >= 0 ? '+' : '') + (change * 100).toFixed(1) + '%').padStart(8)}${regressed ? ' REGRESSION' : ''}${changed ? ' OUTPUT CHANGED' : ''}`)
+    
+    if (regressed || changed) regressions.push({ ...result, baseline: previous.median, change, changed })
+  }
+  
+  for (const entry of baseline.results) {
+    if (current.results.some((result) => result.corpus === entry.corpus && result.algorithm === entry.algorithm)) continue
+    
+    console.log(`${entry.corpus.padEnd(15)} ${entry.algorithm.padEnd(9)} MISSING FROM RUN`)
+    regressions.push({ ...entry, missing: true })
+  }
+  
+  return regressions
+}
+
+async function runCorpusBenchmarks(args) {
+  const option = (name, fallback) => {
+    const i = args.indexOf(name)
+    return i === -1 ? fallback : args[i + 1]
+  }
+  
+  const current = await benchmarkCorpora({
+    lines: Number(option('--lines', 100000)),
+    seed: Number(option('--seed', 1)),
+    iterations: Number(option('--iterations', 5))
+  })
+  
+  const output = option('--json', null)
+  if (output) {
+    fs.writeFileSync(output, JSON.stringify(current, null, 2) + '\n')
+    console.log(`\nResults written to ${output}`)
+  }
+  
+  const baseline = option('--baseline', null)
+  if (baseline) {
+    const regressions = compareBaseline(current, JSON.parse(fs.readFileSync(baseline, 'utf8')), Number(option('--threshold', 0.1)))
+    
+    if (regressions.length > 0) {
+      console.log(`\n❌ ${regressions.length} regression(s) against ${baseline}`)
+      process.exitCode = 1
+    } else {
+      console.log(`\n✅ No regressions against ${baseline}`)
+    }
+  }
+}
+
+async function runConcurrencyBenchmarks(args) {
+  const option = (name, fallback) => {
+    const i = args.indexOf(name)
+    return i === -1 ? fallback : args[i + 1]
+  }
+  
+  const size = Number(option('--size', 64)) * 1024
+  const max = Number(option('--max', 32))
+  const levels = []
+  for (let concurrency = 1; concurrency <= max; concurrency *= 2) levels.push(concurrency)
+  
+  await benchmarkConcurrency(`${size / 1024}KB`, size, {
+    levels,
+    operations: Number(option('--operations', 64))
+  })
+}
+
 async function runAllBenchmarks() {
   console.log('🚀 bare-xdiff Performance Benchmark Suite')
   console.log('==========================================')
   
   const diffResults = []
   const mergeResults = []
+  const concurrencyResults = []
   
   for (const { name, bytes } of sizes) {
     try {
@@ -329,6 +754,7 @@ async function runAllBenchmarks() {
       // Algorithm comparison for smaller files
       if (bytes <= 1024 * 1024) {
         await benchmarkAlgorithms(name, bytes)
+        concurrencyResults.push(await benchmarkConcurrency(name, bytes))
       }
       
     } catch (error) {
@@ -372,6 +798,23 @@ async function runAllBenchmarks() {
     )
   }
   
+  // Tail latency summary, taken from the highest concurrency level
+  if (concurrencyResults.length > 0) {
+    console.log('\nTail Latency (p99, ms):')
+    console.log('Size      | Diff Sync | Diff Async | Merge Sync | Merge Async | In flight')
+    console.log('----------|-----------|------------|------------|-------------|----------')
+    
+    for (const result of concurrencyResults) {
+      const diffSync = result.diff[0]
+      const diffAsync = result.diff[result.diff.length - 1]
+      const mergeSync = result.merge[0]
+      const mergeAsync = result.merge[result.merge.length - 1]
+      console.log(
+        `${result.size.padEnd(9)} | ${diffSync.p99.toFixed(2).padStart(9)} | ${diffAsync.p99.toFixed(2).padStart(10)} | ${mergeSync.p99.toFixed(2).padStart(10)} | ${mergeAsync.p99.toFixed(2).padStart(11)} | ${String(diffAsync.concurrency).padStart(9)}`
+      )
+    }
+  }
+  
   // Memory usage summary
   if (memoryResults.length > 0) {
     console.log('\nMemory Usage Analysis:')
@@ -393,14 +836,30 @@ async function runAllBenchmarks() {
 if (require.main === module) {
   console.log(`Platform: ${process.platform} ${process.arch}\n`)
   
-  runAllBenchmarks().catch(console.error)
+  const args = process.argv.slice(2)
+  
+  if (args.includes('--corpus')) {
+    // A failing comparison must fail the job that runs it
+    runCorpusBenchmarks(args).catch((err) => {
+      console.error(err)
+      process.exitCode = 1
+    })
+  } else if (args.includes('--concurrency')) {
+    runConcurrencyBenchmarks(args).catch(console.error)
+  } else {
+    runAllBenchmarks().catch(console.error)
+  }
 }
 
 module.exports = {
   benchmarkDiff,
   benchmarkMerge,
   benchmarkAlgorithms,
+  benchmarkConcurrency,
   benchmarkMemoryUsage,
+  benchmarkCorpora,
+  compareBaseline,
+  generateCorpora,
   generateRandomData,
   generateModifiedData
 }
\ No newline at end of file
@@ -2,13 +2,22 @@
 #include <bare.h>
 #include <js.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <uv.h>
 
+#if !defined(_WIN32)
+#include <regex.h>
+#endif
+
 // Include xdiff headers
 #include "xdiff.h"
 
+#include "core.h"
+#include "cpu.h"
+#include "tree.h"
+
 // XDL merge constants (in case not defined in header)
 #ifndef XDL_MERGE_MINIMAL
 #define XDL_MERGE_MINIMAL 0
@@ -28,12 +37,182 @@
 #define XDL_MERGE_ZEALOUS_DIFF3 2
 #endif
 
+// Operation types for async requests
+#define BARE_XDIFF_OP_DIFF 0
+#define BARE_XDIFF_OP_MERGE 1
+#define BARE_XDIFF_OP_DELTA 2
+#define BARE_XDIFF_OP_APPLY_DELTA 3
+#define BARE_XDIFF_OP_APPLY_PATCH 4
+#define BARE_XDIFF_OP_INVERT_PATCH 5
+#define BARE_XDIFF_OP_COMPOSE_PATCHES 6
+#define BARE_XDIFF_OP_DIFF_MANY 7
+#define BARE_XDIFF_OP_SIMILARITY 8
+#define BARE_XDIFF_OP_DIFF_TREES 9
+#define BARE_XDIFF_OP_BLAME 10
+
+// Input bytes per thread a diffMany job needs before it starts another one
+#define BARE_XDIFF_DIFF_MANY_THREAD_BYTES (256 * 1024)
+
+// Key of a cached diff result: hashes and lengths of both inputs, and the
+// options the diff was computed with
+typedef struct {
+  uint64_t hash1;
+  uint64_t hash2;
+  uint64_t len1;
+  uint64_t len2;
+  uint64_t options;
+  uint64_t lines;  // Hash of the anchors and ignored line patterns, 0 for none
+} bare_xdiff_cache_key_t;
+
+typedef struct bare_xdiff_cache_entry_s bare_xdiff_cache_entry_t;
+
+// Cached diff result, shared with JavaScript
+struct bare_xdiff_cache_entry_s {
+  bare_xdiff_cache_key_t key;
+  js_ref_t *result;
+  size_t bytes;
+  bare_xdiff_cache_entry_t *prev;   // More recently used
+  bare_xdiff_cache_entry_t *next;   // Less recently used
+  bare_xdiff_cache_entry_t *chain;  // Next entry in the same bucket
+};
+
+// LRU cache of diff results, bounded by bytes. Disabled while max_bytes is 0.
+typedef struct {
+  js_env_t *env;
+  bare_xdiff_cache_entry_t **buckets;
+  size_t buckets_len;
+  bare_xdiff_cache_entry_t *head;
+  bare_xdiff_cache_entry_t *tail;
+  size_t entries;
+  size_t bytes;
+  size_t max_bytes;
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t evictions;
+  uint32_t pending;  // Requests that will store their result
+  bool closing;
+} bare_xdiff_cache_t;
+
+// Atomic counter operations, cheap enough to leave on in the hot paths
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define bare_xdiff_atomic_add(ptr, value) _InterlockedExchangeAdd64((volatile __int64 *)(ptr), (__int64)(value))
+#define bare_xdiff_atomic_sub(ptr, value) _InterlockedExchangeAdd64((volatile __int64 *)(ptr), -(__int64)(value))
+#define bare_xdiff_atomic_load(ptr) ((uint64_t)_InterlockedOr64((volatile __int64 *)(ptr), 0))
+#else
+#define bare_xdiff_atomic_add(ptr, value) __atomic_fetch_add(ptr, (uint64_t)(value), __ATOMIC_RELAXED)
+#define bare_xdiff_atomic_sub(ptr, value) __atomic_fetch_sub(ptr, (uint64_t)(value), __ATOMIC_RELAXED)
+#define bare_xdiff_atomic_load(ptr) __atomic_load_n(ptr, __ATOMIC_RELAXED)
+#endif
+
+// Input size buckets and latency bins of the metrics histograms. Each has
+// one more slot than bounds for everything above the last bound.
+#define BARE_XDIFF_METRICS_SIZES 6
+#define BARE_XDIFF_METRICS_BINS 8
+
+static const uint64_t bare_xdiff_metrics_sizes[BARE_XDIFF_METRICS_SIZES - 1] = {
+  1ULL << 10, 1ULL << 14, 1ULL << 18, 1ULL << 22, 1ULL << 26
+};
+
+// Latency bin bounds, in nanoseconds
+static const uint64_t bare_xdiff_metrics_bins[BARE_XDIFF_METRICS_BINS - 1] = {
+  10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL, 1000000000ULL, 10000000000ULL
+};
+
+// Module wide metrics of requests run on the thread pool, shared by all
+// environments and updated atomically
+typedef struct {
+  uint64_t queued;        // Requests waiting for a worker
+  uint64_t running;       // Requests being worked on
+  uint64_t completed;
+  uint64_t failed;
+  uint64_t bytes_copied;  // Inputs copied to and results copied from native memory
+  uint64_t memory;        // Native memory held by requests
+  uint64_t latency[BARE_XDIFF_METRICS_SIZES][BARE_XDIFF_METRICS_BINS];
+  uint64_t queue_wait[BARE_XDIFF_METRICS_BINS];
+} bare_xdiff_metrics_t;
+
+static bare_xdiff_metrics_t bare_xdiff_metrics;
+
+// Output of a single diff of a diffMany job
+typedef struct {
+  bare_xdiff_output_t output;
+  bare_xdiff_stats_t stats;
+  int error_code;
+} bare_xdiff_diff_result_t;
+
+// Diffs of one base against many targets, shared by the threads working on
+// them. Targets are claimed one at a time through next.
+typedef struct {
+  mmfile_t base;
+  mmfile_t *targets;
+  size_t len;
+  const bare_xdiff_diff_options_t *options;
+  bare_xdiff_diff_result_t *results;
+  uint64_t next;
+} bare_xdiff_diff_many_t;
+
+// Changed file of a tree diff, waiting to be passed to JavaScript
+typedef struct {
+  char *path;
+  int32_t status;
+  bare_xdiff_output_t output;
+  bare_xdiff_stats_t stats;
+} bare_xdiff_tree_entry_t;
+
+// Changed files a tree diff may have passed on that JavaScript has not read
+// yet, before the threads diffing it wait for it to catch up
+#define BARE_XDIFF_TREE_MAX_UNREAD 64
+
+// Changed files of a tree diff, passed from the threads diffing them to the
+// loop, which hands them to JavaScript as they arrive. The threads stop
+// claiming files once the diff is cancelled, and wait while too many are
+// unread.
+typedef struct {
+  uv_async_t async;
+  uv_mutex_t lock;
+  uv_cond_t drained;
+  bare_xdiff_tree_entry_t *entries;
+  size_t len;
+  size_t capacity;
+  size_t unread;
+  bool cancelled;
+  js_env_t *env;
+  js_ref_t *ctx;
+  js_ref_t *onentry;
+  bare_xdiff_diff_options_t options;
+} bare_xdiff_tree_stream_t;
+
+// Tree diff shared by the threads working on it. Files are claimed one at a
+// time through next.
+typedef struct {
+  uv_loop_t *loop;
+  const char *roots[2];
+  bare_xdiff_tree_file_t *files;
+  size_t len;
+  uint64_t next;
+  int error_code;
+  bare_xdiff_tree_stream_t *stream;
+} bare_xdiff_tree_job_t;
+
+// Blame of a chain of revisions, shared by the threads diffing them. Pairs of
+// consecutive revisions are claimed one at a time through next.
+typedef struct {
+  const mmfile_t *revisions;
+  size_t len;
+  uint32_t flags;
+  bare_xdiff_hunks_t *changes;
+  uint64_t next;
+  uint64_t failed;
+} bare_xdiff_blame_t;
+
 // Request structure for async operations
 typedef struct {
   uv_work_t request;
   js_env_t *env;
   js_ref_t *ctx;
   js_ref_t *callback;
+  int32_t type;
   
   // Input buffers
   void *buf1;
@@ -42,41 +221,276 @@ typedef struct {
   size_t len2;
   void *buf3;  // For merge operations
   size_t len3;
+  void **bufs;  // For patch composition
+  size_t *lens;
+  size_t bufs_len;
+  size_t bufs_first;  // For similarity, number of buffers in the first set
   
   // Options
-  uint32_t diff_flags;
+  bare_xdiff_diff_options_t diff_options;
   int32_t merge_level;
   int32_t merge_favor;
   int32_t merge_style;
   int32_t merge_marker_size;
+  bool merge_normalize_eol;
+  bool merge_stats;
+  double similarity_threshold;
   
   // Output
   char *result;
   size_t result_len;
   int32_t error_code;
+  const char *error_message;
   int32_t conflict_count;  // For merge operations
+  bare_xdiff_diff_result_t *results;  // For diffMany operations, one per target
+  bare_xdiff_tree_stream_t *stream;  // For diffTrees operations
+  bare_xdiff_stats_t stats;
+  
+  // Result cache
+  bare_xdiff_cache_t *cache;
+  bare_xdiff_cache_key_t cache_key;
+  
+  // Metrics
+  uv_work_cb work;
+  uint64_t queued_at;
+  size_t input_bytes;
+  size_t memory;
   
   js_deferred_teardown_t *teardown;
 } bare_xdiff_request_t;
 
-// Output buffer for capturing xdiff output
-typedef struct {
-  char *data;
-  size_t len;
-  size_t capacity;
-} bare_xdiff_output_t;
+// Get the bytes of an anchor, a string or Uint8Array, copying them to data
+// if not NULL. Returns false for any other value.
+static bool
+parse_anchor(js_env_t *env, js_value_t *value, char *data, size_t *len) {
+  js_value_type_t type;
+  if (js_typeof(env, value, &type) != 0) return false;
+  
+  if (type == js_string) {
+    if (data) return js_get_value_string_utf8(env, value, (utf8_t *)data, *len + 1, NULL) == 0;
+    return js_get_value_string_utf8(env, value, NULL, 0, len) == 0;
+  }
+  
+  bool is_typedarray;
+  if (js_is_typedarray(env, value, &is_typedarray) != 0 || !is_typedarray) return false;
+  
+  void *bytes;
+  js_typedarray_type_t typedarray_type;
+  js_value_t *arraybuffer;
+  size_t offset;
+  
+  if (js_get_typedarray_info(env, value, &typedarray_type, &bytes, len, &arraybuffer, &offset) != 0) return false;
+  if (typedarray_type != js_uint8array) return false;
+  
+  if (data) memcpy(data, (char *)bytes + offset, *len);
+  return true;
+}
+
+// Parse the anchors option into a single allocation, holding the pointers to
+// the anchors followed by the NUL-terminated anchors themselves. Anything
+// but non-empty strings and Uint8Array is skipped, as an empty anchor would
+// match every line.
+static void
+parse_anchors(js_env_t *env, js_value_t *array, bare_xdiff_diff_options_t *result) {
+  uint32_t count;
+  if (js_get_array_length(env, array, &count) != 0 || count == 0) return;
+  
+  size_t size = count * sizeof(char *);
+  
+  for (uint32_t i = 0; i < count; i++) {
+    js_value_t *element;
+    size_t len;
+    if (js_get_element(env, array, i, &element) != 0) return;
+    if (parse_anchor(env, element, NULL, &len)) size += len + 1;
+  }
+  
+  char **anchors = xdl_malloc(size);
+  if (!anchors) return;
+  
+  char *data = (char *)(anchors + count);
+  size_t len = 0;
+  
+  for (uint32_t i = 0; i < count; i++) {
+    js_value_t *element;
+    size_t anchor_len;
+    if (js_get_element(env, array, i, &element) != 0) break;
+    if (!parse_anchor(env, element, NULL, &anchor_len) || anchor_len == 0) continue;
+    if (!parse_anchor(env, element, data, &anchor_len)) continue;
+    
+    data[anchor_len] = '\0';
+    anchors[len++] = data;
+    data += anchor_len + 1;
+  }
+  
+  if (len == 0) {
+    xdl_free(anchors);
+    return;
+  }
+  
+  result->anchors = anchors;
+  result->anchors_len = len;
+}
+
+// Parse an array of POSIX extended regular expressions into a single
+// allocation holding the pointers to the compiled patterns followed by the
+// patterns themselves. Every pattern is compiled once for all of the diffs of
+// a call. index.js has checked the patterns with checkPatterns() before they
+// get here, and rejects them on Windows, where POSIX regular expressions are
+// not available.
+static void
+parse_patterns(js_env_t *env, js_value_t *array, xdl_regex_t ***result, size_t *result_len, uint64_t *result_hash) {
+#if defined(_WIN32)
+  (void)env;
+  (void)array;
+  (void)result;
+  (void)result_len;
+  (void)result_hash;
+#else
+  uint32_t count;
+  if (js_get_array_length(env, array, &count) != 0 || count == 0) return;
+  
+  xdl_regex_t **regex = xdl_malloc(count * (sizeof(xdl_regex_t *) + sizeof(xdl_regex_t)));
+  if (!regex) return;
+  
+  xdl_regex_t *compiled = (xdl_regex_t *)(regex + count);
+  size_t len = 0;
+  uint64_t hash = 0;
+  
+  for (uint32_t i = 0; i < count; i++) {
+    js_value_t *element;
+    js_value_type_t type;
+    if (js_get_element(env, array, i, &element) != 0) break;
+    if (js_typeof(env, element, &type) != 0 || type != js_string) continue;
+    
+    size_t pattern_len;
+    if (js_get_value_string_utf8(env, element, NULL, 0, &pattern_len) != 0) continue;
+    
+    char *pattern = xdl_malloc(pattern_len + 1);
+    if (!pattern) break;
+    
+    if (js_get_value_string_utf8(env, element, (utf8_t *)pattern, pattern_len + 1, NULL) == 0) {
+      pattern[pattern_len] = '\0';
+      
+      if (regcomp(&compiled[len], pattern, REG_EXTENDED | REG_NEWLINE) == 0) {
+        hash = bare_xdiff_hash64(pattern, pattern_len + 1, hash);
+        regex[len] = &compiled[len];
+        len++;
+      }
+    }
+    
+    xdl_free(pattern);
+  }
+  
+  if (len == 0) {
+    xdl_free(regex);
+    return;
+  }
+  
+  *result = regex;
+  *result_len = len;
+  *result_hash = hash;
+#endif
+}
+
+// Free patterns parsed by parse_patterns()
+static void
+bare_xdiff_patterns_clear(xdl_regex_t ***regex, size_t *len) {
+#if !defined(_WIN32)
+  for (size_t i = 0; i < *len; i++) regfree((*regex)[i]);
+#endif
+  
+  xdl_free(*regex);
+  *regex = NULL;
+  *len = 0;
+}
+
+// JavaScript function: checkPatterns
+// Throws if any pattern of an array fails to compile, like git diff -I
+static js_value_t *
+bare_xdiff_check_patterns(js_env_t *env, js_callback_info_t *info) {
+  int err;
+  size_t argc = 1;
+  js_value_t *argv[1];
+  err = js_get_callback_info(env, info, &argc, argv, NULL, NULL);
+  assert(err == 0);
+
+#if !defined(_WIN32)
+  uint32_t count;
+  err = js_get_array_length(env, argv[0], &count);
+  assert(err == 0);
+  
+  for (uint32_t i = 0; i < count; i++) {
+    js_value_t *element;
+    js_value_type_t type;
+    err = js_get_element(env, argv[0], i, &element);
+    assert(err == 0);
+    if (js_typeof(env, element, &type) != 0 || type != js_string) continue;
+    
+    size_t pattern_len;
+    err = js_get_value_string_utf8(env, element, NULL, 0, &pattern_len);
+    assert(err == 0);
+    
+    char *pattern = xdl_malloc(pattern_len + 1);
+    
+    if (!pattern) {
+      js_throw_error(env, NULL, "Memory allocation failed");
+      return NULL;
+    }
+    
+    err = js_get_value_string_utf8(env, element, (utf8_t *)pattern, pattern_len + 1, NULL);
+    assert(err == 0);
+    pattern[pattern_len] = '\0';
+    
+    regex_t regex;
+    int result = regcomp(&regex, pattern, REG_EXTENDED | REG_NEWLINE);
+    
+    if (result != 0) {
+      char reason[128];
+      regerror(result, &regex, reason, sizeof(reason));
+      
+      char message[256];
+      snprintf(message, sizeof(message), "Invalid pattern '%.64s': %s", pattern, reason);
+      xdl_free(pattern);
+      
+      js_throw_error(env, NULL, message);
+      return NULL;
+    }
+    
+    regfree(&regex);
+    xdl_free(pattern);
+  }
+#endif
+  
+  return NULL;
+}
 
 // Parse diff options from JavaScript object
-static uint32_t
-parse_diff_options(js_env_t *env, js_value_t *options) {
+static void
+parse_diff_options(js_env_t *env, js_value_t *options, bare_xdiff_diff_options_t *result) {
   uint32_t flags = 0;
   js_value_t *prop;
   bool value;
   
+  // Set defaults
+  result->flags = 0;
+  result->granularity = BARE_XDIFF_GRANULARITY_LINE;
+  result->encoding = BARE_XDIFF_ENCODING_UNIFIED;
+  result->stats = false;
+  result->max_memory = 0;
+  result->anchors = NULL;
+  result->anchors_len = 0;
+  result->ignore_regex = NULL;
+  result->ignore_regex_len = 0;
+  result->ignore_regex_hash = 0;
+  result->func_names = false;
+  result->func_regex = NULL;
+  result->func_regex_len = 0;
+  result->func_regex_hash = 0;
+  
   // Check if options is null or undefined
   js_value_type_t type;
   if (js_typeof(env, options, &type) != 0 || type == js_null || type == js_undefined) {
-    return flags;
+    return;
   }
   
   // ignoreWhitespace
@@ -109,6 +523,16 @@ parse_diff_options(js_env_t *env, js_value_t *options) {
     }
   }
   
+  // ignoreCrAtEol
+  if (js_get_named_property(env, options, "ignoreCrAtEol", &prop) == 0) {
+    js_value_type_t prop_type;
+    if (js_typeof(env, prop, &prop_type) == 0 && prop_type == js_boolean) {
+      if (js_get_value_bool(env, prop, &value) == 0 && value) {
+        flags |= XDF_IGNORE_CR_AT_EOL;
+      }
+    }
+  }
+  
   // ignoreBlankLines
   if (js_get_named_property(env, options, "ignoreBlankLines", &prop) == 0) {
     js_value_type_t prop_type;
@@ -128,7 +552,9 @@ parse_diff_options(js_env_t *env, js_value_t *options) {
         length += 1; /* NULL */
         char *algorithm = malloc(length);
         if (js_get_value_string_utf8(env, prop, (utf8_t*)algorithm, length, NULL) == 0) {
-          if (strcmp(algorithm, "patience") == 0) {
+          if (strcmp(algorithm, "minimal") == 0) {
+            flags |= XDF_NEED_MINIMAL;
+          } else if (strcmp(algorithm, "patience") == 0) {
             flags |= XDF_PATIENCE_DIFF;
           } else if (strcmp(algorithm, "histogram") == 0) {
             flags |= XDF_HISTOGRAM_DIFF;
@@ -139,12 +565,142 @@ parse_diff_options(js_env_t *env, js_value_t *options) {
     }
   }
   
-  return flags;
+  // granularity
+  if (js_get_named_property(env, options, "granularity", &prop) == 0) {
+    js_value_type_t prop_type;
+    if (js_typeof(env, prop, &prop_type) == 0 && prop_type == js_string) {
+      size_t length;
+      if (js_get_value_string_utf8(env, prop, NULL, 0, &length) == 0) {
+        length += 1; /* NULL */
+        char *granularity = malloc(length);
+        if (js_get_value_string_utf8(env, prop, (utf8_t*)granularity, length, NULL) == 0) {
+          if (strcmp(granularity, "word") == 0) {
+            result->granularity = BARE_XDIFF_GRANULARITY_WORD;
+          } else if (strcmp(granularity, "char") == 0) {
+            result->granularity = BARE_XDIFF_GRANULARITY_CHAR;
+          }
+        }
+        free(granularity);
+      }
+    }
+  }
+  
+  // encoding
+  if (js_get_named_property(env, options, "encoding", &prop) == 0) {
+    js_value_type_t prop_type;
+    if (js_typeof(env, prop, &prop_type) == 0 && prop_type == js_string) {
+      size_t length;
+      if (js_get_value_string_utf8(env, prop, NULL, 0, &length) == 0) {
+        length += 1; /* NULL */
+        char *encoding = malloc(length);
+        if (js_get_value_string_utf8(env, prop, (utf8_t*)encoding, length, NULL) == 0) {
+          if (strcmp(encoding, "binary") == 0) {
+            result->encoding = BARE_XDIFF_ENCODING_BINARY;
+          }
+        }
+        free(encoding);
+      }
+    }
+  }
+  
+  // stats
+  if (js_get_named_property(env, options, "stats", &prop) == 0) {
+    js_value_type_t prop_type;
+    if (js_typeof(env, prop, &prop_type) == 0 && prop_type == js_boolean) {
+      js_get_value_bool(env, prop, &result->stats);
+    }
+  }
+  
+  // maxMemory
+  if (js_get_named_property(env, options, "maxMemory", &prop) == 0) {
+    js_value_type_t prop_type;
+    if (js_typeof(env, prop, &prop_type) == 0 && prop_type == js_number) {
+      int64_t max_memory;
+      if (js_get_value_int64(env, prop, &max_memory) == 0 && max_memory > 0) {
+        result->max_memory = (uint64_t)max_memory;
+      }
+    }
+  }
+  
+  // anchors, which only the patience algorithm supports
+  if (js_get_named_property(env, options, "anchors", &prop) == 0) {
+    bool is_array;
+    if (js_is_array(env, prop, &is_array) == 0 && is_array) {
+      parse_anchors(env, prop, result);
+    }
+  }
+  
+  if (result->anchors_len > 0) {
+    flags = (flags & ~XDF_DIFF_ALGORITHM_MASK) | XDF_PATIENCE_DIFF;
+  }
+  
+  // ignoreLines
+  if (js_get_named_property(env, options, "ignoreLines", &prop) == 0) {
+    bool is_array;
+    if (js_is_array(env, prop, &is_array) == 0 && is_array) {
+      parse_patterns(env, prop, &result->ignore_regex, &result->ignore_regex_len, &result->ignore_regex_hash);
+    }
+  }
+  
+  // funcNames, either true for the default rule or an array of patterns
+  if (js_get_named_property(env, options, "funcNames", &prop) == 0) {
+    js_value_type_t prop_type;
+    bool is_array;
+    if (js_typeof(env, prop, &prop_type) == 0 && prop_type == js_boolean) {
+      js_get_value_bool(env, prop, &result->func_names);
+    } else if (js_is_array(env, prop, &is_array) == 0 && is_array) {
+      result->func_names = true;
+      parse_patterns(env, prop, &result->func_regex, &result->func_regex_len, &result->func_regex_hash);
+    }
+  }
+  
+  result->flags = flags;
+}
+
+// Free the anchors and patterns of diff options parsed by
+// parse_diff_options()
+static void
+bare_xdiff_diff_options_clear(bare_xdiff_diff_options_t *options) {
+  xdl_free(options->anchors);
+  options->anchors = NULL;
+  options->anchors_len = 0;
+  
+  bare_xdiff_patterns_clear(&options->ignore_regex, &options->ignore_regex_len);
+  bare_xdiff_patterns_clear(&options->func_regex, &options->func_regex_len);
+}
+
+// Parse similarity options from JavaScript object: the threshold and the
+// whitespace options of diff, which change how lines are hashed
+static void
+parse_similarity_options(js_env_t *env, js_value_t *options, uint32_t *flags, double *threshold) {
+  bare_xdiff_diff_options_t diff_options;
+  parse_diff_options(env, options, &diff_options);
+  bare_xdiff_diff_options_clear(&diff_options);
+  
+  *flags = diff_options.flags & XDF_WHITESPACE_FLAGS;
+  *threshold = 0.5;
+  
+  js_value_type_t type;
+  if (js_typeof(env, options, &type) != 0 || type == js_null || type == js_undefined) {
+    return;
+  }
+  
+  // threshold
+  js_value_t *prop;
+  if (js_get_named_property(env, options, "threshold", &prop) == 0) {
+    js_value_type_t prop_type;
+    if (js_typeof(env, prop, &prop_type) == 0 && prop_type == js_number) {
+      double value;
+      if (js_get_value_double(env, prop, &value) == 0 && value >= 0 && value <= 1) {
+        *threshold = value;
+      }
+    }
+  }
 }
 
 // Parse merge options from JavaScript object
 static void
-parse_merge_options(js_env_t *env, js_value_t *options, int32_t *level, int32_t *favor, int32_t *style, int32_t *marker_size) {
+parse_merge_options(js_env_t *env, js_value_t *options, int32_t *level, int32_t *favor, int32_t *style, int32_t *marker_size, bool *normalize_eol, bool *stats) {
   js_value_t *prop;
   
   // Set defaults
@@ -152,6 +708,8 @@ parse_merge_options(js_env_t *env, js_value_t *options, int32_t *level, int32_t
   *favor = 0;
   *style = 0;
   *marker_size = 7;
+  *normalize_eol = false;
+  *stats = false;
   
   // Check if options is null or undefined
   js_value_type_t type;
@@ -233,86 +791,620 @@ parse_merge_options(js_env_t *env, js_value_t *options, int32_t *level, int32_t
       }
     }
   }
+  
+  // normalizeEol
+  if (js_get_named_property(env, options, "normalizeEol", &prop) == 0) {
+    js_value_type_t prop_type;
+    if (js_typeof(env, prop, &prop_type) == 0 && prop_type == js_boolean) {
+      js_get_value_bool(env, prop, normalize_eol);
+    }
+  }
+  
+  // stats
+  if (js_get_named_property(env, options, "stats", &prop) == 0) {
+    js_value_type_t prop_type;
+    if (js_typeof(env, prop, &prop_type) == 0 && prop_type == js_boolean) {
+      js_get_value_bool(env, prop, stats);
+    }
+  }
 }
 
-// Callback for xdiff diff output
+// Create the JavaScript value for the stats of a diff or merge
 static int
-xdiff_out_line(void *priv, mmbuffer_t *mb, int nbuf) {
-  bare_xdiff_output_t *output = (bare_xdiff_output_t *)priv;
+bare_xdiff_create_stats(js_env_t *env, const bare_xdiff_stats_t *stats, bool merge, js_value_t **result) {
+  int err;
   
-  for (int i = 0; i < nbuf; i++) {
-    size_t new_len = output->len + mb[i].size;
-    
-    // Grow buffer if needed
-    if (new_len > output->capacity) {
-      size_t new_capacity = output->capacity * 2;
-      if (new_capacity < new_len) {
-        new_capacity = new_len + 1024;
-      }
-      char *new_data = xdl_realloc(output->data, new_capacity);
-      if (!new_data) {
-        return -1;
-      }
-      output->data = new_data;
-      output->capacity = new_capacity;
-    }
+  err = js_create_object(env, result);
+  if (err != 0) return err;
+  
+  struct {
+    const char *name;
+    double value;
+  } fields[] = {
+    {"prepareNs", (double)stats->prepare_ns},
+    {"searchNs", (double)stats->search_ns},
+    {"emitNs", (double)stats->emit_ns},
+    {"copyNs", (double)stats->copy_ns},
+    {merge ? "linesO" : "linesA", (double)stats->lines[0]},
+    {merge ? "linesA" : "linesB", (double)stats->lines[1]},
+    {merge ? "linesB" : NULL, (double)stats->lines[2]},
+    {"classes", (double)stats->classes},
+    {merge ? "conflicts" : "hunks", (double)stats->hunks},
+    {"bytesEmitted", (double)stats->bytes},
+    {"estimatedMemory", (double)stats->estimated_memory},
+  };
+  
+  for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+    if (fields[i].name == NULL) continue;
     
-    memcpy(output->data + output->len, mb[i].ptr, mb[i].size);
-    output->len = new_len;
+    js_value_t *value;
+    err = js_create_double(env, fields[i].value, &value);
+    if (err != 0) return err;
+    err = js_set_named_property(env, *result, fields[i].name, value);
+    if (err != 0) return err;
   }
   
   return 0;
 }
 
-// Work function for diff operation
-static void
-bare_xdiff_diff_work(uv_work_t *req) {
-  bare_xdiff_request_t *request = (bare_xdiff_request_t *)req->data;
+// Wrap a diff result as {output, stats} when the stats option is set
+static int
+bare_xdiff_create_diff_stats_result(js_env_t *env, const bare_xdiff_stats_t *stats, js_value_t *output, js_value_t **result) {
+  int err;
   
-  // Set up mmfile structures for xdiff
-  mmfile_t mf1, mf2;
-  mf1.ptr = (char *)request->buf1;
-  mf1.size = (long)request->len1;
-  mf2.ptr = (char *)request->buf2;
-  mf2.size = (long)request->len2;
+  js_value_t *stats_value;
+  err = bare_xdiff_create_stats(env, stats, false, &stats_value);
+  if (err != 0) return err;
   
-  // Configure xdiff parameters
-  xpparam_t xpp;
-  memset(&xpp, 0, sizeof(xpp));
-  xpp.flags = request->diff_flags;
+  err = js_create_object(env, result);
+  if (err != 0) return err;
+  err = js_set_named_property(env, *result, "output", output);
+  if (err != 0) return err;
   
-  xdemitconf_t xecfg;
-  memset(&xecfg, 0, sizeof(xecfg));
-  xecfg.ctxlen = 3; // Context lines for unified diff
+  return js_set_named_property(env, *result, "stats", stats_value);
+}
+
+// Create the JavaScript value for a diff result
+static int
+bare_xdiff_create_diff_result(js_env_t *env, const bare_xdiff_diff_options_t *options, const char *data, size_t len, js_value_t **result) {
+  int err;
   
-  // Set up output handler
-  bare_xdiff_output_t output;
-  memset(&output, 0, sizeof(output));
-  output.data = xdl_malloc(1024);
-  output.capacity = 1024;
-  output.len = 0;
+  js_value_t *arraybuffer;
+  void *arraybuffer_data;
+  err = js_create_arraybuffer(env, len, &arraybuffer_data, &arraybuffer);
+  if (err != 0) return err;
+  memcpy(arraybuffer_data, data, len);
   
-  if (!output.data) {
-    request->error_code = -1;
-    return;
+  // Token-level edits are returned as [aOffset, aLength, bOffset, bLength] tuples
+  if (options->granularity != BARE_XDIFF_GRANULARITY_LINE && options->encoding != BARE_XDIFF_ENCODING_BINARY) {
+    return js_create_typedarray(env, js_uint32array, len / sizeof(uint32_t), arraybuffer, 0, result);
   }
   
-  xdemitcb_t ecb;
-  memset(&ecb, 0, sizeof(ecb));
-  ecb.out_line = xdiff_out_line;
-  ecb.priv = &output;
+  return js_create_typedarray(env, js_uint8array, len, arraybuffer, 0, result);
+}
+
+// Create the array of results of a diffMany job, each the same as diff()
+// would return for its target
+static int
+bare_xdiff_create_diff_many_result(js_env_t *env, const bare_xdiff_diff_options_t *options, bare_xdiff_diff_result_t *results, size_t len, js_value_t **result) {
+  int err;
   
-  // Perform the diff
-  int result = xdl_diff(&mf1, &mf2, &xpp, &xecfg, &ecb);
+  err = js_create_array_with_length(env, len, result);
+  if (err != 0) return err;
   
-  if (result < 0) {
-    xdl_free(output.data);
-    request->error_code = result;
-  } else {
-    request->result = output.data;
-    request->result_len = output.len;
-    request->error_code = 0;
+  for (size_t i = 0; i < len; i++) {
+    uint64_t start = uv_hrtime();
+    js_value_t *value;
+    err = bare_xdiff_create_diff_result(env, options, results[i].output.data, results[i].output.len, &value);
+    if (err != 0) return err;
+    
+    if (options->stats) {
+      results[i].stats.copy_ns = uv_hrtime() - start;
+      err = bare_xdiff_create_diff_stats_result(env, &results[i].stats, value, &value);
+      if (err != 0) return err;
+    }
+    
+    err = js_set_element(env, *result, (uint32_t)i, value);
+    if (err != 0) return err;
   }
+  
+  return 0;
+}
+
+// Create the array of {a, b, score} objects of the matches of a similarity
+static int
+bare_xdiff_create_matches(js_env_t *env, const char *data, size_t len, js_value_t **result) {
+  int err;
+  
+  const bare_xdiff_match_t *matches = (const bare_xdiff_match_t *)data;
+  size_t count = len / sizeof(bare_xdiff_match_t);
+  
+  err = js_create_array_with_length(env, count, result);
+  if (err != 0) return err;
+  
+  for (size_t i = 0; i < count; i++) {
+    js_value_t *match, *a, *b, *score;
+    err = js_create_object(env, &match);
+    if (err != 0) return err;
+    
+    err = js_create_uint32(env, matches[i].a, &a);
+    if (err != 0) return err;
+    err = js_set_named_property(env, match, "a", a);
+    if (err != 0) return err;
+    
+    err = js_create_uint32(env, matches[i].b, &b);
+    if (err != 0) return err;
+    err = js_set_named_property(env, match, "b", b);
+    if (err != 0) return err;
+    
+    err = js_create_double(env, matches[i].score, &score);
+    if (err != 0) return err;
+    err = js_set_named_property(env, match, "score", score);
+    if (err != 0) return err;
+    
+    err = js_set_element(env, *result, (uint32_t)i, match);
+    if (err != 0) return err;
+  }
+  
+  return 0;
+}
+
+// Create the Uint32Array of the revision that added every line of a blame
+static int
+bare_xdiff_create_origins(js_env_t *env, const uint32_t *origins, size_t len, js_value_t **result) {
+  int err;
+  
+  js_value_t *arraybuffer;
+  void *arraybuffer_data;
+  err = js_create_arraybuffer(env, len * sizeof(uint32_t), &arraybuffer_data, &arraybuffer);
+  if (err != 0) return err;
+  memcpy(arraybuffer_data, origins, len * sizeof(uint32_t));
+  
+  return js_create_typedarray(env, js_uint32array, len, arraybuffer, 0, result);
+}
+
+// Free the outputs of a diffMany job
+static void
+bare_xdiff_diff_results_free(bare_xdiff_diff_result_t *results, size_t len) {
+  for (size_t i = 0; i < len; i++) xdl_free(results[i].output.data);
+  xdl_free(results);
+}
+
+// Diff the base of a job against its targets until none are left, so that
+// threads finishing early pick up the remaining targets
+static void
+bare_xdiff_diff_many_thread(void *data) {
+  bare_xdiff_diff_many_t *job = (bare_xdiff_diff_many_t *)data;
+  
+  while (true) {
+    size_t i = (size_t)bare_xdiff_atomic_add(&job->next, 1);
+    if (i >= job->len) break;
+    
+    bare_xdiff_diff_result_t *result = &job->results[i];
+    result->output.data = xdl_malloc(1024);
+    result->output.capacity = 1024;
+    
+    if (!result->output.data) {
+      result->error_code = -1;
+      continue;
+    }
+    
+    // xdiff only reads the files, so every thread diffs the same base
+    mmfile_t base = job->base, target = job->targets[i];
+    bare_xdiff_stats_t *stats = job->options->stats ? &result->stats : NULL;
+    result->error_code = bare_xdiff_run_diff(&base, &target, job->options, &result->output, stats);
+  }
+}
+
+// Run work on up to the given number of threads, but no more than the CPU
+// runs in parallel, the calling thread being one of them. The work has to
+// claim its share until none is left, as failing to start a thread only
+// leaves more for the others.
+static void
+bare_xdiff_run_threads(uv_thread_cb work, void *data, size_t threads) {
+  size_t parallelism = uv_available_parallelism();
+  if (threads > parallelism) threads = parallelism;
+  
+  uv_thread_t *ids = threads > 1 ? malloc((threads - 1) * sizeof(uv_thread_t)) : NULL;
+  size_t started = 0;
+  
+  for (size_t i = 1; ids && i < threads; i++) {
+    if (uv_thread_create(&ids[started], work, data) == 0) started++;
+  }
+  
+  work(data);
+  
+  for (size_t i = 0; i < started; i++) uv_thread_join(&ids[i]);
+  free(ids);
+}
+
+// Run the diffs of a job on as many threads as the CPU runs in parallel.
+// Small jobs start fewer threads, as starting a thread costs more than
+// diffing a few small files.
+static int
+bare_xdiff_run_diff_many(bare_xdiff_diff_many_t *job) {
+  size_t bytes = 0;
+  for (size_t i = 0; i < job->len; i++) bytes += job->base.size + job->targets[i].size;
+  
+  size_t threads = bytes / BARE_XDIFF_DIFF_MANY_THREAD_BYTES + 1;
+  if (threads > job->len) threads = job->len;
+  
+  bare_xdiff_run_threads(bare_xdiff_diff_many_thread, job, threads);
+  
+  int ret = 0;
+  
+  for (size_t i = 0; i < job->len; i++) {
+    if (job->results[i].error_code < 0) ret = job->results[i].error_code;
+    if (ret == BARE_XDIFF_ERROR_MEMORY) break;
+  }
+  
+  return ret;
+}
+
+// Diff the consecutive revisions of a blame until none are left
+static void
+bare_xdiff_blame_thread(void *data) {
+  bare_xdiff_blame_t *job = (bare_xdiff_blame_t *)data;
+  
+  while (true) {
+    size_t i = (size_t)bare_xdiff_atomic_add(&job->next, 1);
+    if (i + 1 >= job->len) break;
+    
+    mmfile_t a = job->revisions[i], b = job->revisions[i + 1];
+    
+    if (bare_xdiff_collect_hunks(&a, &b, job->flags, &job->changes[i]) < 0) {
+      bare_xdiff_atomic_add(&job->failed, 1);
+    }
+  }
+}
+
+// Run a blame, diffing the consecutive revisions on as many threads as the
+// CPU runs in parallel and then tracing the lines of the last revision back
+// through the changes
+static int
+bare_xdiff_run_blame(bare_xdiff_blame_t *job, uint32_t **origins, size_t *len) {
+  size_t pairs = job->len > 1 ? job->len - 1 : 0;
+  
+  // Every line has to be accounted for, so changes to blank lines are never
+  // left out
+  job->flags &= XDF_WHITESPACE_FLAGS | XDF_IGNORE_CR_AT_EOL | XDF_DIFF_ALGORITHM_MASK;
+  
+  job->changes = xdl_malloc((pairs ? pairs : 1) * sizeof(bare_xdiff_hunks_t));
+  if (!job->changes) return -1;
+  
+  memset(job->changes, 0, (pairs ? pairs : 1) * sizeof(bare_xdiff_hunks_t));
+  
+  size_t bytes = 0;
+  for (size_t i = 0; i < job->len; i++) bytes += job->revisions[i].size;
+  
+  size_t threads = bytes / BARE_XDIFF_DIFF_MANY_THREAD_BYTES + 1;
+  if (threads > pairs) threads = pairs;
+  
+  if (threads > 0) bare_xdiff_run_threads(bare_xdiff_blame_thread, job, threads);
+  
+  int ret = -1;
+  
+  if (job->failed == 0) {
+    mmfile_t empty = {"", 0};
+    ret = bare_xdiff_blame(job->len ? job->revisions : &empty, job->changes, job->len, origins, len);
+  }
+  
+  for (size_t i = 0; i < pairs; i++) xdl_free(job->changes[i].data);
+  xdl_free(job->changes);
+  
+  return ret;
+}
+
+// Work function for diff operation
+static void
+bare_xdiff_diff_work(uv_work_t *req) {
+  bare_xdiff_request_t *request = (bare_xdiff_request_t *)req->data;
+  
+  // Set up mmfile structures for xdiff
+  mmfile_t mf1, mf2;
+  mf1.ptr = (char *)request->buf1;
+  mf1.size = (long)request->len1;
+  mf2.ptr = (char *)request->buf2;
+  mf2.size = (long)request->len2;
+  
+  // Set up output handler
+  bare_xdiff_output_t output;
+  memset(&output, 0, sizeof(output));
+  output.data = xdl_malloc(1024);
+  output.capacity = 1024;
+  output.len = 0;
+  
+  if (!output.data) {
+    request->error_code = -1;
+    return;
+  }
+  
+  // Perform the diff
+  bare_xdiff_stats_t *stats = request->diff_options.stats ? &request->stats : NULL;
+  int result = bare_xdiff_run_diff(&mf1, &mf2, &request->diff_options, &output, stats);
+  
+  if (result < 0) {
+    xdl_free(output.data);
+    request->error_code = result;
+    if (result == BARE_XDIFF_ERROR_MEMORY) request->error_message = "Diff exceeds maxMemory";
+  } else {
+    // Count the copies of the inputs made for the worker
+    if (stats) stats->estimated_memory += request->len1 + request->len2;
+    
+    request->result = output.data;
+    request->result_len = output.len;
+    request->error_code = 0;
+  }
+}
+
+// Work function for diffMany operation
+static void
+bare_xdiff_diff_many_work(uv_work_t *req) {
+  bare_xdiff_request_t *request = (bare_xdiff_request_t *)req->data;
+  size_t len = request->bufs_len;
+  
+  mmfile_t *targets = xdl_malloc((len ? len : 1) * sizeof(mmfile_t));
+  request->results = xdl_malloc((len ? len : 1) * sizeof(bare_xdiff_diff_result_t));
+  
+  if (!targets || !request->results) {
+    xdl_free(targets);
+    request->error_code = -1;
+    return;
+  }
+  
+  memset(request->results, 0, (len ? len : 1) * sizeof(bare_xdiff_diff_result_t));
+  
+  for (size_t i = 0; i < len; i++) {
+    targets[i].ptr = (char *)request->bufs[i];
+    targets[i].size = (long)request->lens[i];
+  }
+  
+  bare_xdiff_diff_many_t job;
+  memset(&job, 0, sizeof(job));
+  job.base.ptr = (char *)request->buf1;
+  job.base.size = (long)request->len1;
+  job.targets = targets;
+  job.len = len;
+  job.options = &request->diff_options;
+  job.results = request->results;
+  
+  int result = bare_xdiff_run_diff_many(&job);
+  xdl_free(targets);
+  
+  if (result < 0) {
+    request->error_code = result;
+    if (result == BARE_XDIFF_ERROR_MEMORY) request->error_message = "Diff exceeds maxMemory";
+    return;
+  }
+  
+  for (size_t i = 0; i < len; i++) {
+    // Count the copies of the inputs made for the worker
+    if (request->diff_options.stats) request->results[i].stats.estimated_memory += request->len1 + request->lens[i];
+    
+    request->result_len += request->results[i].output.len;
+  }
+  
+  request->error_code = 0;
+}
+
+// Status names of the files of a tree diff
+static const char *bare_xdiff_tree_status[] = {"modified", "added", "removed"};
+
+// Free the changed files of a tree diff
+static void
+bare_xdiff_tree_entries_free(bare_xdiff_tree_entry_t *entries, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    xdl_free(entries[i].path);
+    xdl_free(entries[i].output.data);
+  }
+  
+  xdl_free(entries);
+}
+
+// Pass the changed files of a tree diff that have arrived so far to
+// JavaScript, calling onentry(path, status, patch) for each
+static void
+bare_xdiff_tree_flush(bare_xdiff_tree_stream_t *stream) {
+  int err;
+  js_env_t *env = stream->env;
+  
+  uv_mutex_lock(&stream->lock);
+  bare_xdiff_tree_entry_t *entries = stream->entries;
+  size_t len = stream->len;
+  stream->entries = NULL;
+  stream->len = 0;
+  stream->capacity = 0;
+  uv_mutex_unlock(&stream->lock);
+  
+  if (len == 0) return;
+  
+  js_handle_scope_t *scope;
+  err = js_open_handle_scope(env, &scope);
+  assert(err == 0);
+  
+  js_value_t *ctx;
+  err = js_get_reference_value(env, stream->ctx, &ctx);
+  assert(err == 0);
+  
+  js_value_t *onentry;
+  err = js_get_reference_value(env, stream->onentry, &onentry);
+  assert(err == 0);
+  
+  for (size_t i = 0; i < len; i++) {
+    bare_xdiff_tree_entry_t *entry = &entries[i];
+    
+    js_value_t *argv[3];
+    err = js_create_string_utf8(env, (const utf8_t *)entry->path, -1, &argv[0]);
+    assert(err == 0);
+    err = js_create_string_utf8(env, (const utf8_t *)bare_xdiff_tree_status[entry->status], -1, &argv[1]);
+    assert(err == 0);
+    
+    uint64_t start = uv_hrtime();
+    err = bare_xdiff_create_diff_result(env, &stream->options, entry->output.data, entry->output.len, &argv[2]);
+    assert(err == 0);
+    
+    if (stream->options.stats) {
+      entry->stats.copy_ns = uv_hrtime() - start;
+      err = bare_xdiff_create_diff_stats_result(env, &entry->stats, argv[2], &argv[2]);
+      assert(err == 0);
+    }
+    
+    js_call_function(env, ctx, onentry, 3, argv, NULL);
+  }
+  
+  err = js_close_handle_scope(env, scope);
+  assert(err == 0);
+  
+  bare_xdiff_tree_entries_free(entries, len);
+}
+
+// Async callback of a tree diff, run on the loop when files have arrived
+static void
+bare_xdiff_tree_on_async(uv_async_t *handle) {
+  bare_xdiff_tree_flush((bare_xdiff_tree_stream_t *)handle->data);
+}
+
+// Close callback of a tree diff, freeing the stream once the loop is done
+// with it
+static void
+bare_xdiff_tree_on_close(uv_handle_t *handle) {
+  bare_xdiff_tree_stream_t *stream = (bare_xdiff_tree_stream_t *)handle->data;
+  
+  bare_xdiff_tree_entries_free(stream->entries, stream->len);
+  bare_xdiff_diff_options_clear(&stream->options);
+  uv_cond_destroy(&stream->drained);
+  uv_mutex_destroy(&stream->lock);
+  free(stream);
+}
+
+// Fail a tree diff, stopping the threads from claiming more files
+static void
+bare_xdiff_tree_fail(bare_xdiff_tree_job_t *job, int error_code) {
+  uv_mutex_lock(&job->stream->lock);
+  if (job->error_code == 0 || error_code == BARE_XDIFF_ERROR_MEMORY) job->error_code = error_code;
+  uv_mutex_unlock(&job->stream->lock);
+  
+  bare_xdiff_atomic_add(&job->next, job->len);
+}
+
+// Diff the files of a tree diff until none are left, sending each changed
+// file to the loop as soon as it is done
+static void
+bare_xdiff_tree_thread(void *data) {
+  bare_xdiff_tree_job_t *job = (bare_xdiff_tree_job_t *)data;
+  bare_xdiff_tree_stream_t *stream = job->stream;
+  
+  while (true) {
+    uv_mutex_lock(&stream->lock);
+    while (stream->unread >= BARE_XDIFF_TREE_MAX_UNREAD && !stream->cancelled) {
+      uv_cond_wait(&stream->drained, &stream->lock);
+    }
+    bool cancelled = stream->cancelled;
+    uv_mutex_unlock(&stream->lock);
+    
+    if (cancelled) break;
+    
+    size_t i = (size_t)bare_xdiff_atomic_add(&job->next, 1);
+    if (i >= job->len) break;
+    
+    bare_xdiff_tree_entry_t entry;
+    memset(&entry, 0, sizeof(entry));
+    entry.status = job->files[i].status;
+    entry.output.data = xdl_malloc(1024);
+    entry.output.capacity = 1024;
+    
+    if (!entry.output.data) {
+      bare_xdiff_tree_fail(job, -1);
+      break;
+    }
+    
+    bare_xdiff_stats_t *stats = stream->options.stats ? &entry.stats : NULL;
+    int result = bare_xdiff_tree_diff_file(job->loop, job->roots[0], job->roots[1], &job->files[i], &stream->options, &entry.output, stats);
+    
+    if (result <= 0) {
+      xdl_free(entry.output.data);
+      if (result == 0) continue;
+      
+      bare_xdiff_tree_fail(job, result);
+      break;
+    }
+    
+    size_t path_len = strlen(job->files[i].path);
+    entry.path = xdl_malloc(path_len + 1);
+    
+    if (entry.path) memcpy(entry.path, job->files[i].path, path_len + 1);
+    
+    uv_mutex_lock(&stream->lock);
+    
+    if (entry.path && stream->len == stream->capacity) {
+      size_t new_capacity = stream->capacity ? stream->capacity * 2 : 16;
+      bare_xdiff_tree_entry_t *new_entries = xdl_realloc(stream->entries, new_capacity * sizeof(bare_xdiff_tree_entry_t));
+      
+      if (new_entries) {
+        stream->entries = new_entries;
+        stream->capacity = new_capacity;
+      }
+    }
+    
+    bool queued = entry.path && stream->len < stream->capacity;
+    if (queued) {
+      stream->entries[stream->len++] = entry;
+      stream->unread++;
+    }
+    
+    uv_mutex_unlock(&stream->lock);
+    
+    if (!queued) {
+      xdl_free(entry.path);
+      xdl_free(entry.output.data);
+      bare_xdiff_tree_fail(job, -1);
+      break;
+    }
+    
+    uv_async_send(&stream->async);
+  }
+}
+
+// Work function for diffTrees operation
+static void
+bare_xdiff_diff_trees_work(uv_work_t *req) {
+  bare_xdiff_request_t *request = (bare_xdiff_request_t *)req->data;
+  bare_xdiff_tree_stream_t *stream = request->stream;
+  uv_loop_t *loop = stream->async.loop;
+  
+  bare_xdiff_tree_t trees[2];
+  memset(trees, 0, sizeof(trees));
+  
+  bare_xdiff_tree_job_t job;
+  memset(&job, 0, sizeof(job));
+  
+  if (bare_xdiff_tree_list(loop, request->buf1, &trees[0]) < 0 || bare_xdiff_tree_list(loop, request->buf2, &trees[1]) < 0) {
+    request->error_code = -1;
+    request->error_message = "Failed to read directory";
+    goto done;
+  }
+  
+  if (bare_xdiff_tree_files(&trees[0], &trees[1], &job.files, &job.len) < 0) {
+    request->error_code = -1;
+    goto done;
+  }
+  
+  job.loop = loop;
+  job.roots[0] = request->buf1;
+  job.roots[1] = request->buf2;
+  job.stream = stream;
+  
+  bare_xdiff_run_threads(bare_xdiff_tree_thread, &job, job.len);
+  
+  request->error_code = job.error_code;
+  
+  if (job.error_code == BARE_XDIFF_ERROR_MEMORY) request->error_message = "Diff exceeds maxMemory";
+  else if (job.error_code < 0) request->error_message = "Failed to read file";
+
+done:
+  xdl_free(job.files);
+  bare_xdiff_tree_clear(&trees[0]);
+  bare_xdiff_tree_clear(&trees[1]);
 }
 
 // Work function for merge operation
@@ -337,21 +1429,34 @@ bare_xdiff_merge_work(uv_work_t *req) {
   xmp.favor = request->merge_favor;
   xmp.style = request->merge_style;
   
+  // CR before LF is ignored when hashing and comparing lines, so lines only
+  // differing in their line ending are unchanged
+  if (request->merge_normalize_eol) xmp.xpp.flags |= XDF_IGNORE_CR_AT_EOL;
+  
   // Output buffer
   mmbuffer_t result;
   memset(&result, 0, sizeof(result));
   
   // Perform the merge
-  int ret = xdl_merge(&ancestor, &ours, &theirs, &xmp, &result);
+  bare_xdiff_stats_t *stats = request->merge_stats ? &request->stats : NULL;
+  int ret = bare_xdiff_run_merge(&ancestor, &ours, &theirs, &xmp, &result, stats);
   
   if (ret < 0) {
     request->error_code = ret;
     request->conflict_count = 0;
   } else {
     // Copy result
+    uint64_t start = uv_hrtime();
     request->result = xdl_malloc(result.size);
     if (request->result) {
       memcpy(request->result, result.ptr, result.size);
+      
+      // Count the copies of the inputs made for the worker and of the result
+      if (stats) {
+        stats->copy_ns = uv_hrtime() - start;
+        stats->estimated_memory += request->len1 + request->len2 + request->len3 + result.size;
+      }
+      
       request->result_len = result.size;
       request->error_code = 0;  // Success
       request->conflict_count = ret;  // Number of conflicts (0 or more)
@@ -363,21 +1468,421 @@ bare_xdiff_merge_work(uv_work_t *req) {
   }
 }
 
-// Patch functionality is not supported by xdiff - stub implementation
+// Work function for delta operation
 static void
-bare_xdiff_patch_work(uv_work_t *req) {
+bare_xdiff_delta_work(uv_work_t *req) {
   bare_xdiff_request_t *request = (bare_xdiff_request_t *)req->data;
-  request->error_code = -1; // Not implemented
+  
+  bare_xdiff_output_t output;
+  memset(&output, 0, sizeof(output));
+  output.data = xdl_malloc(1024);
+  output.capacity = 1024;
+  output.len = 0;
+  
+  if (!output.data) {
+    request->error_code = -1;
+    return;
+  }
+  
+  int result = bare_xdiff_delta(request->buf1, request->len1, request->buf2, request->len2, &output);
+  
+  if (result < 0) {
+    xdl_free(output.data);
+    request->error_code = result;
+  } else {
+    request->result = output.data;
+    request->result_len = output.len;
+    request->error_code = 0;
+  }
 }
 
-// After work callback for all operations
+// Work function for apply delta operation
 static void
-bare_xdiff_after(uv_work_t *req, int status) {
-  int err;
+bare_xdiff_apply_delta_work(uv_work_t *req) {
   bare_xdiff_request_t *request = (bare_xdiff_request_t *)req->data;
-  js_env_t *env = request->env;
   
-  js_handle_scope_t *scope;
+  int result = bare_xdiff_apply_delta(request->buf1, request->len1, request->buf2, request->len2, &request->result, &request->result_len);
+  
+  if (result < 0) {
+    request->error_code = result;
+    request->error_message = "Invalid delta";
+  } else {
+    request->error_code = 0;
+  }
+}
+
+// Work function for apply patch operation
+static void
+bare_xdiff_patch_work(uv_work_t *req) {
+  bare_xdiff_request_t *request = (bare_xdiff_request_t *)req->data;
+  
+  int result = bare_xdiff_apply_patch(request->buf1, request->len1, request->buf2, request->len2, &request->result, &request->result_len);
+  
+  if (result < 0) {
+    request->error_code = result;
+    request->error_message = "Invalid patch";
+  } else {
+    request->error_code = 0;
+  }
+}
+
+// Work function for invert patch operation
+static void
+bare_xdiff_invert_patch_work(uv_work_t *req) {
+  bare_xdiff_request_t *request = (bare_xdiff_request_t *)req->data;
+  
+  int result = bare_xdiff_invert_patch(request->buf1, request->len1, &request->result, &request->result_len);
+  
+  if (result < 0) {
+    request->error_code = result;
+    request->error_message = "Invalid patch";
+  } else {
+    request->error_code = 0;
+  }
+}
+
+// Work function for compose patches operation
+static void
+bare_xdiff_compose_patches_work(uv_work_t *req) {
+  bare_xdiff_request_t *request = (bare_xdiff_request_t *)req->data;
+  
+  bare_xdiff_output_t output;
+  memset(&output, 0, sizeof(output));
+  output.data = xdl_malloc(1024);
+  output.capacity = 1024;
+  output.len = 0;
+  
+  if (!output.data) {
+    request->error_code = -1;
+    return;
+  }
+  
+  int result = bare_xdiff_compose_patches(request->bufs, request->lens, request->bufs_len, &output);
+  
+  if (result < 0) {
+    xdl_free(output.data);
+    request->error_code = result;
+    request->error_message = "Patches do not apply in sequence";
+  } else {
+    request->result = output.data;
+    request->result_len = output.len;
+    request->error_code = 0;
+  }
+}
+
+// Work function for similarity operation
+static void
+bare_xdiff_similarity_work(uv_work_t *req) {
+  bare_xdiff_request_t *request = (bare_xdiff_request_t *)req->data;
+  size_t len = request->bufs_len;
+  
+  mmfile_t *files = xdl_malloc((len ? len : 1) * sizeof(mmfile_t));
+  
+  bare_xdiff_output_t output;
+  memset(&output, 0, sizeof(output));
+  
+  if (!files) {
+    request->error_code = -1;
+    return;
+  }
+  
+  for (size_t i = 0; i < len; i++) {
+    files[i].ptr = (char *)request->bufs[i];
+    files[i].size = (long)request->lens[i];
+  }
+  
+  size_t first = request->bufs_first;
+  int result = bare_xdiff_similarity(files, first, files + first, len - first, request->diff_options.flags, request->similarity_threshold, &output);
+  xdl_free(files);
+  
+  if (result < 0) {
+    xdl_free(output.data);
+    request->error_code = result;
+  } else {
+    request->result = output.data;
+    request->result_len = output.len;
+    request->error_code = 0;
+  }
+}
+
+// Work function for blame operation
+static void
+bare_xdiff_blame_work(uv_work_t *req) {
+  bare_xdiff_request_t *request = (bare_xdiff_request_t *)req->data;
+  size_t len = request->bufs_len;
+  
+  mmfile_t *revisions = xdl_malloc((len ? len : 1) * sizeof(mmfile_t));
+  
+  if (!revisions) {
+    request->error_code = -1;
+    return;
+  }
+  
+  for (size_t i = 0; i < len; i++) {
+    revisions[i].ptr = (char *)request->bufs[i];
+    revisions[i].size = (long)request->lens[i];
+  }
+  
+  bare_xdiff_blame_t job;
+  memset(&job, 0, sizeof(job));
+  job.revisions = revisions;
+  job.len = len;
+  job.flags = request->diff_options.flags;
+  
+  uint32_t *origins;
+  size_t origins_len;
+  int result = bare_xdiff_run_blame(&job, &origins, &origins_len);
+  xdl_free(revisions);
+  
+  if (result < 0) {
+    request->error_code = result;
+  } else {
+    request->result = (char *)origins;
+    request->result_len = origins_len * sizeof(uint32_t);
+    request->error_code = 0;
+  }
+}
+
+// Compute the cache key of a diff
+static void
+bare_xdiff_cache_key_init(bare_xdiff_cache_key_t *key, const void *data1, size_t len1, const void *data2, size_t len2, const bare_xdiff_diff_options_t *options) {
+  key->hash1 = bare_xdiff_hash64(data1, len1, 0);
+  key->hash2 = bare_xdiff_hash64(data2, len2, 0);
+  key->len1 = len1;
+  key->len2 = len2;
+  key->options = (uint64_t)options->flags | (uint64_t)options->granularity << 32 | (uint64_t)options->encoding << 40 | (uint64_t)options->func_names << 48;
+  key->lines = options->ignore_regex_hash;
+  
+  for (size_t i = 0; i < options->anchors_len; i++) {
+    key->lines = bare_xdiff_hash64(options->anchors[i], strlen(options->anchors[i]) + 1, key->lines);
+  }
+  
+  if (options->func_regex_len > 0) {
+    key->lines = bare_xdiff_hash64(&options->func_regex_hash, sizeof(options->func_regex_hash), key->lines);
+  }
+}
+
+static size_t
+bare_xdiff_cache_bucket(const bare_xdiff_cache_t *cache, const bare_xdiff_cache_key_t *key) {
+  return (key->hash1 ^ bare_xdiff_rotl64(key->hash2, 17) ^ key->options) & (cache->buckets_len - 1);
+}
+
+// Unlink an entry from the LRU list
+static void
+bare_xdiff_cache_unlink(bare_xdiff_cache_t *cache, bare_xdiff_cache_entry_t *entry) {
+  if (entry->prev) entry->prev->next = entry->next;
+  else cache->head = entry->next;
+  
+  if (entry->next) entry->next->prev = entry->prev;
+  else cache->tail = entry->prev;
+  
+  entry->prev = entry->next = NULL;
+}
+
+// Link an entry at the front of the LRU list
+static void
+bare_xdiff_cache_link(bare_xdiff_cache_t *cache, bare_xdiff_cache_entry_t *entry) {
+  entry->prev = NULL;
+  entry->next = cache->head;
+  
+  if (cache->head) cache->head->prev = entry;
+  else cache->tail = entry;
+  
+  cache->head = entry;
+}
+
+// Remove an entry from the cache and release its result
+static void
+bare_xdiff_cache_evict(bare_xdiff_cache_t *cache, bare_xdiff_cache_entry_t *entry) {
+  int err;
+  
+  bare_xdiff_cache_entry_t **slot = &cache->buckets[bare_xdiff_cache_bucket(cache, &entry->key)];
+  while (*slot != entry) slot = &(*slot)->chain;
+  *slot = entry->chain;
+  
+  bare_xdiff_cache_unlink(cache, entry);
+  
+  err = js_delete_reference(cache->env, entry->result);
+  assert(err == 0);
+  
+  cache->entries--;
+  cache->bytes -= entry->bytes;
+  
+  free(entry);
+}
+
+// Evict the least recently used entries until the cache fits its bound
+static void
+bare_xdiff_cache_trim(bare_xdiff_cache_t *cache) {
+  while (cache->tail && cache->bytes > cache->max_bytes) {
+    bare_xdiff_cache_evict(cache, cache->tail);
+    cache->evictions++;
+  }
+}
+
+// Look up a cached diff result, returning NULL on a miss
+static js_value_t *
+bare_xdiff_cache_get(bare_xdiff_cache_t *cache, const bare_xdiff_cache_key_t *key) {
+  int err;
+  
+  if (cache->entries == 0) {
+    cache->misses++;
+    return NULL;
+  }
+  
+  bare_xdiff_cache_entry_t *entry = cache->buckets[bare_xdiff_cache_bucket(cache, key)];
+  
+  while (entry && memcmp(&entry->key, key, sizeof(*key)) != 0) entry = entry->chain;
+  
+  if (!entry) {
+    cache->misses++;
+    return NULL;
+  }
+  
+  cache->hits++;
+  
+  bare_xdiff_cache_unlink(cache, entry);
+  bare_xdiff_cache_link(cache, entry);
+  
+  js_value_t *result;
+  err = js_get_reference_value(cache->env, entry->result, &result);
+  assert(err == 0);
+  
+  return result;
+}
+
+// Store a diff result in the cache. Allocation failures only mean the
+// result isn't cached.
+static void
+bare_xdiff_cache_put(bare_xdiff_cache_t *cache, const bare_xdiff_cache_key_t *key, js_value_t *result, size_t len) {
+  int err;
+  
+  size_t bytes = len + sizeof(bare_xdiff_cache_entry_t);
+  
+  if (bytes > cache->max_bytes) return;
+  
+  // Keep the load factor at most 1
+  if (cache->entries + 1 > cache->buckets_len) {
+    size_t buckets_len = cache->buckets_len ? cache->buckets_len * 2 : 64;
+    bare_xdiff_cache_entry_t **buckets = calloc(buckets_len, sizeof(bare_xdiff_cache_entry_t *));
+    if (!buckets) return;
+    
+    bare_xdiff_cache_entry_t **old_buckets = cache->buckets;
+    size_t old_buckets_len = cache->buckets_len;
+    
+    cache->buckets = buckets;
+    cache->buckets_len = buckets_len;
+    
+    for (size_t i = 0; i < old_buckets_len; i++) {
+      bare_xdiff_cache_entry_t *entry = old_buckets[i];
+      
+      while (entry) {
+        bare_xdiff_cache_entry_t *chain = entry->chain;
+        size_t bucket = bare_xdiff_cache_bucket(cache, &entry->key);
+        entry->chain = buckets[bucket];
+        buckets[bucket] = entry;
+        entry = chain;
+      }
+    }
+    
+    free(old_buckets);
+  }
+  
+  bare_xdiff_cache_entry_t *entry = malloc(sizeof(bare_xdiff_cache_entry_t));
+  if (!entry) return;
+  
+  entry->key = *key;
+  entry->bytes = bytes;
+  
+  err = js_create_reference(cache->env, result, 1, &entry->result);
+  assert(err == 0);
+  
+  size_t bucket = bare_xdiff_cache_bucket(cache, key);
+  entry->chain = cache->buckets[bucket];
+  cache->buckets[bucket] = entry;
+  
+  bare_xdiff_cache_link(cache, entry);
+  
+  cache->entries++;
+  cache->bytes += bytes;
+  
+  bare_xdiff_cache_trim(cache);
+}
+
+// Release the cache when the environment is torn down. Requests still in
+// flight hold on to it until they complete.
+static void
+bare_xdiff_cache_teardown(void *data) {
+  bare_xdiff_cache_t *cache = (bare_xdiff_cache_t *)data;
+  
+  while (cache->head) bare_xdiff_cache_evict(cache, cache->head);
+  
+  free(cache->buckets);
+  cache->buckets = NULL;
+  cache->buckets_len = 0;
+  cache->max_bytes = 0;
+  cache->closing = true;
+  
+  if (cache->pending == 0) free(cache);
+}
+
+// Release a request's hold on the cache
+static void
+bare_xdiff_cache_release(bare_xdiff_cache_t *cache) {
+  if (--cache->pending == 0 && cache->closing) free(cache);
+}
+
+// Find the histogram slot of a value given the bounds of the other slots
+static size_t
+bare_xdiff_metrics_slot(const uint64_t *bounds, size_t len, uint64_t value) {
+  size_t i = 0;
+  while (i < len && value > bounds[i]) i++;
+  return i;
+}
+
+// Work function for all operations, keeping the module metrics around the
+// work of the request
+static void
+bare_xdiff_work(uv_work_t *req) {
+  bare_xdiff_request_t *request = (bare_xdiff_request_t *)req->data;
+  uint64_t wait = uv_hrtime() - request->queued_at;
+  
+  bare_xdiff_atomic_sub(&bare_xdiff_metrics.queued, 1);
+  bare_xdiff_atomic_add(&bare_xdiff_metrics.running, 1);
+  bare_xdiff_atomic_add(&bare_xdiff_metrics.queue_wait[bare_xdiff_metrics_slot(bare_xdiff_metrics_bins, BARE_XDIFF_METRICS_BINS - 1, wait)], 1);
+  
+  request->work(req);
+  
+  // The result is held natively until it is copied to JavaScript
+  request->memory += request->result_len;
+  bare_xdiff_atomic_add(&bare_xdiff_metrics.memory, request->result_len);
+  bare_xdiff_atomic_sub(&bare_xdiff_metrics.running, 1);
+}
+
+// After work callback for all operations
+static void
+bare_xdiff_after(uv_work_t *req, int status) {
+  int err;
+  bare_xdiff_request_t *request = (bare_xdiff_request_t *)req->data;
+  js_env_t *env = request->env;
+  
+  // Record the outcome and latency of the request
+  bool failed = status != 0 || request->error_code < 0;
+  
+  if (status == UV_ECANCELED) bare_xdiff_atomic_sub(&bare_xdiff_metrics.queued, 1);
+  
+  if (failed) {
+    bare_xdiff_atomic_add(&bare_xdiff_metrics.failed, 1);
+  } else {
+    bare_xdiff_atomic_add(&bare_xdiff_metrics.completed, 1);
+    bare_xdiff_atomic_add(&bare_xdiff_metrics.bytes_copied, request->result_len);
+  }
+  
+  size_t size = bare_xdiff_metrics_slot(bare_xdiff_metrics_sizes, BARE_XDIFF_METRICS_SIZES - 1, request->input_bytes);
+  size_t bin = bare_xdiff_metrics_slot(bare_xdiff_metrics_bins, BARE_XDIFF_METRICS_BINS - 1, uv_hrtime() - request->queued_at);
+  bare_xdiff_atomic_add(&bare_xdiff_metrics.latency[size][bin], 1);
+  
+  js_handle_scope_t *scope;
   err = js_open_handle_scope(env, &scope);
   assert(err == 0);
   
@@ -389,12 +1894,16 @@ bare_xdiff_after(uv_work_t *req, int status) {
   err = js_get_reference_value(env, request->callback, &callback);
   assert(err == 0);
   
+  // Pass the last changed files of a tree diff before it completes
+  if (request->stream) bare_xdiff_tree_flush(request->stream);
+  
   js_value_t *argv[2];
   
-  if (status != 0 || request->error_code < 0) {
+  if (failed) {
     // Call callback(error, null)
     js_value_t *message;
-    err = js_create_string_utf8(env, (const utf8_t *)"Operation failed", -1, &message);
+    const char *error_message = request->error_message ? request->error_message : "Operation failed";
+    err = js_create_string_utf8(env, (const utf8_t *)error_message, -1, &message);
     assert(err == 0);
     err = js_create_error(env, NULL, message, &argv[0]);
     assert(err == 0);
@@ -406,8 +1915,7 @@ bare_xdiff_after(uv_work_t *req, int status) {
     err = js_get_null(env, &argv[0]);
     assert(err == 0);
     
-    // Check if this is a merge operation (has buf3)
-    if (request->buf3 != NULL) {
+    if (request->type == BARE_XDIFF_OP_MERGE) {
       // For merge operations, return an object {conflict: boolean, output: string}
       js_value_t *result_obj;
       err = js_create_object(env, &result_obj);
@@ -422,6 +1930,7 @@ bare_xdiff_after(uv_work_t *req, int status) {
       assert(err == 0);
       
       // Add output property as buffer
+      uint64_t start = uv_hrtime();
       js_value_t *output_arraybuffer, *output_prop;
       void *output_data;
       err = js_create_arraybuffer(env, request->result_len, &output_data, &output_arraybuffer);
@@ -433,9 +1942,51 @@ bare_xdiff_after(uv_work_t *req, int status) {
       err = js_set_named_property(env, result_obj, "output", output_prop);
       assert(err == 0);
       
+      // Add stats property (if requested)
+      if (request->merge_stats) {
+        request->stats.copy_ns += uv_hrtime() - start;
+        
+        js_value_t *stats_prop;
+        err = bare_xdiff_create_stats(env, &request->stats, true, &stats_prop);
+        assert(err == 0);
+        err = js_set_named_property(env, result_obj, "stats", stats_prop);
+        assert(err == 0);
+      }
+      
       argv[1] = result_obj;
-    } else {
+    } else if (request->type == BARE_XDIFF_OP_DIFF) {
       // For diff operations, return buffer
+      uint64_t start = uv_hrtime();
+      err = bare_xdiff_create_diff_result(env, &request->diff_options, request->result, request->result_len, &argv[1]);
+      assert(err == 0);
+      
+      if (request->diff_options.stats) {
+        request->stats.copy_ns = uv_hrtime() - start;
+        err = bare_xdiff_create_diff_stats_result(env, &request->stats, argv[1], &argv[1]);
+        assert(err == 0);
+      }
+      
+      if (request->cache && !request->cache->closing) {
+        bare_xdiff_cache_put(request->cache, &request->cache_key, argv[1], request->result_len);
+      }
+    } else if (request->type == BARE_XDIFF_OP_DIFF_TREES) {
+      // For diffTrees operations, the files have been passed already
+      err = js_get_null(env, &argv[1]);
+      assert(err == 0);
+    } else if (request->type == BARE_XDIFF_OP_BLAME) {
+      // For blame operations, return the origin of every line
+      err = bare_xdiff_create_origins(env, (const uint32_t *)request->result, request->result_len / sizeof(uint32_t), &argv[1]);
+      assert(err == 0);
+    } else if (request->type == BARE_XDIFF_OP_SIMILARITY) {
+      // For similarity operations, return an array of matches
+      err = bare_xdiff_create_matches(env, request->result, request->result_len, &argv[1]);
+      assert(err == 0);
+    } else if (request->type == BARE_XDIFF_OP_DIFF_MANY) {
+      // For diffMany operations, return an array with a result per target
+      err = bare_xdiff_create_diff_many_result(env, &request->diff_options, request->results, request->bufs_len, &argv[1]);
+      assert(err == 0);
+    } else {
+      // For delta operations, return buffer
       js_value_t *result_arraybuffer;
       void *result_data;
       err = js_create_arraybuffer(env, request->result_len, &result_data, &result_arraybuffer);
@@ -457,7 +2008,24 @@ bare_xdiff_after(uv_work_t *req, int status) {
   xdl_free(request->buf1);
   xdl_free(request->buf2);
   if (request->buf3) xdl_free(request->buf3);
+  for (size_t i = 0; i < request->bufs_len; i++) xdl_free(request->bufs[i]);
+  if (request->bufs) xdl_free(request->bufs);
+  if (request->lens) xdl_free(request->lens);
   if (request->result) xdl_free(request->result);
+  if (request->results) bare_xdiff_diff_results_free(request->results, request->bufs_len);
+  bare_xdiff_diff_options_clear(&request->diff_options);
+  
+  if (request->stream) {
+    err = js_delete_reference(env, request->stream->ctx);
+    assert(err == 0);
+    err = js_delete_reference(env, request->stream->onentry);
+    assert(err == 0);
+    
+    uv_close((uv_handle_t *)&request->stream->async, bare_xdiff_tree_on_close);
+  }
+  
+  if (request->cache) bare_xdiff_cache_release(request->cache);
+  bare_xdiff_atomic_sub(&bare_xdiff_metrics.memory, request->memory);
   
   err = js_delete_reference(env, request->ctx);
   assert(err == 0);
@@ -471,13 +2039,54 @@ bare_xdiff_after(uv_work_t *req, int status) {
   free(request);
 }
 
+// Store the callback and context of a request and queue it on the loop
+static void
+bare_xdiff_queue_request(js_env_t *env, js_callback_info_t *info, bare_xdiff_request_t *request, js_value_t *callback, uv_work_cb work) {
+  int err;
+  
+  // Store callback reference
+  err = js_create_reference(env, callback, 1, &request->callback);
+  assert(err == 0);
+  
+  // Get context
+  js_value_t *ctx;
+  err = js_get_callback_info(env, info, NULL, NULL, &ctx, NULL);
+  assert(err == 0);
+  
+  err = js_create_reference(env, ctx, 1, &request->ctx);
+  assert(err == 0);
+  
+  // Start teardown tracking
+  err = js_add_deferred_teardown_callback(env, NULL, NULL, &request->teardown);
+  assert(err == 0);
+  
+  // Account for the copies of the inputs
+  request->input_bytes = request->len1 + request->len2 + request->len3;
+  for (size_t i = 0; i < request->bufs_len; i++) request->input_bytes += request->lens[i];
+  request->memory = request->input_bytes;
+  request->queued_at = uv_hrtime();
+  request->work = work;
+  
+  bare_xdiff_atomic_add(&bare_xdiff_metrics.queued, 1);
+  bare_xdiff_atomic_add(&bare_xdiff_metrics.bytes_copied, request->input_bytes);
+  bare_xdiff_atomic_add(&bare_xdiff_metrics.memory, request->input_bytes);
+  
+  // Queue work
+  request->request.data = request;
+  uv_loop_t *loop;
+  err = js_get_env_loop(env, &loop);
+  assert(err == 0);
+  uv_queue_work(loop, &request->request, bare_xdiff_work, bare_xdiff_after);
+}
+
 // JavaScript function: diff
 static js_value_t *
 bare_xdiff_diff(js_env_t *env, js_callback_info_t *info) {
   int err;
   size_t argc = 4;
   js_value_t *argv[4];
-  err = js_get_callback_info(env, info, &argc, argv, NULL, NULL);
+  bare_xdiff_cache_t *cache;
+  err = js_get_callback_info(env, info, &argc, argv, NULL, (void **)&cache);
   assert(err == 0);
   
   // Get buffer data for both inputs
@@ -510,201 +2119,1523 @@ bare_xdiff_diff(js_env_t *env, js_callback_info_t *info) {
     return NULL;
   }
   
+  // Parse options (if provided)
+  bare_xdiff_diff_options_t diff_options;
+  if (options) {
+    parse_diff_options(env, options, &diff_options);
+  } else {
+    diff_options.flags = 0;
+    diff_options.granularity = BARE_XDIFF_GRANULARITY_LINE;
+    diff_options.encoding = BARE_XDIFF_ENCODING_UNIFIED;
+    diff_options.stats = false;
+    diff_options.max_memory = 0;
+    diff_options.anchors = NULL;
+    diff_options.anchors_len = 0;
+    diff_options.ignore_regex = NULL;
+    diff_options.ignore_regex_len = 0;
+    diff_options.ignore_regex_hash = 0;
+    diff_options.func_names = false;
+    diff_options.func_regex = NULL;
+    diff_options.func_regex_len = 0;
+    diff_options.func_regex_hash = 0;
+  }
+  
+  // Answer from the cache without going through the thread pool, unless the
+  // caller asked for the stats of an actual run. Diffs with a memory budget
+  // are not cached, as whether they fail depends on the budget.
+  bare_xdiff_cache_key_t cache_key;
+  bool cacheable = cache->max_bytes > 0 && !diff_options.stats && !diff_options.max_memory;
+  
+  if (cacheable) {
+    bare_xdiff_cache_key_init(&cache_key, (char*)data1 + offset1, len1, (char*)data2 + offset2, len2, &diff_options);
+    
+    js_value_t *cached = bare_xdiff_cache_get(cache, &cache_key);
+    
+    if (cached) {
+      js_value_t *ctx;
+      err = js_get_callback_info(env, info, NULL, NULL, &ctx, NULL);
+      assert(err == 0);
+      
+      js_value_t *result_argv[2];
+      err = js_get_null(env, &result_argv[0]);
+      assert(err == 0);
+      result_argv[1] = cached;
+      
+      bare_xdiff_diff_options_clear(&diff_options);
+      
+      js_call_function(env, ctx, callback, 2, result_argv, NULL);
+      return NULL;
+    }
+  }
+  
+  // Create request
+  bare_xdiff_request_t *request = calloc(1, sizeof(bare_xdiff_request_t));
+  request->env = env;
+  request->type = BARE_XDIFF_OP_DIFF;
+  request->diff_options = diff_options;
+  
+  if (cacheable) {
+    request->cache = cache;
+    request->cache_key = cache_key;
+    cache->pending++;
+  }
+  
+  // Copy input data
+  request->buf1 = xdl_malloc(len1);
+  request->len1 = len1;
+  memcpy(request->buf1, (char*)data1 + offset1, len1);
+  
+  request->buf2 = xdl_malloc(len2);
+  request->len2 = len2;
+  memcpy(request->buf2, (char*)data2 + offset2, len2);
+  
+  bare_xdiff_queue_request(env, info, request, callback, bare_xdiff_diff_work);
+  
+  return NULL;
+}
+
+
+// JavaScript function: merge
+static js_value_t *
+bare_xdiff_merge(js_env_t *env, js_callback_info_t *info) {
+  int err;
+  size_t argc = 5;
+  js_value_t *argv[5];
+  err = js_get_callback_info(env, info, &argc, argv, NULL, NULL);
+  assert(err == 0);
+  
+  // Get buffer data for all three inputs
+  void *data1, *data2, *data3;
+  size_t len1, len2, len3;
+  js_typedarray_type_t type1, type2, type3;
+  js_value_t *arraybuffer1, *arraybuffer2, *arraybuffer3;
+  size_t offset1, offset2, offset3;
+  
+  err = js_get_typedarray_info(env, argv[0], &type1, &data1, &len1, &arraybuffer1, &offset1);
+  assert(err == 0);
+  assert(type1 == js_uint8array);
+  
+  err = js_get_typedarray_info(env, argv[1], &type2, &data2, &len2, &arraybuffer2, &offset2);
+  assert(err == 0);
+  assert(type2 == js_uint8array);
+  
+  err = js_get_typedarray_info(env, argv[2], &type3, &data3, &len3, &arraybuffer3, &offset3);
+  assert(err == 0);
+  assert(type3 == js_uint8array);
+  
+  // Handle optional arguments: merge(o, a, b, callback) or merge(o, a, b, options, callback)
+  js_value_t *options = NULL;
+  js_value_t *callback;
+  
+  if (argc == 4) {
+    // merge(o, a, b, callback)
+    callback = argv[3];
+  } else if (argc == 5) {
+    // merge(o, a, b, options, callback)
+    options = argv[3];
+    callback = argv[4];
+  } else {
+    // Invalid number of arguments
+    return NULL;
+  }
+  
+  // Create request
+  bare_xdiff_request_t *request = calloc(1, sizeof(bare_xdiff_request_t));
+  request->env = env;
+  request->type = BARE_XDIFF_OP_MERGE;
+  
+  // Parse merge options (if provided)
+  if (options) {
+    parse_merge_options(env, options, &request->merge_level, &request->merge_favor, &request->merge_style, &request->merge_marker_size, &request->merge_normalize_eol, &request->merge_stats);
+  } else {
+    request->merge_level = XDL_MERGE_MINIMAL;
+    request->merge_favor = 0;
+    request->merge_style = 0;
+    request->merge_marker_size = 7;
+    request->merge_normalize_eol = false;
+  }
+  
+  // Copy input data
+  request->buf1 = xdl_malloc(len1);
+  request->len1 = len1;
+  memcpy(request->buf1, (char*)data1 + offset1, len1);
+  
+  request->buf2 = xdl_malloc(len2);
+  request->len2 = len2;
+  memcpy(request->buf2, (char*)data2 + offset2, len2);
+  
+  request->buf3 = xdl_malloc(len3);
+  request->len3 = len3;
+  memcpy(request->buf3, (char*)data3 + offset3, len3);
+  
+  bare_xdiff_queue_request(env, info, request, callback, bare_xdiff_merge_work);
+  
+  return NULL;
+}
+
+// Synchronous diff function
+static js_value_t *
+bare_xdiff_diff_sync(js_env_t *env, js_callback_info_t *info) {
+  int err;
+  size_t argc = 3;
+  js_value_t *argv[3];
+  bare_xdiff_cache_t *cache;
+  err = js_get_callback_info(env, info, &argc, argv, NULL, (void **)&cache);
+  assert(err == 0);
+  
+  // Get buffer data for both inputs
+  void *data1, *data2;
+  size_t len1, len2;
+  js_typedarray_type_t type1, type2;
+  js_value_t *arraybuffer1, *arraybuffer2;
+  size_t offset1, offset2;
+  
+  err = js_get_typedarray_info(env, argv[0], &type1, &data1, &len1, &arraybuffer1, &offset1);
+  assert(err == 0);
+  assert(type1 == js_uint8array);
+  
+  err = js_get_typedarray_info(env, argv[1], &type2, &data2, &len2, &arraybuffer2, &offset2);
+  assert(err == 0);
+  assert(type2 == js_uint8array);
+  
+  // Third argument is options (optional)
+  js_value_t *options = NULL;
+  if (argc == 3) {
+    options = argv[2];
+  }
+  
+  // Parse options
+  bare_xdiff_diff_options_t diff_options;
+  memset(&diff_options, 0, sizeof(diff_options));
+  if (options) {
+    parse_diff_options(env, options, &diff_options);
+  }
+  
+  // Diffs with a memory budget are not cached, see bare_xdiff_diff()
+  bare_xdiff_cache_key_t cache_key;
+  bool cacheable = cache->max_bytes > 0 && !diff_options.stats && !diff_options.max_memory;
+  
+  if (cacheable) {
+    bare_xdiff_cache_key_init(&cache_key, (char*)data1 + offset1, len1, (char*)data2 + offset2, len2, &diff_options);
+    
+    js_value_t *cached = bare_xdiff_cache_get(cache, &cache_key);
+    
+    if (cached) {
+      bare_xdiff_diff_options_clear(&diff_options);
+      return cached;
+    }
+  }
+  
+  // Set up mmfile structures for xdiff
+  mmfile_t mf1, mf2;
+  mf1.ptr = (char*)data1 + offset1;
+  mf1.size = (long)len1;
+  mf2.ptr = (char*)data2 + offset2;
+  mf2.size = (long)len2;
+  
+  // Set up output handler
+  bare_xdiff_output_t output;
+  memset(&output, 0, sizeof(output));
+  output.data = xdl_malloc(1024);
+  output.capacity = 1024;
+  output.len = 0;
+  
+  if (!output.data) {
+    bare_xdiff_diff_options_clear(&diff_options);
+    js_throw_error(env, NULL, "Memory allocation failed");
+    return NULL;
+  }
+  
+  // Perform the diff
+  bare_xdiff_stats_t stats;
+  memset(&stats, 0, sizeof(stats));
+  int result = bare_xdiff_run_diff(&mf1, &mf2, &diff_options, &output, diff_options.stats ? &stats : NULL);
+  bare_xdiff_diff_options_clear(&diff_options);
+  
+  if (result < 0) {
+    xdl_free(output.data);
+    js_throw_error(env, NULL, result == BARE_XDIFF_ERROR_MEMORY ? "Diff exceeds maxMemory" : "xdl_diff failed");
+    return NULL;
+  }
+  
+  // Create result buffer
+  uint64_t start = uv_hrtime();
+  js_value_t *result_value;
+  err = bare_xdiff_create_diff_result(env, &diff_options, output.data, output.len, &result_value);
+  if (err != 0) {
+    xdl_free(output.data);
+    js_throw_error(env, NULL, "Failed to create result buffer");
+    return NULL;
+  }
+  
+  if (diff_options.stats) {
+    stats.copy_ns = uv_hrtime() - start;
+    err = bare_xdiff_create_diff_stats_result(env, &stats, result_value, &result_value);
+    if (err != 0) {
+      xdl_free(output.data);
+      js_throw_error(env, NULL, "Failed to create stats object");
+      return NULL;
+    }
+  }
+  
+  if (cacheable) bare_xdiff_cache_put(cache, &cache_key, result_value, output.len);
+  
+  xdl_free(output.data);
+  return result_value;
+}
+
+// JavaScript function: diffMany
+static js_value_t *
+bare_xdiff_diff_many(js_env_t *env, js_callback_info_t *info) {
+  int err;
+  size_t argc = 4;
+  js_value_t *argv[4];
+  err = js_get_callback_info(env, info, &argc, argv, NULL, NULL);
+  assert(err == 0);
+  
+  if (argc != 4) {
+    return NULL;
+  }
+  
+  void *data;
+  size_t len;
+  js_typedarray_type_t type;
+  js_value_t *arraybuffer;
+  size_t offset;
+  
+  err = js_get_typedarray_info(env, argv[0], &type, &data, &len, &arraybuffer, &offset);
+  assert(err == 0);
+  assert(type == js_uint8array);
+  
+  uint32_t count;
+  err = js_get_array_length(env, argv[1], &count);
+  assert(err == 0);
+  
+  // Create request
+  bare_xdiff_request_t *request = calloc(1, sizeof(bare_xdiff_request_t));
+  request->env = env;
+  request->type = BARE_XDIFF_OP_DIFF_MANY;
+  parse_diff_options(env, argv[2], &request->diff_options);
+  
+  // Copy the base once for all of the targets
+  request->buf1 = xdl_malloc(len ? len : 1);
+  request->len1 = len;
+  memcpy(request->buf1, (char*)data + offset, len);
+  
+  request->bufs = xdl_malloc((count ? count : 1) * sizeof(void *));
+  request->lens = xdl_malloc((count ? count : 1) * sizeof(size_t));
+  
+  for (uint32_t i = 0; i < count; i++) {
+    js_value_t *element;
+    err = js_get_element(env, argv[1], i, &element);
+    assert(err == 0);
+    
+    err = js_get_typedarray_info(env, element, &type, &data, &len, &arraybuffer, &offset);
+    assert(err == 0);
+    assert(type == js_uint8array);
+    
+    request->bufs[i] = xdl_malloc(len ? len : 1);
+    request->lens[i] = len;
+    request->bufs_len++;
+    memcpy(request->bufs[i], (char*)data + offset, len);
+  }
+  
+  bare_xdiff_queue_request(env, info, request, argv[3], bare_xdiff_diff_many_work);
+  
+  return NULL;
+}
+
+// Synchronous diffMany function
+static js_value_t *
+bare_xdiff_diff_many_sync(js_env_t *env, js_callback_info_t *info) {
+  int err;
+  size_t argc = 3;
+  js_value_t *argv[3];
+  err = js_get_callback_info(env, info, &argc, argv, NULL, NULL);
+  assert(err == 0);
+  
+  bare_xdiff_diff_options_t diff_options;
+  memset(&diff_options, 0, sizeof(diff_options));
+  if (argc == 3) {
+    parse_diff_options(env, argv[2], &diff_options);
+  }
+  
+  void *data;
+  size_t len;
+  js_typedarray_type_t type;
+  js_value_t *arraybuffer;
+  size_t offset;
+  
+  err = js_get_typedarray_info(env, argv[0], &type, &data, &len, &arraybuffer, &offset);
+  assert(err == 0);
+  assert(type == js_uint8array);
+  
+  uint32_t count;
+  err = js_get_array_length(env, argv[1], &count);
+  assert(err == 0);
+  
+  bare_xdiff_diff_many_t job;
+  memset(&job, 0, sizeof(job));
+  job.base.ptr = (char*)data + offset;
+  job.base.size = (long)len;
+  job.len = count;
+  job.options = &diff_options;
+  job.targets = xdl_malloc((count ? count : 1) * sizeof(mmfile_t));
+  job.results = xdl_malloc((count ? count : 1) * sizeof(bare_xdiff_diff_result_t));
+  
+  if (!job.targets || !job.results) {
+    xdl_free(job.targets);
+    xdl_free(job.results);
+    bare_xdiff_diff_options_clear(&diff_options);
+    js_throw_error(env, NULL, "Memory allocation failed");
+    return NULL;
+  }
+  
+  memset(job.results, 0, (count ? count : 1) * sizeof(bare_xdiff_diff_result_t));
+  
+  // The inputs are only read, so they are used in place
+  for (uint32_t i = 0; i < count; i++) {
+    js_value_t *element;
+    err = js_get_element(env, argv[1], i, &element);
+    assert(err == 0);
+    
+    err = js_get_typedarray_info(env, element, &type, &data, &len, &arraybuffer, &offset);
+    assert(err == 0);
+    assert(type == js_uint8array);
+    
+    job.targets[i].ptr = (char*)data + offset;
+    job.targets[i].size = (long)len;
+  }
+  
+  int result = bare_xdiff_run_diff_many(&job);
+  xdl_free(job.targets);
+  bare_xdiff_diff_options_clear(&diff_options);
+  
+  if (result < 0) {
+    bare_xdiff_diff_results_free(job.results, count);
+    js_throw_error(env, NULL, result == BARE_XDIFF_ERROR_MEMORY ? "Diff exceeds maxMemory" : "xdl_diff failed");
+    return NULL;
+  }
+  
+  js_value_t *result_value;
+  err = bare_xdiff_create_diff_many_result(env, &diff_options, job.results, count, &result_value);
+  bare_xdiff_diff_results_free(job.results, count);
+  if (err != 0) {
+    js_throw_error(env, NULL, "Failed to create result buffer");
+    return NULL;
+  }
+  
+  return result_value;
+}
+
+// Synchronous merge function
+static js_value_t *
+bare_xdiff_merge_sync(js_env_t *env, js_callback_info_t *info) {
+  int err;
+  size_t argc = 4;
+  js_value_t *argv[4];
+  err = js_get_callback_info(env, info, &argc, argv, NULL, NULL);
+  assert(err == 0);
+  
+  // Get buffer data for all three inputs
+  void *data1, *data2, *data3;
+  size_t len1, len2, len3;
+  js_typedarray_type_t type1, type2, type3;
+  js_value_t *arraybuffer1, *arraybuffer2, *arraybuffer3;
+  size_t offset1, offset2, offset3;
+  
+  err = js_get_typedarray_info(env, argv[0], &type1, &data1, &len1, &arraybuffer1, &offset1);
+  assert(err == 0);
+  assert(type1 == js_uint8array);
+  
+  err = js_get_typedarray_info(env, argv[1], &type2, &data2, &len2, &arraybuffer2, &offset2);
+  assert(err == 0);
+  assert(type2 == js_uint8array);
+  
+  err = js_get_typedarray_info(env, argv[2], &type3, &data3, &len3, &arraybuffer3, &offset3);
+  assert(err == 0);
+  assert(type3 == js_uint8array);
+  
+  // Fourth argument is options (optional)
+  js_value_t *options = NULL;
+  if (argc == 4) {
+    options = argv[3];
+  }
+  
+  // Parse merge options
+  int32_t merge_level = XDL_MERGE_MINIMAL;
+  int32_t merge_favor = 0;
+  int32_t merge_style = 0;
+  int32_t merge_marker_size = 7;
+  bool merge_normalize_eol = false;
+  bool merge_stats = false;
+  
+  if (options) {
+    parse_merge_options(env, options, &merge_level, &merge_favor, &merge_style, &merge_marker_size, &merge_normalize_eol, &merge_stats);
+  }
+  
+  // Set up mmfile structures for three-way merge
+  mmfile_t ancestor, ours, theirs;
+  ancestor.ptr = (char*)data1 + offset1;
+  ancestor.size = (long)len1;
+  ours.ptr = (char*)data2 + offset2;
+  ours.size = (long)len2;
+  theirs.ptr = (char*)data3 + offset3;
+  theirs.size = (long)len3;
+  
+  // Configure merge parameters
+  xmparam_t xmp;
+  memset(&xmp, 0, sizeof(xmp));
+  xmp.marker_size = merge_marker_size;
+  xmp.level = merge_level;
+  xmp.favor = merge_favor;
+  xmp.style = merge_style;
+  if (merge_normalize_eol) xmp.xpp.flags |= XDF_IGNORE_CR_AT_EOL;
+  
+  // Output buffer
+  mmbuffer_t result;
+  memset(&result, 0, sizeof(result));
+  
+  // Perform the merge
+  bare_xdiff_stats_t stats;
+  memset(&stats, 0, sizeof(stats));
+  int ret = bare_xdiff_run_merge(&ancestor, &ours, &theirs, &xmp, &result, merge_stats ? &stats : NULL);
+  
+  if (ret < 0) {
+    js_throw_error(env, NULL, "xdl_merge failed");
+    return NULL;
+  }
+  
+  // Create result object {conflict: boolean, output: string}
+  js_value_t *result_obj;
+  err = js_create_object(env, &result_obj);
+  if (err != 0) {
+    if (result.ptr) xdl_free(result.ptr);
+    js_throw_error(env, NULL, "Failed to create result object");
+    return NULL;
+  }
+  
+  // Add conflict property
+  js_value_t *conflict_prop;
+  bool has_conflict = ret > 0;  // ret is the number of conflicts
+  err = js_get_boolean(env, has_conflict, &conflict_prop);
+  if (err != 0) {
+    if (result.ptr) xdl_free(result.ptr);
+    js_throw_error(env, NULL, "Failed to create conflict property");
+    return NULL;
+  }
+  err = js_set_named_property(env, result_obj, "conflict", conflict_prop);
+  if (err != 0) {
+    if (result.ptr) xdl_free(result.ptr);
+    js_throw_error(env, NULL, "Failed to set conflict property");
+    return NULL;
+  }
+  
+  // Add output property as buffer
+  uint64_t start = uv_hrtime();
+  js_value_t *output_arraybuffer, *output_prop;
+  void *output_data;
+  err = js_create_arraybuffer(env, result.size, &output_data, &output_arraybuffer);
+  if (err != 0) {
+    if (result.ptr) xdl_free(result.ptr);
+    js_throw_error(env, NULL, "Failed to create output buffer");
+    return NULL;
+  }
+  memcpy(output_data, result.ptr, result.size);
+  
+  err = js_create_typedarray(env, js_uint8array, result.size, output_arraybuffer, 0, &output_prop);
+  if (err != 0) {
+    if (result.ptr) xdl_free(result.ptr);
+    js_throw_error(env, NULL, "Failed to create output Uint8Array");
+    return NULL;
+  }
+  err = js_set_named_property(env, result_obj, "output", output_prop);
+  if (err != 0) {
+    if (result.ptr) xdl_free(result.ptr);
+    js_throw_error(env, NULL, "Failed to set output property");
+    return NULL;
+  }
+  
+  // Add stats property (if requested)
+  if (merge_stats) {
+    stats.copy_ns = uv_hrtime() - start;
+    
+    js_value_t *stats_prop;
+    err = bare_xdiff_create_stats(env, &stats, true, &stats_prop);
+    if (err == 0) err = js_set_named_property(env, result_obj, "stats", stats_prop);
+    if (err != 0) {
+      if (result.ptr) xdl_free(result.ptr);
+      js_throw_error(env, NULL, "Failed to set stats property");
+      return NULL;
+    }
+  }
+  
+  if (result.ptr) xdl_free(result.ptr);
+  return result_obj;
+}
+
+
+// Queue a request that takes two buffers and produces a buffer
+static js_value_t *
+bare_xdiff_queue_pair_request(js_env_t *env, js_callback_info_t *info, int32_t type, uv_work_cb work) {
+  int err;
+  size_t argc = 3;
+  js_value_t *argv[3];
+  err = js_get_callback_info(env, info, &argc, argv, NULL, NULL);
+  assert(err == 0);
+  
+  if (argc != 3) {
+    return NULL;
+  }
+  
+  // Get buffer data for both inputs
+  void *data1, *data2;
+  size_t len1, len2;
+  js_typedarray_type_t type1, type2;
+  js_value_t *arraybuffer1, *arraybuffer2;
+  size_t offset1, offset2;
+  
+  err = js_get_typedarray_info(env, argv[0], &type1, &data1, &len1, &arraybuffer1, &offset1);
+  assert(err == 0);
+  assert(type1 == js_uint8array);
+  
+  err = js_get_typedarray_info(env, argv[1], &type2, &data2, &len2, &arraybuffer2, &offset2);
+  assert(err == 0);
+  assert(type2 == js_uint8array);
+  
+  // Create request
+  bare_xdiff_request_t *request = calloc(1, sizeof(bare_xdiff_request_t));
+  request->env = env;
+  request->type = type;
+  
+  // Copy input data
+  request->buf1 = xdl_malloc(len1);
+  request->len1 = len1;
+  memcpy(request->buf1, (char*)data1 + offset1, len1);
+  
+  request->buf2 = xdl_malloc(len2);
+  request->len2 = len2;
+  memcpy(request->buf2, (char*)data2 + offset2, len2);
+  
+  bare_xdiff_queue_request(env, info, request, argv[2], work);
+  
+  return NULL;
+}
+
+// JavaScript function: delta
+static js_value_t *
+bare_xdiff_delta_async(js_env_t *env, js_callback_info_t *info) {
+  return bare_xdiff_queue_pair_request(env, info, BARE_XDIFF_OP_DELTA, bare_xdiff_delta_work);
+}
+
+// JavaScript function: applyDelta
+static js_value_t *
+bare_xdiff_apply_delta_async(js_env_t *env, js_callback_info_t *info) {
+  return bare_xdiff_queue_pair_request(env, info, BARE_XDIFF_OP_APPLY_DELTA, bare_xdiff_apply_delta_work);
+}
+
+// Synchronous delta function
+static js_value_t *
+bare_xdiff_delta_sync(js_env_t *env, js_callback_info_t *info) {
+  int err;
+  size_t argc = 2;
+  js_value_t *argv[2];
+  err = js_get_callback_info(env, info, &argc, argv, NULL, NULL);
+  assert(err == 0);
+  
+  // Get buffer data for both inputs
+  void *data1, *data2;
+  size_t len1, len2;
+  js_typedarray_type_t type1, type2;
+  js_value_t *arraybuffer1, *arraybuffer2;
+  size_t offset1, offset2;
+  
+  err = js_get_typedarray_info(env, argv[0], &type1, &data1, &len1, &arraybuffer1, &offset1);
+  assert(err == 0);
+  assert(type1 == js_uint8array);
+  
+  err = js_get_typedarray_info(env, argv[1], &type2, &data2, &len2, &arraybuffer2, &offset2);
+  assert(err == 0);
+  assert(type2 == js_uint8array);
+  
+  // Set up output handler
+  bare_xdiff_output_t output;
+  memset(&output, 0, sizeof(output));
+  output.data = xdl_malloc(1024);
+  output.capacity = 1024;
+  output.len = 0;
+  
+  if (!output.data) {
+    js_throw_error(env, NULL, "Memory allocation failed");
+    return NULL;
+  }
+  
+  int result = bare_xdiff_delta((char*)data1 + offset1, len1, (char*)data2 + offset2, len2, &output);
+  
+  if (result < 0) {
+    xdl_free(output.data);
+    js_throw_error(env, NULL, "Delta failed");
+    return NULL;
+  }
+  
+  // Create result buffer
+  js_value_t *result_buffer;
+  void *result_data;
+  err = js_create_arraybuffer(env, output.len, &result_data, &result_buffer);
+  if (err != 0) {
+    xdl_free(output.data);
+    js_throw_error(env, NULL, "Failed to create result buffer");
+    return NULL;
+  }
+  memcpy(result_data, output.data, output.len);
+  
+  js_value_t *result_uint8;
+  err = js_create_typedarray(env, js_uint8array, output.len, result_buffer, 0, &result_uint8);
+  xdl_free(output.data);
+  if (err != 0) {
+    js_throw_error(env, NULL, "Failed to create result Uint8Array");
+    return NULL;
+  }
+  
+  return result_uint8;
+}
+
+// Apply a delta or binary patch to a base buffer synchronously
+static js_value_t *
+bare_xdiff_apply_sync(js_env_t *env, js_callback_info_t *info, int (*apply)(const char *, size_t, const char *, size_t, char **, size_t *), const char *error_message) {
+  int err;
+  size_t argc = 2;
+  js_value_t *argv[2];
+  err = js_get_callback_info(env, info, &argc, argv, NULL, NULL);
+  assert(err == 0);
+  
+  // Get buffer data for base and delta or patch
+  void *data1, *data2;
+  size_t len1, len2;
+  js_typedarray_type_t type1, type2;
+  js_value_t *arraybuffer1, *arraybuffer2;
+  size_t offset1, offset2;
+  
+  err = js_get_typedarray_info(env, argv[0], &type1, &data1, &len1, &arraybuffer1, &offset1);
+  assert(err == 0);
+  assert(type1 == js_uint8array);
+  
+  err = js_get_typedarray_info(env, argv[1], &type2, &data2, &len2, &arraybuffer2, &offset2);
+  assert(err == 0);
+  assert(type2 == js_uint8array);
+  
+  char *target;
+  size_t target_len;
+  
+  int result = apply((char*)data1 + offset1, len1, (char*)data2 + offset2, len2, &target, &target_len);
+  
+  if (result < 0) {
+    js_throw_error(env, NULL, error_message);
+    return NULL;
+  }
+  
+  // Create result buffer
+  js_value_t *result_buffer;
+  void *result_data;
+  err = js_create_arraybuffer(env, target_len, &result_data, &result_buffer);
+  if (err != 0) {
+    xdl_free(target);
+    js_throw_error(env, NULL, "Failed to create result buffer");
+    return NULL;
+  }
+  memcpy(result_data, target, target_len);
+  
+  js_value_t *result_uint8;
+  err = js_create_typedarray(env, js_uint8array, target_len, result_buffer, 0, &result_uint8);
+  xdl_free(target);
+  if (err != 0) {
+    js_throw_error(env, NULL, "Failed to create result Uint8Array");
+    return NULL;
+  }
+  
+  return result_uint8;
+}
+
+// Synchronous apply delta function
+static js_value_t *
+bare_xdiff_apply_delta_sync(js_env_t *env, js_callback_info_t *info) {
+  return bare_xdiff_apply_sync(env, info, bare_xdiff_apply_delta, "Invalid delta");
+}
+
+// JavaScript function: applyPatch
+static js_value_t *
+bare_xdiff_apply_patch_async(js_env_t *env, js_callback_info_t *info) {
+  return bare_xdiff_queue_pair_request(env, info, BARE_XDIFF_OP_APPLY_PATCH, bare_xdiff_patch_work);
+}
+
+// Synchronous apply patch function
+static js_value_t *
+bare_xdiff_apply_patch_sync(js_env_t *env, js_callback_info_t *info) {
+  return bare_xdiff_apply_sync(env, info, bare_xdiff_apply_patch, "Invalid patch");
+}
+
+// JavaScript function: invertPatch
+static js_value_t *
+bare_xdiff_invert_patch_async(js_env_t *env, js_callback_info_t *info) {
+  int err;
+  size_t argc = 2;
+  js_value_t *argv[2];
+  err = js_get_callback_info(env, info, &argc, argv, NULL, NULL);
+  assert(err == 0);
+  
+  if (argc != 2) {
+    return NULL;
+  }
+  
+  // Get buffer data for the patch
+  void *data;
+  size_t len;
+  js_typedarray_type_t type;
+  js_value_t *arraybuffer;
+  size_t offset;
+  
+  err = js_get_typedarray_info(env, argv[0], &type, &data, &len, &arraybuffer, &offset);
+  assert(err == 0);
+  assert(type == js_uint8array);
+  
+  // Create request
+  bare_xdiff_request_t *request = calloc(1, sizeof(bare_xdiff_request_t));
+  request->env = env;
+  request->type = BARE_XDIFF_OP_INVERT_PATCH;
+  
+  // Copy input data
+  request->buf1 = xdl_malloc(len);
+  request->len1 = len;
+  memcpy(request->buf1, (char*)data + offset, len);
+  
+  bare_xdiff_queue_request(env, info, request, argv[1], bare_xdiff_invert_patch_work);
+  
+  return NULL;
+}
+
+// Synchronous invert patch function
+static js_value_t *
+bare_xdiff_invert_patch_sync(js_env_t *env, js_callback_info_t *info) {
+  int err;
+  size_t argc = 1;
+  js_value_t *argv[1];
+  err = js_get_callback_info(env, info, &argc, argv, NULL, NULL);
+  assert(err == 0);
+  
+  // Get buffer data for the patch
+  void *data;
+  size_t len;
+  js_typedarray_type_t type;
+  js_value_t *arraybuffer;
+  size_t offset;
+  
+  err = js_get_typedarray_info(env, argv[0], &type, &data, &len, &arraybuffer, &offset);
+  assert(err == 0);
+  assert(type == js_uint8array);
+  
+  char *inverted;
+  size_t inverted_len;
+  
+  int result = bare_xdiff_invert_patch((char*)data + offset, len, &inverted, &inverted_len);
+  
+  if (result < 0) {
+    js_throw_error(env, NULL, "Invalid patch");
+    return NULL;
+  }
+  
+  // Create result buffer
+  js_value_t *result_buffer;
+  void *result_data;
+  err = js_create_arraybuffer(env, inverted_len, &result_data, &result_buffer);
+  if (err != 0) {
+    xdl_free(inverted);
+    js_throw_error(env, NULL, "Failed to create result buffer");
+    return NULL;
+  }
+  memcpy(result_data, inverted, inverted_len);
+  
+  js_value_t *result_uint8;
+  err = js_create_typedarray(env, js_uint8array, inverted_len, result_buffer, 0, &result_uint8);
+  xdl_free(inverted);
+  if (err != 0) {
+    js_throw_error(env, NULL, "Failed to create result Uint8Array");
+    return NULL;
+  }
+  
+  return result_uint8;
+}
+
+// JavaScript function: composePatches
+static js_value_t *
+bare_xdiff_compose_patches_async(js_env_t *env, js_callback_info_t *info) {
+  int err;
+  size_t argc = 2;
+  js_value_t *argv[2];
+  err = js_get_callback_info(env, info, &argc, argv, NULL, NULL);
+  assert(err == 0);
+  
+  if (argc != 2) {
+    return NULL;
+  }
+  
+  uint32_t count;
+  err = js_get_array_length(env, argv[0], &count);
+  assert(err == 0);
+  
+  // Create request
+  bare_xdiff_request_t *request = calloc(1, sizeof(bare_xdiff_request_t));
+  request->env = env;
+  request->type = BARE_XDIFF_OP_COMPOSE_PATCHES;
+  
+  request->bufs = xdl_malloc((count ? count : 1) * sizeof(void *));
+  request->lens = xdl_malloc((count ? count : 1) * sizeof(size_t));
+  
+  // Copy input data
+  for (uint32_t i = 0; i < count; i++) {
+    js_value_t *element;
+    err = js_get_element(env, argv[0], i, &element);
+    assert(err == 0);
+    
+    void *data;
+    size_t len;
+    js_typedarray_type_t type;
+    js_value_t *arraybuffer;
+    size_t offset;
+    
+    err = js_get_typedarray_info(env, element, &type, &data, &len, &arraybuffer, &offset);
+    assert(err == 0);
+    assert(type == js_uint8array);
+    
+    request->bufs[i] = xdl_malloc(len ? len : 1);
+    request->lens[i] = len;
+    request->bufs_len++;
+    memcpy(request->bufs[i], (char*)data + offset, len);
+  }
+  
+  bare_xdiff_queue_request(env, info, request, argv[1], bare_xdiff_compose_patches_work);
+  
+  return NULL;
+}
+
+// Synchronous compose patches function
+static js_value_t *
+bare_xdiff_compose_patches_sync(js_env_t *env, js_callback_info_t *info) {
+  int err;
+  size_t argc = 1;
+  js_value_t *argv[1];
+  err = js_get_callback_info(env, info, &argc, argv, NULL, NULL);
+  assert(err == 0);
+  
+  uint32_t count;
+  err = js_get_array_length(env, argv[0], &count);
+  assert(err == 0);
+  
+  void **patches = xdl_malloc((count ? count : 1) * sizeof(void *));
+  size_t *lens = xdl_malloc((count ? count : 1) * sizeof(size_t));
+  
+  if (!patches || !lens) {
+    xdl_free(patches);
+    xdl_free(lens);
+    js_throw_error(env, NULL, "Memory allocation failed");
+    return NULL;
+  }
+  
+  // The patches are only read, so they are used in place
+  for (uint32_t i = 0; i < count; i++) {
+    js_value_t *element;
+    err = js_get_element(env, argv[0], i, &element);
+    assert(err == 0);
+    
+    js_typedarray_type_t type;
+    js_value_t *arraybuffer;
+    size_t offset;
+    
+    err = js_get_typedarray_info(env, element, &type, &patches[i], &lens[i], &arraybuffer, &offset);
+    assert(err == 0);
+    assert(type == js_uint8array);
+    
+    patches[i] = (char*)patches[i] + offset;
+  }
+  
+  bare_xdiff_output_t output;
+  memset(&output, 0, sizeof(output));
+  output.data = xdl_malloc(1024);
+  output.capacity = 1024;
+  output.len = 0;
+  
+  int result = output.data ? bare_xdiff_compose_patches(patches, lens, count, &output) : -1;
+  
+  xdl_free(patches);
+  xdl_free(lens);
+  
+  if (result < 0) {
+    xdl_free(output.data);
+    js_throw_error(env, NULL, "Patches do not apply in sequence");
+    return NULL;
+  }
+  
+  // Create result buffer
+  js_value_t *result_buffer;
+  void *result_data;
+  err = js_create_arraybuffer(env, output.len, &result_data, &result_buffer);
+  if (err != 0) {
+    xdl_free(output.data);
+    js_throw_error(env, NULL, "Failed to create result buffer");
+    return NULL;
+  }
+  memcpy(result_data, output.data, output.len);
+  
+  js_value_t *result_uint8;
+  err = js_create_typedarray(env, js_uint8array, output.len, result_buffer, 0, &result_uint8);
+  xdl_free(output.data);
+  if (err != 0) {
+    js_throw_error(env, NULL, "Failed to create result Uint8Array");
+    return NULL;
+  }
+  
+  return result_uint8;
+}
+
+// Copy the buffers of an array of Uint8Array to the request
+static void
+bare_xdiff_copy_buffers(js_env_t *env, js_value_t *array, bare_xdiff_request_t *request) {
+  int err;
+  
+  uint32_t count;
+  err = js_get_array_length(env, array, &count);
+  assert(err == 0);
+  
+  for (uint32_t i = 0; i < count; i++) {
+    js_value_t *element;
+    err = js_get_element(env, array, i, &element);
+    assert(err == 0);
+    
+    void *data;
+    size_t len;
+    js_typedarray_type_t type;
+    js_value_t *arraybuffer;
+    size_t offset;
+    
+    err = js_get_typedarray_info(env, element, &type, &data, &len, &arraybuffer, &offset);
+    assert(err == 0);
+    assert(type == js_uint8array);
+    
+    request->bufs[request->bufs_len] = xdl_malloc(len ? len : 1);
+    request->lens[request->bufs_len] = len;
+    memcpy(request->bufs[request->bufs_len], (char*)data + offset, len);
+    request->bufs_len++;
+  }
+}
+
+// Point files at the buffers of an array of Uint8Array, which are only read
+static void
+bare_xdiff_get_files(js_env_t *env, js_value_t *array, mmfile_t *files) {
+  int err;
+  
+  uint32_t count;
+  err = js_get_array_length(env, array, &count);
+  assert(err == 0);
+  
+  for (uint32_t i = 0; i < count; i++) {
+    js_value_t *element;
+    err = js_get_element(env, array, i, &element);
+    assert(err == 0);
+    
+    void *data;
+    size_t len;
+    js_typedarray_type_t type;
+    js_value_t *arraybuffer;
+    size_t offset;
+    
+    err = js_get_typedarray_info(env, element, &type, &data, &len, &arraybuffer, &offset);
+    assert(err == 0);
+    assert(type == js_uint8array);
+    
+    files[i].ptr = (char*)data + offset;
+    files[i].size = (long)len;
+  }
+}
+
+// Copy a JavaScript string to a NUL-terminated buffer
+static char *
+bare_xdiff_copy_string(js_env_t *env, js_value_t *value, size_t *len) {
+  int err;
+  
+  err = js_get_value_string_utf8(env, value, NULL, 0, len);
+  assert(err == 0);
+  
+  char *result = xdl_malloc(*len + 1);
+  
+  err = js_get_value_string_utf8(env, value, (utf8_t *)result, *len + 1, NULL);
+  assert(err == 0);
+  
+  result[*len] = '\0';
+  return result;
+}
+
+// JavaScript function: diffTrees
+static js_value_t *
+bare_xdiff_diff_trees(js_env_t *env, js_callback_info_t *info) {
+  int err;
+  size_t argc = 5;
+  js_value_t *argv[5];
+  err = js_get_callback_info(env, info, &argc, argv, NULL, NULL);
+  assert(err == 0);
+  
+  if (argc != 5) {
+    return NULL;
+  }
+  
+  uv_loop_t *loop;
+  err = js_get_env_loop(env, &loop);
+  assert(err == 0);
+  
+  // Create request
+  bare_xdiff_request_t *request = calloc(1, sizeof(bare_xdiff_request_t));
+  request->env = env;
+  request->type = BARE_XDIFF_OP_DIFF_TREES;
+  request->buf1 = bare_xdiff_copy_string(env, argv[0], &request->len1);
+  request->buf2 = bare_xdiff_copy_string(env, argv[1], &request->len2);
+  
+  // Changed files are passed to onentry on the loop as they are diffed
+  bare_xdiff_tree_stream_t *stream = calloc(1, sizeof(bare_xdiff_tree_stream_t));
+  stream->env = env;
+  parse_diff_options(env, argv[2], &stream->options);
+  
+  err = uv_mutex_init(&stream->lock);
+  assert(err == 0);
+  err = uv_cond_init(&stream->drained);
+  assert(err == 0);
+  err = uv_async_init(loop, &stream->async, bare_xdiff_tree_on_async);
+  assert(err == 0);
+  stream->async.data = stream;
+  
+  js_value_t *ctx;
+  err = js_get_callback_info(env, info, NULL, NULL, &ctx, NULL);
+  assert(err == 0);
+  err = js_create_reference(env, ctx, 1, &stream->ctx);
+  assert(err == 0);
+  err = js_create_reference(env, argv[3], 1, &stream->onentry);
+  assert(err == 0);
+  
+  request->stream = stream;
+  
+  bare_xdiff_queue_request(env, info, request, argv[4], bare_xdiff_diff_trees_work);
+  
+  // The handle is only valid until the callback has been called
+  js_value_t *handle;
+  err = js_create_external(env, stream, NULL, NULL, &handle);
+  assert(err == 0);
+  
+  return handle;
+}
+
+// JavaScript function: diffTreesRead
+static js_value_t *
+bare_xdiff_diff_trees_read(js_env_t *env, js_callback_info_t *info) {
+  int err;
+  size_t argc = 2;
+  js_value_t *argv[2];
+  err = js_get_callback_info(env, info, &argc, argv, NULL, NULL);
+  assert(err == 0);
+  
+  bare_xdiff_tree_stream_t *stream;
+  err = js_get_value_external(env, argv[0], (void **)&stream);
+  assert(err == 0);
+  
+  uint32_t count;
+  err = js_get_value_uint32(env, argv[1], &count);
+  assert(err == 0);
+  
+  // Let the threads claim more files now that JavaScript has caught up
+  uv_mutex_lock(&stream->lock);
+  stream->unread = count < stream->unread ? stream->unread - count : 0;
+  uv_cond_broadcast(&stream->drained);
+  uv_mutex_unlock(&stream->lock);
+  
+  return NULL;
+}
+
+// JavaScript function: diffTreesCancel
+static js_value_t *
+bare_xdiff_diff_trees_cancel(js_env_t *env, js_callback_info_t *info) {
+  int err;
+  size_t argc = 1;
+  js_value_t *argv[1];
+  err = js_get_callback_info(env, info, &argc, argv, NULL, NULL);
+  assert(err == 0);
+  
+  bare_xdiff_tree_stream_t *stream;
+  err = js_get_value_external(env, argv[0], (void **)&stream);
+  assert(err == 0);
+  
+  // Files being diffed are finished, but no more are claimed
+  uv_mutex_lock(&stream->lock);
+  stream->cancelled = true;
+  uv_cond_broadcast(&stream->drained);
+  uv_mutex_unlock(&stream->lock);
+  
+  return NULL;
+}
+
+// JavaScript function: similarity
+static js_value_t *
+bare_xdiff_similarity_async(js_env_t *env, js_callback_info_t *info) {
+  int err;
+  size_t argc = 4;
+  js_value_t *argv[4];
+  err = js_get_callback_info(env, info, &argc, argv, NULL, NULL);
+  assert(err == 0);
+  
+  if (argc != 4) {
+    return NULL;
+  }
+  
+  uint32_t a_len, b_len;
+  err = js_get_array_length(env, argv[0], &a_len);
+  assert(err == 0);
+  err = js_get_array_length(env, argv[1], &b_len);
+  assert(err == 0);
+  
+  // Create request
+  bare_xdiff_request_t *request = calloc(1, sizeof(bare_xdiff_request_t));
+  request->env = env;
+  request->type = BARE_XDIFF_OP_SIMILARITY;
+  parse_similarity_options(env, argv[2], &request->diff_options.flags, &request->similarity_threshold);
+  
+  size_t count = (size_t)a_len + b_len;
+  request->bufs = xdl_malloc((count ? count : 1) * sizeof(void *));
+  request->lens = xdl_malloc((count ? count : 1) * sizeof(size_t));
+  
+  // Copy input data, the first set followed by the second
+  bare_xdiff_copy_buffers(env, argv[0], request);
+  request->bufs_first = request->bufs_len;
+  bare_xdiff_copy_buffers(env, argv[1], request);
+  
+  bare_xdiff_queue_request(env, info, request, argv[3], bare_xdiff_similarity_work);
+  
+  return NULL;
+}
+
+// Synchronous similarity function
+static js_value_t *
+bare_xdiff_similarity_sync(js_env_t *env, js_callback_info_t *info) {
+  int err;
+  size_t argc = 3;
+  js_value_t *argv[3];
+  err = js_get_callback_info(env, info, &argc, argv, NULL, NULL);
+  assert(err == 0);
+  
+  uint32_t flags = 0;
+  double threshold = 0.5;
+  if (argc == 3) {
+    parse_similarity_options(env, argv[2], &flags, &threshold);
+  }
+  
+  uint32_t a_len, b_len;
+  err = js_get_array_length(env, argv[0], &a_len);
+  assert(err == 0);
+  err = js_get_array_length(env, argv[1], &b_len);
+  assert(err == 0);
+  
+  size_t count = (size_t)a_len + b_len;
+  mmfile_t *files = xdl_malloc((count ? count : 1) * sizeof(mmfile_t));
+  
+  if (!files) {
+    js_throw_error(env, NULL, "Memory allocation failed");
+    return NULL;
+  }
+  
+  bare_xdiff_get_files(env, argv[0], files);
+  bare_xdiff_get_files(env, argv[1], files + a_len);
+  
+  bare_xdiff_output_t output;
+  memset(&output, 0, sizeof(output));
+  
+  int result = bare_xdiff_similarity(files, a_len, files + a_len, b_len, flags, threshold, &output);
+  xdl_free(files);
+  
+  if (result < 0) {
+    xdl_free(output.data);
+    js_throw_error(env, NULL, "Memory allocation failed");
+    return NULL;
+  }
+  
+  js_value_t *result_value;
+  err = bare_xdiff_create_matches(env, output.data, output.len, &result_value);
+  xdl_free(output.data);
+  if (err != 0) {
+    js_throw_error(env, NULL, "Failed to create result array");
+    return NULL;
+  }
+  
+  return result_value;
+}
+
+// JavaScript function: blame
+static js_value_t *
+bare_xdiff_blame_async(js_env_t *env, js_callback_info_t *info) {
+  int err;
+  size_t argc = 3;
+  js_value_t *argv[3];
+  err = js_get_callback_info(env, info, &argc, argv, NULL, NULL);
+  assert(err == 0);
+  
+  if (argc != 3) {
+    return NULL;
+  }
+  
+  uint32_t count;
+  err = js_get_array_length(env, argv[0], &count);
+  assert(err == 0);
+  
   // Create request
   bare_xdiff_request_t *request = calloc(1, sizeof(bare_xdiff_request_t));
   request->env = env;
+  request->type = BARE_XDIFF_OP_BLAME;
+  parse_diff_options(env, argv[1], &request->diff_options);
   
-  // Parse options (if provided)
-  if (options) {
-    request->diff_flags = parse_diff_options(env, options);
-  } else {
-    request->diff_flags = 0;
-  }
+  request->bufs = xdl_malloc((count ? count : 1) * sizeof(void *));
+  request->lens = xdl_malloc((count ? count : 1) * sizeof(size_t));
   
   // Copy input data
-  request->buf1 = xdl_malloc(len1);
-  request->len1 = len1;
-  memcpy(request->buf1, (char*)data1 + offset1, len1);
+  bare_xdiff_copy_buffers(env, argv[0], request);
   
-  request->buf2 = xdl_malloc(len2);
-  request->len2 = len2;
-  memcpy(request->buf2, (char*)data2 + offset2, len2);
+  bare_xdiff_queue_request(env, info, request, argv[2], bare_xdiff_blame_work);
   
-  // Store callback reference
-  err = js_create_reference(env, callback, 1, &request->callback);
+  return NULL;
+}
+
+// Synchronous blame function
+static js_value_t *
+bare_xdiff_blame_sync(js_env_t *env, js_callback_info_t *info) {
+  int err;
+  size_t argc = 2;
+  js_value_t *argv[2];
+  err = js_get_callback_info(env, info, &argc, argv, NULL, NULL);
   assert(err == 0);
   
-  // Get context
-  js_value_t *ctx;
-  err = js_get_callback_info(env, info, NULL, NULL, &ctx, NULL);
-  assert(err == 0);
+  bare_xdiff_diff_options_t diff_options;
+  memset(&diff_options, 0, sizeof(diff_options));
+  if (argc == 2) {
+    parse_diff_options(env, argv[1], &diff_options);
+    bare_xdiff_diff_options_clear(&diff_options);
+  }
   
-  err = js_create_reference(env, ctx, 1, &request->ctx);
+  uint32_t count;
+  err = js_get_array_length(env, argv[0], &count);
   assert(err == 0);
   
-  // Start teardown tracking
-  err = js_add_deferred_teardown_callback(env, NULL, NULL, &request->teardown);
-  assert(err == 0);
+  mmfile_t *revisions = xdl_malloc((count ? count : 1) * sizeof(mmfile_t));
   
-  // Queue work
-  request->request.data = request;
-  uv_loop_t *loop;
-  err = js_get_env_loop(env, &loop);
-  assert(err == 0);
-  uv_queue_work(loop, &request->request, bare_xdiff_diff_work, bare_xdiff_after);
+  if (!revisions) {
+    js_throw_error(env, NULL, "Memory allocation failed");
+    return NULL;
+  }
   
-  return NULL;
+  bare_xdiff_get_files(env, argv[0], revisions);
+  
+  bare_xdiff_blame_t job;
+  memset(&job, 0, sizeof(job));
+  job.revisions = revisions;
+  job.len = count;
+  job.flags = diff_options.flags;
+  
+  uint32_t *origins;
+  size_t origins_len;
+  int result = bare_xdiff_run_blame(&job, &origins, &origins_len);
+  xdl_free(revisions);
+  
+  if (result < 0) {
+    js_throw_error(env, NULL, "xdl_diff failed");
+    return NULL;
+  }
+  
+  js_value_t *result_value;
+  err = bare_xdiff_create_origins(env, origins, origins_len, &result_value);
+  xdl_free(origins);
+  if (err != 0) {
+    js_throw_error(env, NULL, "Failed to create result buffer");
+    return NULL;
+  }
+  
+  return result_value;
 }
 
+// Finalizer for diff session handles
+static void
+bare_xdiff_diff_session_finalize(js_env_t *env, void *data, void *finalize_hint) {
+  (void)env;
+  (void)finalize_hint;
+  
+  bare_xdiff_session_t *session = (bare_xdiff_session_t *)data;
+  
+  bare_xdiff_session_clear(session);
+  xdl_free(session);
+}
 
-// JavaScript function: merge
-static js_value_t *
-bare_xdiff_merge(js_env_t *env, js_callback_info_t *info) {
+// Get the session behind a handle, throwing if it has been destroyed
+static bare_xdiff_session_t *
+bare_xdiff_get_session(js_env_t *env, js_value_t *handle) {
   int err;
-  size_t argc = 5;
-  js_value_t *argv[5];
-  err = js_get_callback_info(env, info, &argc, argv, NULL, NULL);
+  
+  bare_xdiff_session_t *session;
+  err = js_get_value_external(env, handle, (void **)&session);
   assert(err == 0);
   
-  // Get buffer data for all three inputs
-  void *data1, *data2, *data3;
-  size_t len1, len2, len3;
-  js_typedarray_type_t type1, type2, type3;
-  js_value_t *arraybuffer1, *arraybuffer2, *arraybuffer3;
-  size_t offset1, offset2, offset3;
+  if (!session->base) {
+    js_throw_error(env, NULL, "Session destroyed");
+    return NULL;
+  }
   
-  err = js_get_typedarray_info(env, argv[0], &type1, &data1, &len1, &arraybuffer1, &offset1);
+  return session;
+}
+
+// JavaScript function: sessionCreate
+static js_value_t *
+bare_xdiff_diff_session_create(js_env_t *env, js_callback_info_t *info) {
+  int err;
+  size_t argc = 2;
+  js_value_t *argv[2];
+  err = js_get_callback_info(env, info, &argc, argv, NULL, NULL);
   assert(err == 0);
-  assert(type1 == js_uint8array);
   
-  err = js_get_typedarray_info(env, argv[1], &type2, &data2, &len2, &arraybuffer2, &offset2);
-  assert(err == 0);
-  assert(type2 == js_uint8array);
+  // Get buffer data for the base
+  void *data;
+  size_t len;
+  js_typedarray_type_t type;
+  js_value_t *arraybuffer;
+  size_t offset;
   
-  err = js_get_typedarray_info(env, argv[2], &type3, &data3, &len3, &arraybuffer3, &offset3);
+  err = js_get_typedarray_info(env, argv[0], &type, &data, &len, &arraybuffer, &offset);
   assert(err == 0);
-  assert(type3 == js_uint8array);
-  
-  // Handle optional arguments: merge(o, a, b, callback) or merge(o, a, b, options, callback)
-  js_value_t *options = NULL;
-  js_value_t *callback;
+  assert(type == js_uint8array);
   
-  if (argc == 4) {
-    // merge(o, a, b, callback)
-    callback = argv[3];
-  } else if (argc == 5) {
-    // merge(o, a, b, options, callback)
-    options = argv[3];
-    callback = argv[4];
-  } else {
-    // Invalid number of arguments
-    return NULL;
-  }
+  // Only the algorithm applies, as edits are compared byte for byte
+  bare_xdiff_diff_options_t options;
+  parse_diff_options(env, argv[1], &options);
+  bare_xdiff_diff_options_clear(&options);
   
-  // Create request
-  bare_xdiff_request_t *request = calloc(1, sizeof(bare_xdiff_request_t));
-  request->env = env;
+  bare_xdiff_session_t *session = bare_xdiff_session_create((char*)data + offset, len, options.flags & XDF_DIFF_ALGORITHM_MASK);
   
-  // Parse merge options (if provided)
-  if (options) {
-    parse_merge_options(env, options, &request->merge_level, &request->merge_favor, &request->merge_style, &request->merge_marker_size);
-  } else {
-    request->merge_level = XDL_MERGE_MINIMAL;
-    request->merge_favor = 0;
-    request->merge_style = 0;
-    request->merge_marker_size = 7;
+  if (!session) {
+    js_throw_error(env, NULL, "Memory allocation failed");
+    return NULL;
   }
   
-  // Copy input data
-  request->buf1 = xdl_malloc(len1);
-  request->len1 = len1;
-  memcpy(request->buf1, (char*)data1 + offset1, len1);
+  js_value_t *handle;
+  err = js_create_external(env, session, bare_xdiff_diff_session_finalize, NULL, &handle);
+  assert(err == 0);
   
-  request->buf2 = xdl_malloc(len2);
-  request->len2 = len2;
-  memcpy(request->buf2, (char*)data2 + offset2, len2);
+  return handle;
+}
+
+// JavaScript function: sessionEdit
+static js_value_t *
+bare_xdiff_diff_session_edit(js_env_t *env, js_callback_info_t *info) {
+  int err;
+  size_t argc = 4;
+  js_value_t *argv[4];
+  err = js_get_callback_info(env, info, &argc, argv, NULL, NULL);
+  assert(err == 0);
   
-  request->buf3 = xdl_malloc(len3);
-  request->len3 = len3;
-  memcpy(request->buf3, (char*)data3 + offset3, len3);
+  bare_xdiff_session_t *session = bare_xdiff_get_session(env, argv[0]);
+  if (!session) return NULL;
   
-  // Store callback reference
-  err = js_create_reference(env, callback, 1, &request->callback);
+  int64_t offset, delete_len;
+  err = js_get_value_int64(env, argv[1], &offset);
   assert(err == 0);
-  
-  // Get context
-  js_value_t *ctx;
-  err = js_get_callback_info(env, info, NULL, NULL, &ctx, NULL);
+  err = js_get_value_int64(env, argv[2], &delete_len);
   assert(err == 0);
   
-  err = js_create_reference(env, ctx, 1, &request->ctx);
-  assert(err == 0);
+  // Get buffer data for the inserted bytes
+  void *data;
+  size_t len;
+  js_typedarray_type_t type;
+  js_value_t *arraybuffer;
+  size_t data_offset;
   
-  // Start teardown tracking
-  err = js_add_deferred_teardown_callback(env, NULL, NULL, &request->teardown);
+  err = js_get_typedarray_info(env, argv[3], &type, &data, &len, &arraybuffer, &data_offset);
   assert(err == 0);
+  assert(type == js_uint8array);
   
-  // Queue work
-  request->request.data = request;
-  uv_loop_t *loop;
-  err = js_get_env_loop(env, &loop);
-  assert(err == 0);
-  uv_queue_work(loop, &request->request, bare_xdiff_merge_work, bare_xdiff_after);
+  if (offset < 0 || delete_len < 0 || (uint64_t)offset > session->current_len || (uint64_t)delete_len > session->current_len - offset) {
+    js_throw_error(env, NULL, "Edit out of range");
+    return NULL;
+  }
+  
+  if (bare_xdiff_session_edit(session, offset, delete_len, (char*)data + data_offset, len) < 0) {
+    js_throw_error(env, NULL, "Edit failed");
+    return NULL;
+  }
   
   return NULL;
 }
 
-// Synchronous diff function
+// JavaScript function: sessionHunks
 static js_value_t *
-bare_xdiff_diff_sync(js_env_t *env, js_callback_info_t *info) {
+bare_xdiff_diff_session_hunks(js_env_t *env, js_callback_info_t *info) {
   int err;
-  size_t argc = 3;
-  js_value_t *argv[3];
+  size_t argc = 1;
+  js_value_t *argv[1];
   err = js_get_callback_info(env, info, &argc, argv, NULL, NULL);
   assert(err == 0);
   
-  // Get buffer data for both inputs
-  void *data1, *data2;
-  size_t len1, len2;
-  js_typedarray_type_t type1, type2;
-  js_value_t *arraybuffer1, *arraybuffer2;
-  size_t offset1, offset2;
+  bare_xdiff_session_t *session = bare_xdiff_get_session(env, argv[0]);
+  if (!session) return NULL;
   
-  err = js_get_typedarray_info(env, argv[0], &type1, &data1, &len1, &arraybuffer1, &offset1);
-  assert(err == 0);
-  assert(type1 == js_uint8array);
+  bare_xdiff_change_t *changes;
+  if (bare_xdiff_session_changes(session, &changes) < 0) {
+    js_throw_error(env, NULL, "Memory allocation failed");
+    return NULL;
+  }
   
-  err = js_get_typedarray_info(env, argv[1], &type2, &data2, &len2, &arraybuffer2, &offset2);
-  assert(err == 0);
-  assert(type2 == js_uint8array);
+  // Return [aStart, aCount, bStart, bCount] for every hunk
+  js_value_t *result_buffer;
+  uint32_t *result_data;
+  err = js_create_arraybuffer(env, session->len * 4 * sizeof(uint32_t), (void **)&result_data, &result_buffer);
+  if (err != 0) {
+    xdl_free(changes);
+    js_throw_error(env, NULL, "Failed to create result buffer");
+    return NULL;
+  }
   
-  // Third argument is options (optional)
-  js_value_t *options = NULL;
-  if (argc == 3) {
-    options = argv[2];
+  for (size_t i = 0; i < session->len; i++) {
+    result_data[i * 4] = changes[i].a_start;
+    result_data[i * 4 + 1] = changes[i].a_count;
+    result_data[i * 4 + 2] = changes[i].b_start;
+    result_data[i * 4 + 3] = changes[i].b_count;
   }
   
-  // Parse options
-  uint32_t diff_flags = 0;
-  if (options) {
-    diff_flags = parse_diff_options(env, options);
+  xdl_free(changes);
+  
+  js_value_t *result_uint32;
+  err = js_create_typedarray(env, js_uint32array, session->len * 4, result_buffer, 0, &result_uint32);
+  if (err != 0) {
+    js_throw_error(env, NULL, "Failed to create result Uint32Array");
+    return NULL;
   }
   
-  // Set up mmfile structures for xdiff
-  mmfile_t mf1, mf2;
-  mf1.ptr = (char*)data1 + offset1;
-  mf1.size = (long)len1;
-  mf2.ptr = (char*)data2 + offset2;
-  mf2.size = (long)len2;
+  return result_uint32;
+}
+
+// JavaScript function: sessionPatch
+static js_value_t *
+bare_xdiff_diff_session_patch(js_env_t *env, js_callback_info_t *info) {
+  int err;
+  size_t argc = 1;
+  js_value_t *argv[1];
+  err = js_get_callback_info(env, info, &argc, argv, NULL, NULL);
+  assert(err == 0);
   
-  // Configure xdiff parameters
-  xpparam_t xpp;
-  memset(&xpp, 0, sizeof(xpp));
-  xpp.flags = diff_flags;
+  bare_xdiff_session_t *session = bare_xdiff_get_session(env, argv[0]);
+  if (!session) return NULL;
   
-  xdemitconf_t xecfg;
-  memset(&xecfg, 0, sizeof(xecfg));
-  xecfg.ctxlen = 3; // Context lines for unified diff
+  bare_xdiff_change_t *changes;
+  if (bare_xdiff_session_changes(session, &changes) < 0) {
+    js_throw_error(env, NULL, "Memory allocation failed");
+    return NULL;
+  }
   
   // Set up output handler
   bare_xdiff_output_t output;
@@ -713,184 +3644,306 @@ bare_xdiff_diff_sync(js_env_t *env, js_callback_info_t *info) {
   output.capacity = 1024;
   output.len = 0;
   
-  if (!output.data) {
+  int result = output.data ? bare_xdiff_emit_changes(session->base, session->lines, session->lines_len, changes, session->len, 3, &output) : -1;
+  
+  xdl_free(changes);
+  
+  if (result < 0) {
+    xdl_free(output.data);
     js_throw_error(env, NULL, "Memory allocation failed");
     return NULL;
   }
   
-  // Set up callback
-  xdemitcb_t ecb;
-  memset(&ecb, 0, sizeof(ecb));
-  ecb.out_line = xdiff_out_line;
-  ecb.priv = &output;
+  // Create result buffer
+  js_value_t *result_buffer;
+  void *result_data;
+  err = js_create_arraybuffer(env, output.len, &result_data, &result_buffer);
+  if (err != 0) {
+    xdl_free(output.data);
+    js_throw_error(env, NULL, "Failed to create result buffer");
+    return NULL;
+  }
+  memcpy(result_data, output.data, output.len);
+  
+  js_value_t *result_uint8;
+  err = js_create_typedarray(env, js_uint8array, output.len, result_buffer, 0, &result_uint8);
+  xdl_free(output.data);
+  if (err != 0) {
+    js_throw_error(env, NULL, "Failed to create result Uint8Array");
+    return NULL;
+  }
   
-  // Perform the diff
-  int result = xdl_diff(&mf1, &mf2, &xpp, &xecfg, &ecb);
+  return result_uint8;
+}
+
+// JavaScript function: sessionDestroy
+static js_value_t *
+bare_xdiff_diff_session_destroy(js_env_t *env, js_callback_info_t *info) {
+  int err;
+  size_t argc = 1;
+  js_value_t *argv[1];
+  err = js_get_callback_info(env, info, &argc, argv, NULL, NULL);
+  assert(err == 0);
+  
+  bare_xdiff_session_t *session;
+  err = js_get_value_external(env, argv[0], (void **)&session);
+  assert(err == 0);
+  
+  // Release the buffers now, the handle itself is freed by its finalizer
+  bare_xdiff_session_clear(session);
+  
+  return NULL;
+}
+
+// JavaScript function: configureCache
+static js_value_t *
+bare_xdiff_configure_cache(js_env_t *env, js_callback_info_t *info) {
+  int err;
+  size_t argc = 1;
+  js_value_t *argv[1];
+  bare_xdiff_cache_t *cache;
+  err = js_get_callback_info(env, info, &argc, argv, NULL, (void **)&cache);
+  assert(err == 0);
+  
+  js_value_t *prop;
+  double max_bytes;
+  
+  if (js_get_named_property(env, argv[0], "maxBytes", &prop) == 0 && js_get_value_double(env, prop, &max_bytes) == 0) {
+    if (!(max_bytes >= 0)) {
+      js_throw_error(env, NULL, "maxBytes must be a non-negative number");
+      return NULL;
+    }
+    
+    cache->max_bytes = max_bytes < (double)SIZE_MAX ? (size_t)max_bytes : SIZE_MAX;
+    bare_xdiff_cache_trim(cache);
+  }
+  
+  return NULL;
+}
+
+// JavaScript function: cacheStats
+static js_value_t *
+bare_xdiff_cache_stats(js_env_t *env, js_callback_info_t *info) {
+  int err;
+  bare_xdiff_cache_t *cache;
+  err = js_get_callback_info(env, info, NULL, NULL, NULL, (void **)&cache);
+  assert(err == 0);
+  
+  js_value_t *result;
+  err = js_create_object(env, &result);
+  assert(err == 0);
+  
+  struct {
+    const char *name;
+    double value;
+  } stats[] = {
+    {"hits", (double)cache->hits},
+    {"misses", (double)cache->misses},
+    {"evictions", (double)cache->evictions},
+    {"entries", (double)cache->entries},
+    {"bytes", (double)cache->bytes},
+    {"maxBytes", (double)cache->max_bytes},
+  };
   
-  if (result < 0) {
-    xdl_free(output.data);
-    js_throw_error(env, NULL, "xdl_diff failed");
-    return NULL;
+  for (size_t i = 0; i < sizeof(stats) / sizeof(stats[0]); i++) {
+    js_value_t *value;
+    err = js_create_double(env, stats[i].value, &value);
+    assert(err == 0);
+    err = js_set_named_property(env, result, stats[i].name, value);
+    assert(err == 0);
   }
   
-  // Create result buffer
-  js_value_t *result_buffer;
-  void *result_data;
-  err = js_create_arraybuffer(env, output.len, &result_data, &result_buffer);
-  if (err != 0) {
-    xdl_free(output.data);
-    js_throw_error(env, NULL, "Failed to create result buffer");
-    return NULL;
-  }
-  memcpy(result_data, output.data, output.len);
+  return result;
+}
+
+// Create a JavaScript array of numbers
+static int
+bare_xdiff_create_number_array(js_env_t *env, const uint64_t *values, size_t len, js_value_t **result) {
+  int err;
   
-  js_value_t *result_uint8;
-  err = js_create_typedarray(env, js_uint8array, output.len, result_buffer, 0, &result_uint8);
-  if (err != 0) {
-    xdl_free(output.data);
-    js_throw_error(env, NULL, "Failed to create result Uint8Array");
-    return NULL;
+  err = js_create_array_with_length(env, len, result);
+  if (err != 0) return err;
+  
+  for (size_t i = 0; i < len; i++) {
+    js_value_t *value;
+    err = js_create_double(env, (double)values[i], &value);
+    if (err != 0) return err;
+    err = js_set_element(env, *result, i, value);
+    if (err != 0) return err;
   }
   
-  xdl_free(output.data);
-  return result_uint8;
+  return 0;
 }
 
-// Synchronous merge function
+// JavaScript function: metrics
 static js_value_t *
-bare_xdiff_merge_sync(js_env_t *env, js_callback_info_t *info) {
+bare_xdiff_get_metrics(js_env_t *env, js_callback_info_t *info) {
+  (void)info;
+  
   int err;
-  size_t argc = 4;
-  js_value_t *argv[4];
-  err = js_get_callback_info(env, info, &argc, argv, NULL, NULL);
+  
+  js_value_t *result;
+  err = js_create_object(env, &result);
   assert(err == 0);
   
-  // Get buffer data for all three inputs
-  void *data1, *data2, *data3;
-  size_t len1, len2, len3;
-  js_typedarray_type_t type1, type2, type3;
-  js_value_t *arraybuffer1, *arraybuffer2, *arraybuffer3;
-  size_t offset1, offset2, offset3;
+  struct {
+    const char *name;
+    uint64_t *counter;
+  } counters[] = {
+    {"queued", &bare_xdiff_metrics.queued},
+    {"running", &bare_xdiff_metrics.running},
+    {"completed", &bare_xdiff_metrics.completed},
+    {"failed", &bare_xdiff_metrics.failed},
+    {"bytesCopied", &bare_xdiff_metrics.bytes_copied},
+    {"memory", &bare_xdiff_metrics.memory},
+  };
   
-  err = js_get_typedarray_info(env, argv[0], &type1, &data1, &len1, &arraybuffer1, &offset1);
+  for (size_t i = 0; i < sizeof(counters) / sizeof(counters[0]); i++) {
+    js_value_t *value;
+    err = js_create_double(env, (double)bare_xdiff_atomic_load(counters[i].counter), &value);
+    assert(err == 0);
+    err = js_set_named_property(env, result, counters[i].name, value);
+    assert(err == 0);
+  }
+  
+  // Latency histograms, one per input size bucket
+  js_value_t *latency, *sizes, *bins, *counts;
+  err = js_create_object(env, &latency);
+  assert(err == 0);
+  err = bare_xdiff_create_number_array(env, bare_xdiff_metrics_sizes, BARE_XDIFF_METRICS_SIZES - 1, &sizes);
+  assert(err == 0);
+  err = js_set_named_property(env, latency, "sizes", sizes);
+  assert(err == 0);
+  err = bare_xdiff_create_number_array(env, bare_xdiff_metrics_bins, BARE_XDIFF_METRICS_BINS - 1, &bins);
+  assert(err == 0);
+  err = js_set_named_property(env, latency, "bounds", bins);
+  assert(err == 0);
+  err = js_create_array_with_length(env, BARE_XDIFF_METRICS_SIZES, &counts);
   assert(err == 0);
-  assert(type1 == js_uint8array);
   
-  err = js_get_typedarray_info(env, argv[1], &type2, &data2, &len2, &arraybuffer2, &offset2);
+  uint64_t snapshot[BARE_XDIFF_METRICS_BINS];
+  
+  for (size_t i = 0; i < BARE_XDIFF_METRICS_SIZES; i++) {
+    for (size_t j = 0; j < BARE_XDIFF_METRICS_BINS; j++) {
+      snapshot[j] = bare_xdiff_atomic_load(&bare_xdiff_metrics.latency[i][j]);
+    }
+    
+    js_value_t *histogram;
+    err = bare_xdiff_create_number_array(env, snapshot, BARE_XDIFF_METRICS_BINS, &histogram);
+    assert(err == 0);
+    err = js_set_element(env, counts, i, histogram);
+    assert(err == 0);
+  }
+  
+  err = js_set_named_property(env, latency, "counts", counts);
+  assert(err == 0);
+  err = js_set_named_property(env, result, "latency", latency);
   assert(err == 0);
-  assert(type2 == js_uint8array);
   
-  err = js_get_typedarray_info(env, argv[2], &type3, &data3, &len3, &arraybuffer3, &offset3);
+  // Queue wait histogram
+  js_value_t *queue_wait;
+  err = js_create_object(env, &queue_wait);
+  assert(err == 0);
+  err = bare_xdiff_create_number_array(env, bare_xdiff_metrics_bins, BARE_XDIFF_METRICS_BINS - 1, &bins);
+  assert(err == 0);
+  err = js_set_named_property(env, queue_wait, "bounds", bins);
   assert(err == 0);
-  assert(type3 == js_uint8array);
   
-  // Fourth argument is options (optional)
-  js_value_t *options = NULL;
-  if (argc == 4) {
-    options = argv[3];
+  for (size_t j = 0; j < BARE_XDIFF_METRICS_BINS; j++) {
+    snapshot[j] = bare_xdiff_atomic_load(&bare_xdiff_metrics.queue_wait[j]);
   }
   
-  // Parse merge options
-  int32_t merge_level = XDL_MERGE_MINIMAL;
-  int32_t merge_favor = 0;
-  int32_t merge_style = 0;
-  int32_t merge_marker_size = 7;
+  err = bare_xdiff_create_number_array(env, snapshot, BARE_XDIFF_METRICS_BINS, &counts);
+  assert(err == 0);
+  err = js_set_named_property(env, queue_wait, "counts", counts);
+  assert(err == 0);
+  err = js_set_named_property(env, result, "queueWait", queue_wait);
+  assert(err == 0);
   
-  if (options) {
-    parse_merge_options(env, options, &merge_level, &merge_favor, &merge_style, &merge_marker_size);
-  }
+  return result;
+}
+
+// JavaScript function: cpuFeatures
+static js_value_t *
+bare_xdiff_cpu_features_report(js_env_t *env, js_callback_info_t *info) {
+  (void)info;
   
-  // Set up mmfile structures for three-way merge
-  mmfile_t ancestor, ours, theirs;
-  ancestor.ptr = (char*)data1 + offset1;
-  ancestor.size = (long)len1;
-  ours.ptr = (char*)data2 + offset2;
-  ours.size = (long)len2;
-  theirs.ptr = (char*)data3 + offset3;
-  theirs.size = (long)len3;
+  int err;
   
-  // Configure merge parameters
-  xmparam_t xmp;
-  memset(&xmp, 0, sizeof(xmp));
-  xmp.marker_size = merge_marker_size;
-  xmp.level = merge_level;
-  xmp.favor = merge_favor;
-  xmp.style = merge_style;
+  js_value_t *result;
+  err = js_create_object(env, &result);
+  assert(err == 0);
   
-  // Output buffer
-  mmbuffer_t result;
-  memset(&result, 0, sizeof(result));
+  uint32_t features = bare_xdiff_cpu_features();
   
-  // Perform the merge
-  int ret = xdl_merge(&ancestor, &ours, &theirs, &xmp, &result);
+  struct {
+    const char *name;
+    bool value;
+  } flags[] = {
+    {"avx2", features & BARE_XDIFF_CPU_AVX2},
+    {"avx512", features & BARE_XDIFF_CPU_AVX512},
+    {"neon", features & BARE_XDIFF_CPU_NEON},
+    {"forceScalar", bare_xdiff_cpu_forced_scalar()},
+  };
   
-  if (ret < 0) {
-    js_throw_error(env, NULL, "xdl_merge failed");
-    return NULL;
+  for (size_t i = 0; i < sizeof(flags) / sizeof(flags[0]); i++) {
+    js_value_t *value;
+    err = js_get_boolean(env, flags[i].value, &value);
+    assert(err == 0);
+    err = js_set_named_property(env, result, flags[i].name, value);
+    assert(err == 0);
   }
   
-  // Create result object {conflict: boolean, output: string}
-  js_value_t *result_obj;
-  err = js_create_object(env, &result_obj);
-  if (err != 0) {
-    if (result.ptr) xdl_free(result.ptr);
-    js_throw_error(env, NULL, "Failed to create result object");
-    return NULL;
-  }
+  const char *kernels;
   
-  // Add conflict property
-  js_value_t *conflict_prop;
-  bool has_conflict = ret > 0;  // ret is the number of conflicts
-  err = js_get_boolean(env, has_conflict, &conflict_prop);
-  if (err != 0) {
-    if (result.ptr) xdl_free(result.ptr);
-    js_throw_error(env, NULL, "Failed to create conflict property");
-    return NULL;
-  }
-  err = js_set_named_property(env, result_obj, "conflict", conflict_prop);
-  if (err != 0) {
-    if (result.ptr) xdl_free(result.ptr);
-    js_throw_error(env, NULL, "Failed to set conflict property");
-    return NULL;
-  }
+  switch (bare_xdiff_cpu_kernels()) {
+  case BARE_XDIFF_CPU_AVX512:
+    kernels = "avx512";
+    break;
   
-  // Add output property as buffer
-  js_value_t *output_arraybuffer, *output_prop;
-  void *output_data;
-  err = js_create_arraybuffer(env, result.size, &output_data, &output_arraybuffer);
-  if (err != 0) {
-    if (result.ptr) xdl_free(result.ptr);
-    js_throw_error(env, NULL, "Failed to create output buffer");
-    return NULL;
-  }
-  memcpy(output_data, result.ptr, result.size);
+  case BARE_XDIFF_CPU_AVX2:
+    kernels = "avx2";
+    break;
   
-  err = js_create_typedarray(env, js_uint8array, result.size, output_arraybuffer, 0, &output_prop);
-  if (err != 0) {
-    if (result.ptr) xdl_free(result.ptr);
-    js_throw_error(env, NULL, "Failed to create output Uint8Array");
-    return NULL;
-  }
-  err = js_set_named_property(env, result_obj, "output", output_prop);
-  if (err != 0) {
-    if (result.ptr) xdl_free(result.ptr);
-    js_throw_error(env, NULL, "Failed to set output property");
-    return NULL;
+  case BARE_XDIFF_CPU_NEON:
+    kernels = "neon";
+    break;
+  
+  default:
+    kernels = "scalar";
   }
   
-  if (result.ptr) xdl_free(result.ptr);
-  return result_obj;
+  js_value_t *value;
+  err = js_create_string_utf8(env, (const utf8_t *)kernels, -1, &value);
+  assert(err == 0);
+  err = js_set_named_property(env, result, "kernels", value);
+  assert(err == 0);
+  
+  return result;
 }
 
+// CPU detection runs once per process, however many environments load the
+// module
+static uv_once_t bare_xdiff_cpu_once = UV_ONCE_INIT;
 
 // Module initialization
 static js_value_t *
 init(js_env_t *env, js_value_t *exports) {
   int err;
   
+  uv_once(&bare_xdiff_cpu_once, bare_xdiff_cpu_init);
+  
+  // Result cache shared by diff and diffSync, disabled until configured
+  bare_xdiff_cache_t *cache = calloc(1, sizeof(bare_xdiff_cache_t));
+  assert(cache);
+  cache->env = env;
+  
+  err = js_add_teardown_callback(env, bare_xdiff_cache_teardown, cache);
+  assert(err == 0);
+  
   // Export diff function
   js_value_t *diff_fn;
-  err = js_create_function(env, "diff", -1, bare_xdiff_diff, NULL, &diff_fn);
+  err = js_create_function(env, "diff", -1, bare_xdiff_diff, cache, &diff_fn);
   assert(err == 0);
   err = js_set_named_property(env, exports, "diff", diff_fn);
   assert(err == 0);
@@ -905,11 +3958,25 @@ init(js_env_t *env, js_value_t *exports) {
   
   // Export diffSync function
   js_value_t *diff_sync_fn;
-  err = js_create_function(env, "diffSync", -1, bare_xdiff_diff_sync, NULL, &diff_sync_fn);
+  err = js_create_function(env, "diffSync", -1, bare_xdiff_diff_sync, cache, &diff_sync_fn);
   assert(err == 0);
   err = js_set_named_property(env, exports, "diffSync", diff_sync_fn);
   assert(err == 0);
   
+  // Export diffMany function
+  js_value_t *diff_many_fn;
+  err = js_create_function(env, "diffMany", -1, bare_xdiff_diff_many, NULL, &diff_many_fn);
+  assert(err == 0);
+  err = js_set_named_property(env, exports, "diffMany", diff_many_fn);
+  assert(err == 0);
+  
+  // Export diffManySync function
+  js_value_t *diff_many_sync_fn;
+  err = js_create_function(env, "diffManySync", -1, bare_xdiff_diff_many_sync, NULL, &diff_many_sync_fn);
+  assert(err == 0);
+  err = js_set_named_property(env, exports, "diffManySync", diff_many_sync_fn);
+  assert(err == 0);
+  
   // Export mergeSync function
   js_value_t *merge_sync_fn;
   err = js_create_function(env, "mergeSync", -1, bare_xdiff_merge_sync, NULL, &merge_sync_fn);
@@ -917,6 +3984,201 @@ init(js_env_t *env, js_value_t *exports) {
   err = js_set_named_property(env, exports, "mergeSync", merge_sync_fn);
   assert(err == 0);
   
+  // Export delta function
+  js_value_t *delta_fn;
+  err = js_create_function(env, "delta", -1, bare_xdiff_delta_async, NULL, &delta_fn);
+  assert(err == 0);
+  err = js_set_named_property(env, exports, "delta", delta_fn);
+  assert(err == 0);
+  
+  // Export deltaSync function
+  js_value_t *delta_sync_fn;
+  err = js_create_function(env, "deltaSync", -1, bare_xdiff_delta_sync, NULL, &delta_sync_fn);
+  assert(err == 0);
+  err = js_set_named_property(env, exports, "deltaSync", delta_sync_fn);
+  assert(err == 0);
+  
+  // Export applyDelta function
+  js_value_t *apply_delta_fn;
+  err = js_create_function(env, "applyDelta", -1, bare_xdiff_apply_delta_async, NULL, &apply_delta_fn);
+  assert(err == 0);
+  err = js_set_named_property(env, exports, "applyDelta", apply_delta_fn);
+  assert(err == 0);
+  
+  // Export applyDeltaSync function
+  js_value_t *apply_delta_sync_fn;
+  err = js_create_function(env, "applyDeltaSync", -1, bare_xdiff_apply_delta_sync, NULL, &apply_delta_sync_fn);
+  assert(err == 0);
+  err = js_set_named_property(env, exports, "applyDeltaSync", apply_delta_sync_fn);
+  assert(err == 0);
+  
+  // Export applyPatch function
+  js_value_t *apply_patch_fn;
+  err = js_create_function(env, "applyPatch", -1, bare_xdiff_apply_patch_async, NULL, &apply_patch_fn);
+  assert(err == 0);
+  err = js_set_named_property(env, exports, "applyPatch", apply_patch_fn);
+  assert(err == 0);
+  
+  // Export applyPatchSync function
+  js_value_t *apply_patch_sync_fn;
+  err = js_create_function(env, "applyPatchSync", -1, bare_xdiff_apply_patch_sync, NULL, &apply_patch_sync_fn);
+  assert(err == 0);
+  err = js_set_named_property(env, exports, "applyPatchSync", apply_patch_sync_fn);
+  assert(err == 0);
+  
+  // Export invertPatch function
+  js_value_t *invert_patch_fn;
+  err = js_create_function(env, "invertPatch", -1, bare_xdiff_invert_patch_async, NULL, &invert_patch_fn);
+  assert(err == 0);
+  err = js_set_named_property(env, exports, "invertPatch", invert_patch_fn);
+  assert(err == 0);
+  
+  // Export invertPatchSync function
+  js_value_t *invert_patch_sync_fn;
+  err = js_create_function(env, "invertPatchSync", -1, bare_xdiff_invert_patch_sync, NULL, &invert_patch_sync_fn);
+  assert(err == 0);
+  err = js_set_named_property(env, exports, "invertPatchSync", invert_patch_sync_fn);
+  assert(err == 0);
+  
+  // Export composePatches function
+  js_value_t *compose_patches_fn;
+  err = js_create_function(env, "composePatches", -1, bare_xdiff_compose_patches_async, NULL, &compose_patches_fn);
+  assert(err == 0);
+  err = js_set_named_property(env, exports, "composePatches", compose_patches_fn);
+  assert(err == 0);
+  
+  // Export composePatchesSync function
+  js_value_t *compose_patches_sync_fn;
+  err = js_create_function(env, "composePatchesSync", -1, bare_xdiff_compose_patches_sync, NULL, &compose_patches_sync_fn);
+  assert(err == 0);
+  err = js_set_named_property(env, exports, "composePatchesSync", compose_patches_sync_fn);
+  assert(err == 0);
+  
+  // Export diffTrees function
+  js_value_t *diff_trees_fn;
+  err = js_create_function(env, "diffTrees", -1, bare_xdiff_diff_trees, NULL, &diff_trees_fn);
+  assert(err == 0);
+  err = js_set_named_property(env, exports, "diffTrees", diff_trees_fn);
+  assert(err == 0);
+  
+  // Export diffTreesRead function
+  js_value_t *diff_trees_read_fn;
+  err = js_create_function(env, "diffTreesRead", -1, bare_xdiff_diff_trees_read, NULL, &diff_trees_read_fn);
+  assert(err == 0);
+  err = js_set_named_property(env, exports, "diffTreesRead", diff_trees_read_fn);
+  assert(err == 0);
+  
+  // Export diffTreesCancel function
+  js_value_t *diff_trees_cancel_fn;
+  err = js_create_function(env, "diffTreesCancel", -1, bare_xdiff_diff_trees_cancel, NULL, &diff_trees_cancel_fn);
+  assert(err == 0);
+  err = js_set_named_property(env, exports, "diffTreesCancel", diff_trees_cancel_fn);
+  assert(err == 0);
+  
+  // Export similarity function
+  js_value_t *similarity_fn;
+  err = js_create_function(env, "similarity", -1, bare_xdiff_similarity_async, NULL, &similarity_fn);
+  assert(err == 0);
+  err = js_set_named_property(env, exports, "similarity", similarity_fn);
+  assert(err == 0);
+  
+  // Export similaritySync function
+  js_value_t *similarity_sync_fn;
+  err = js_create_function(env, "similaritySync", -1, bare_xdiff_similarity_sync, NULL, &similarity_sync_fn);
+  assert(err == 0);
+  err = js_set_named_property(env, exports, "similaritySync", similarity_sync_fn);
+  assert(err == 0);
+  
+  // Export blame function
+  js_value_t *blame_fn;
+  err = js_create_function(env, "blame", -1, bare_xdiff_blame_async, NULL, &blame_fn);
+  assert(err == 0);
+  err = js_set_named_property(env, exports, "blame", blame_fn);
+  assert(err == 0);
+  
+  // Export blameSync function
+  js_value_t *blame_sync_fn;
+  err = js_create_function(env, "blameSync", -1, bare_xdiff_blame_sync, NULL, &blame_sync_fn);
+  assert(err == 0);
+  err = js_set_named_property(env, exports, "blameSync", blame_sync_fn);
+  assert(err == 0);
+  
+  // Export diff session functions
+  js_value_t *session_create_fn;
+  err = js_create_function(env, "sessionCreate", -1, bare_xdiff_diff_session_create, NULL, &session_create_fn);
+  assert(err == 0);
+  err = js_set_named_property(env, exports, "sessionCreate", session_create_fn);
+  assert(err == 0);
+  
+  js_value_t *session_edit_fn;
+  err = js_create_function(env, "sessionEdit", -1, bare_xdiff_diff_session_edit, NULL, &session_edit_fn);
+  assert(err == 0);
+  err = js_set_named_property(env, exports, "sessionEdit", session_edit_fn);
+  assert(err == 0);
+  
+  js_value_t *session_hunks_fn;
+  err = js_create_function(env, "sessionHunks", -1, bare_xdiff_diff_session_hunks, NULL, &session_hunks_fn);
+  assert(err == 0);
+  err = js_set_named_property(env, exports, "sessionHunks", session_hunks_fn);
+  assert(err == 0);
+  
+  js_value_t *session_patch_fn;
+  err = js_create_function(env, "sessionPatch", -1, bare_xdiff_diff_session_patch, NULL, &session_patch_fn);
+  assert(err == 0);
+  err = js_set_named_property(env, exports, "sessionPatch", session_patch_fn);
+  assert(err == 0);
+  
+  js_value_t *session_destroy_fn;
+  err = js_create_function(env, "sessionDestroy", -1, bare_xdiff_diff_session_destroy, NULL, &session_destroy_fn);
+  assert(err == 0);
+  err = js_set_named_property(env, exports, "sessionDestroy", session_destroy_fn);
+  assert(err == 0);
+  
+  // Export cache functions
+  js_value_t *configure_cache_fn;
+  err = js_create_function(env, "configureCache", -1, bare_xdiff_configure_cache, cache, &configure_cache_fn);
+  assert(err == 0);
+  err = js_set_named_property(env, exports, "configureCache", configure_cache_fn);
+  assert(err == 0);
+  
+  js_value_t *cache_stats_fn;
+  err = js_create_function(env, "cacheStats", -1, bare_xdiff_cache_stats, cache, &cache_stats_fn);
+  assert(err == 0);
+  err = js_set_named_property(env, exports, "cacheStats", cache_stats_fn);
+  assert(err == 0);
+  
+  // Export metrics function
+  js_value_t *metrics_fn;
+  err = js_create_function(env, "metrics", -1, bare_xdiff_get_metrics, NULL, &metrics_fn);
+  assert(err == 0);
+  err = js_set_named_property(env, exports, "metrics", metrics_fn);
+  assert(err == 0);
+  
+  // Export cpuFeatures function
+  js_value_t *cpu_features_fn;
+  err = js_create_function(env, "cpuFeatures", -1, bare_xdiff_cpu_features_report, NULL, &cpu_features_fn);
+  assert(err == 0);
+  err = js_set_named_property(env, exports, "cpuFeatures", cpu_features_fn);
+  assert(err == 0);
+  
+  // Export checkPatterns function
+  js_value_t *check_patterns_fn;
+  err = js_create_function(env, "checkPatterns", -1, bare_xdiff_check_patterns, NULL, &check_patterns_fn);
+  assert(err == 0);
+  err = js_set_named_property(env, exports, "checkPatterns", check_patterns_fn);
+  assert(err == 0);
+  
+  // Export whether patterns of POSIX regular expressions are supported
+  js_value_t *regex;
+#if defined(_WIN32)
+  err = js_get_boolean(env, false, &regex);
+#else
+  err = js_get_boolean(env, true, &regex);
+#endif
+  assert(err == 0);
+  err = js_set_named_property(env, exports, "regex", regex);
+  assert(err == 0);
+  
   return exports;
 }
 
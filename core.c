@@ -0,0 +1,2653 @@
+#include <assert.h>
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <regex.h>
+#include <time.h>
+#endif
+
+#include "core.h"
+#include "cpu.h"
+#include "xinclude.h"
+
+// Monotonic time in nanoseconds
+uint64_t
+bare_xdiff_hrtime(void) {
+#if defined(_WIN32)
+  LARGE_INTEGER frequency, counter;
+  QueryPerformanceFrequency(&frequency);
+  QueryPerformanceCounter(&counter);
+  return (uint64_t)((double)counter.QuadPart * 1e9 / (double)frequency.QuadPart);
+#else
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+#endif
+}
+
+// Append bytes to an output buffer, growing it if needed
+int
+bare_xdiff_output_append(bare_xdiff_output_t *output, const void *data, size_t size) {
+  if (size == 0) return 0;
+  
+  size_t new_len = output->len + size;
+  
+  // Grow buffer if needed
+  if (new_len > output->capacity) {
+    size_t new_capacity = output->capacity * 2;
+    if (new_capacity < new_len) {
+      new_capacity = new_len + 1024;
+    }
+    char *new_data = xdl_realloc(output->data, new_capacity);
+    if (!new_data) {
+      return -1;
+    }
+    output->data = new_data;
+    output->capacity = new_capacity;
+  }
+  
+  memcpy(output->data + output->len, data, size);
+  output->len = new_len;
+  
+  return 0;
+}
+
+// Append an unsigned LEB128 varint
+static int
+bare_xdiff_output_varint(bare_xdiff_output_t *output, uint64_t value) {
+  unsigned char buf[10];
+  size_t len = 0;
+  
+  do {
+    buf[len] = value & 0x7f;
+    value >>= 7;
+    if (value) buf[len] |= 0x80;
+    len++;
+  } while (value);
+  
+  return bare_xdiff_output_append(output, buf, len);
+}
+
+// Read an unsigned LEB128 varint, returning -1 on truncated or oversized input
+static int
+bare_xdiff_read_varint(const unsigned char **ptr, const unsigned char *end, uint64_t *value) {
+  uint64_t result = 0;
+  int shift = 0;
+  
+  while (*ptr < end && shift < 64) {
+    unsigned char byte = *(*ptr)++;
+    result |= (uint64_t)(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      *value = result;
+      return 0;
+    }
+    shift += 7;
+  }
+  
+  return -1;
+}
+
+// Callback for xdiff diff output
+static int
+xdiff_out_line(void *priv, mmbuffer_t *mb, int nbuf) {
+  bare_xdiff_output_t *output = (bare_xdiff_output_t *)priv;
+  
+  for (int i = 0; i < nbuf; i++) {
+    if (bare_xdiff_output_append(output, mb[i].ptr, mb[i].size) < 0) {
+      return -1;
+    }
+  }
+  
+  return 0;
+}
+
+// Append a unified hunk header, formatted the same way as xdiff does
+static int
+bare_xdiff_output_hunk_header(bare_xdiff_output_t *output, long old_start, long old_count, long new_start, long new_count, const char *func, long func_len) {
+  char header[96];
+  int len = snprintf(header, sizeof(header), "@@ -%ld", old_start);
+  
+  if (old_count != 1) len += snprintf(header + len, sizeof(header) - len, ",%ld", old_count);
+  
+  len += snprintf(header + len, sizeof(header) - len, " +%ld", new_start);
+  
+  if (new_count != 1) len += snprintf(header + len, sizeof(header) - len, ",%ld", new_count);
+  
+  len += snprintf(header + len, sizeof(header) - len, " @@");
+  
+  if (bare_xdiff_output_append(output, header, len) < 0) return -1;
+  
+  if (func_len > 0) {
+    if (bare_xdiff_output_append(output, " ", 1) < 0) return -1;
+    if (bare_xdiff_output_append(output, func, func_len) < 0) return -1;
+  }
+  
+  return bare_xdiff_output_append(output, "\n", 1);
+}
+
+// Function line of a hunk header, as long as xdiff keeps them
+typedef struct {
+  char buf[80];
+  long len;
+} bare_xdiff_func_line_t;
+
+// Emitter for diffing a slice of a file, shifting hunk headers by the
+// position of the slice. Hunks without a function line in the slice get the
+// one ahead of it, if any.
+typedef struct {
+  bare_xdiff_output_t *output;
+  long old_offset;
+  long new_offset;
+  const bare_xdiff_func_line_t *func;
+} bare_xdiff_offset_emitter_t;
+
+// Callback for xdiff hunk headers of a slice (ecb.out_hunk)
+static int
+xdiff_out_offset_hunk(void *priv, long old_begin, long old_nr, long new_begin, long new_nr, const char *func, long funclen) {
+  bare_xdiff_offset_emitter_t *emitter = (bare_xdiff_offset_emitter_t *)priv;
+  
+  if (funclen == 0 && emitter->func) {
+    func = emitter->func->buf;
+    funclen = emitter->func->len;
+  }
+  
+  return bare_xdiff_output_hunk_header(emitter->output, old_begin + emitter->old_offset, old_nr, new_begin + emitter->new_offset, new_nr, func, funclen);
+}
+
+// Callback for xdiff diff output of a slice
+static int
+xdiff_out_offset_line(void *priv, mmbuffer_t *mb, int nbuf) {
+  bare_xdiff_offset_emitter_t *emitter = (bare_xdiff_offset_emitter_t *)priv;
+  
+  return xdiff_out_line(emitter->output, mb, nbuf);
+}
+
+// Callback for xdiff changed line ranges (xecfg.hunk_func)
+static int
+xdiff_out_hunk_range(long start_a, long count_a, long start_b, long count_b, void *priv) {
+  bare_xdiff_hunks_t *hunks = (bare_xdiff_hunks_t *)priv;
+  
+  if (hunks->len == hunks->capacity) {
+    size_t new_capacity = hunks->capacity ? hunks->capacity * 2 : 64;
+    bare_xdiff_hunk_t *new_data = xdl_realloc(hunks->data, new_capacity * sizeof(bare_xdiff_hunk_t));
+    if (!new_data) {
+      return -1;
+    }
+    hunks->data = new_data;
+    hunks->capacity = new_capacity;
+  }
+  
+  bare_xdiff_hunk_t *hunk = &hunks->data[hunks->len++];
+  hunk->a_start = start_a;
+  hunk->a_count = count_a;
+  hunk->b_start = start_b;
+  hunk->b_count = count_b;
+  
+  return 0;
+}
+
+// Configure xdiff for the line options of a diff
+static void
+bare_xdiff_xpparam(const bare_xdiff_diff_options_t *options, xpparam_t *xpp) {
+  memset(xpp, 0, sizeof(xpparam_t));
+  xpp->flags = options->flags;
+  xpp->anchors = options->anchors;
+  xpp->anchors_nr = options->anchors_len;
+  xpp->ignore_regex = options->ignore_regex;
+  xpp->ignore_regex_nr = options->ignore_regex_len;
+}
+
+// Match a line against the function line patterns, setting start and len to
+// the first subexpression of the first matching pattern, or else to the whole
+// match. regexec() is given a NUL-terminated copy of the line, as not every C
+// library supports REG_STARTEND. Patterns are never parsed on Windows, which
+// has no POSIX regular expressions.
+static bool
+bare_xdiff_match_func(const bare_xdiff_diff_options_t *options, const char *line, long *start, long *len) {
+#if defined(_WIN32)
+  (void)options;
+  (void)line;
+  (void)start;
+  (void)len;
+  return false;
+#else
+  char stack[256];
+  char *copy = *len < (long)sizeof(stack) ? stack : xdl_malloc(*len + 1);
+  if (!copy) return false;
+  
+  memcpy(copy, line, *len);
+  copy[*len] = '\0';
+  
+  regmatch_t match[2];
+  bool matched = false;
+  
+  for (size_t i = 0; i < options->func_regex_len && !matched; i++) {
+    matched = regexec(options->func_regex[i], copy, 2, match, 0) == 0;
+  }
+  
+  if (copy != stack) xdl_free(copy);
+  if (!matched) return false;
+  
+  int group = match[1].rm_so >= 0 ? 1 : 0;
+  *start = match[group].rm_so;
+  *len = match[group].rm_eo - match[group].rm_so;
+  return true;
+#endif
+}
+
+// Match the function line of a hunk header (xecfg.find_func). Without
+// patterns, lines starting with an identifier match, the same as by default
+// in xdiff. With patterns, the first subexpression of the first matching
+// pattern is used, or else the whole match. Returns the length written to buf,
+// or -1 if the line does not match.
+static long
+bare_xdiff_find_func(const char *line, long len, char *buf, long size, void *priv) {
+  const bare_xdiff_diff_options_t *options = (const bare_xdiff_diff_options_t *)priv;
+  
+  while (len > 0 && line[len - 1] == '\n') len--;
+  
+  if (options->func_regex_len == 0) {
+    if (len == 0 || !(isalpha((unsigned char)line[0]) || line[0] == '_' || line[0] == '$')) return -1;
+  } else {
+    long start = 0;
+    if (!bare_xdiff_match_func(options, line, &start, &len)) return -1;
+    line += start;
+  }
+  
+  while (len > 0 && isspace((unsigned char)line[len - 1])) len--;
+  if (len > size) len = size;
+  
+  memcpy(buf, line, len);
+  return len;
+}
+
+// Find the function line closest ahead of pos in a file, for the hunks of a
+// diff of the rest of the file that have none of their own
+static void
+bare_xdiff_find_func_before(const mmfile_t *file, const char *pos, const bare_xdiff_diff_options_t *options, bare_xdiff_func_line_t *func) {
+  func->len = 0;
+  
+  while (pos > file->ptr) {
+    const char *line = pos - 1;
+    while (line > file->ptr && line[-1] != '\n') line--;
+    
+    long len = bare_xdiff_find_func(line, pos - line, func->buf, sizeof(func->buf), (void *)options);
+    
+    if (len >= 0) {
+      func->len = len;
+      return;
+    }
+    
+    pos = line;
+  }
+}
+
+// Collect the changed line ranges between two files, without context
+static int
+bare_xdiff_diff_hunks(mmfile_t *mf1, mmfile_t *mf2, xpparam_t const *xpp, bare_xdiff_hunks_t *hunks) {
+  // With no context every change is reported as its own range
+  xdemitconf_t xecfg;
+  memset(&xecfg, 0, sizeof(xecfg));
+  xecfg.hunk_func = xdiff_out_hunk_range;
+  
+  xdemitcb_t ecb;
+  memset(&ecb, 0, sizeof(ecb));
+  ecb.priv = hunks;
+  
+  return xdl_diff(mf1, mf2, xpp, &xecfg, &ecb);
+}
+
+// Collect the changed line ranges between two files, without context
+int
+bare_xdiff_collect_hunks(mmfile_t *mf1, mmfile_t *mf2, uint32_t flags, bare_xdiff_hunks_t *hunks) {
+  xpparam_t xpp;
+  memset(&xpp, 0, sizeof(xpp));
+  xpp.flags = flags;
+  
+  return bare_xdiff_diff_hunks(mf1, mf2, &xpp, hunks);
+}
+
+// Advance through a file line by line, returning the byte offset of a line
+static const char *
+bare_xdiff_seek_line(const char *ptr, const char *end, long *line, long target) {
+  while (*line < target && ptr < end) {
+    const char *eol = memchr(ptr, '\n', end - ptr);
+    ptr = eol ? eol + 1 : end;
+    (*line)++;
+  }
+  return ptr;
+}
+
+// Length of the token starting at ptr for word or char granularity
+static size_t
+bare_xdiff_token_length(const char *ptr, const char *end, int32_t granularity) {
+  unsigned char c = (unsigned char)*ptr;
+  
+  if (granularity == BARE_XDIFF_GRANULARITY_CHAR) {
+    // Keep UTF-8 sequences together so multibyte characters are never split
+    size_t len = c < 0x80 ? 1 : c >= 0xf0 ? 4 : c >= 0xe0 ? 3 : c >= 0xc0 ? 2 : 1;
+    if (len > (size_t)(end - ptr)) return 1;
+    for (size_t i = 1; i < len; i++) {
+      if (((unsigned char)ptr[i] & 0xc0) != 0x80) return 1;
+    }
+    return len;
+  }
+  
+  // Words are runs of alphanumerics, underscores and non-ASCII bytes, spaces
+  // are runs of horizontal whitespace, and everything else stands alone
+#define BARE_XDIFF_IS_WORD(c) ((c) >= 0x80 || (c) == '_' || ((c) >= '0' && (c) <= '9') || ((c | 0x20) >= 'a' && (c | 0x20) <= 'z'))
+#define BARE_XDIFF_IS_SPACE(c) ((c) == ' ' || (c) == '\t' || (c) == '\r' || (c) == '\f' || (c) == '\v')
+  
+  const char *p = ptr + 1;
+  if (BARE_XDIFF_IS_WORD(c)) {
+    while (p < end && BARE_XDIFF_IS_WORD((unsigned char)*p)) p++;
+  } else if (BARE_XDIFF_IS_SPACE(c)) {
+    while (p < end && BARE_XDIFF_IS_SPACE((unsigned char)*p)) p++;
+  }
+  
+#undef BARE_XDIFF_IS_WORD
+#undef BARE_XDIFF_IS_SPACE
+  
+  return p - ptr;
+}
+
+// Split a region into tokens, writing one token per line so xdiff can diff
+// them, and record where each token starts within the region
+static int
+bare_xdiff_tokenize(const char *ptr, size_t len, int32_t granularity, mmfile_t *tokens, uint32_t **starts, long *count) {
+  // Worst case every byte is its own token and needs a line terminator
+  tokens->ptr = xdl_malloc(len * 2);
+  *starts = xdl_malloc(len * sizeof(uint32_t));
+  *count = 0;
+  
+  if (!tokens->ptr || !*starts) {
+    xdl_free(tokens->ptr);
+    xdl_free(*starts);
+    return -1;
+  }
+  
+  char *out = tokens->ptr;
+  const char *end = ptr + len;
+  const char *p = ptr;
+  
+  while (p < end) {
+    size_t token_len = *p == '\n' ? 1 : bare_xdiff_token_length(p, end, granularity);
+    
+    (*starts)[(*count)++] = (uint32_t)(p - ptr);
+    
+    // Newlines become empty lines, everything else is written as is
+    if (*p != '\n') {
+      memcpy(out, p, token_len);
+      out += token_len;
+    }
+    *out++ = '\n';
+    
+    p += token_len;
+  }
+  
+  tokens->size = (long)(out - tokens->ptr);
+  return 0;
+}
+
+// Append a token-level edit range as four native-endian uint32 values
+static int
+bare_xdiff_append_edit(bare_xdiff_output_t *output, size_t a_offset, size_t a_length, size_t b_offset, size_t b_length) {
+  uint32_t edit[4] = { (uint32_t)a_offset, (uint32_t)a_length, (uint32_t)b_offset, (uint32_t)b_length };
+  return bare_xdiff_output_append(output, edit, sizeof(edit));
+}
+
+// Refine a pair of changed line regions into token-level edit ranges
+static int
+bare_xdiff_refine_region(const char *a, size_t a_offset, size_t a_len, const char *b, size_t b_offset, size_t b_len, const bare_xdiff_diff_options_t *options, bare_xdiff_output_t *output) {
+  // Pure insertions and deletions need no tokenization
+  if (a_len == 0 || b_len == 0) {
+    return bare_xdiff_append_edit(output, a_offset, a_len, b_offset, b_len);
+  }
+  
+  mmfile_t tokens1, tokens2;
+  uint32_t *starts1, *starts2;
+  long count1, count2;
+  
+  if (bare_xdiff_tokenize(a + a_offset, a_len, options->granularity, &tokens1, &starts1, &count1) < 0) {
+    return -1;
+  }
+  
+  if (bare_xdiff_tokenize(b + b_offset, b_len, options->granularity, &tokens2, &starts2, &count2) < 0) {
+    xdl_free(tokens1.ptr);
+    xdl_free(starts1);
+    return -1;
+  }
+  
+  // Only the algorithm carries over, whitespace flags are line oriented
+  bare_xdiff_hunks_t hunks;
+  memset(&hunks, 0, sizeof(hunks));
+  
+  int err = bare_xdiff_collect_hunks(&tokens1, &tokens2, options->flags & XDF_DIFF_ALGORITHM_MASK, &hunks);
+  
+  for (size_t i = 0; err == 0 && i < hunks.len; i++) {
+    bare_xdiff_hunk_t *hunk = &hunks.data[i];
+    
+    long a_end = hunk->a_start + hunk->a_count;
+    long b_end = hunk->b_start + hunk->b_count;
+    
+    size_t start1 = hunk->a_start < count1 ? starts1[hunk->a_start] : a_len;
+    size_t end1 = a_end < count1 ? starts1[a_end] : a_len;
+    size_t start2 = hunk->b_start < count2 ? starts2[hunk->b_start] : b_len;
+    size_t end2 = b_end < count2 ? starts2[b_end] : b_len;
+    
+    err = bare_xdiff_append_edit(output, a_offset + start1, end1 - start1, b_offset + start2, end2 - start2);
+  }
+  
+  xdl_free(hunks.data);
+  xdl_free(tokens1.ptr);
+  xdl_free(starts1);
+  xdl_free(tokens2.ptr);
+  xdl_free(starts2);
+  
+  return err;
+}
+
+// Diff lines first, then refine every changed region into token-level edits
+static int
+bare_xdiff_refine(mmfile_t *mf1, mmfile_t *mf2, const bare_xdiff_diff_options_t *options, bare_xdiff_output_t *output) {
+  // Edit ranges are reported as uint32 byte offsets
+  if ((uint64_t)mf1->size > UINT32_MAX || (uint64_t)mf2->size > UINT32_MAX) {
+    return -1;
+  }
+  
+  xpparam_t xpp;
+  bare_xdiff_xpparam(options, &xpp);
+  
+  bare_xdiff_hunks_t hunks;
+  memset(&hunks, 0, sizeof(hunks));
+  
+  int err = bare_xdiff_diff_hunks(mf1, mf2, &xpp, &hunks);
+  
+  const char *end1 = mf1->ptr + mf1->size;
+  const char *end2 = mf2->ptr + mf2->size;
+  const char *ptr1 = mf1->ptr;
+  const char *ptr2 = mf2->ptr;
+  long line1 = 0, line2 = 0;
+  
+  for (size_t i = 0; err == 0 && i < hunks.len; i++) {
+    bare_xdiff_hunk_t *hunk = &hunks.data[i];
+    
+    // Hunks arrive in order, so both files are scanned only once
+    const char *start1 = ptr1 = bare_xdiff_seek_line(ptr1, end1, &line1, hunk->a_start);
+    const char *start2 = ptr2 = bare_xdiff_seek_line(ptr2, end2, &line2, hunk->b_start);
+    
+    ptr1 = bare_xdiff_seek_line(ptr1, end1, &line1, hunk->a_start + hunk->a_count);
+    ptr2 = bare_xdiff_seek_line(ptr2, end2, &line2, hunk->b_start + hunk->b_count);
+    
+    err = bare_xdiff_refine_region(mf1->ptr, start1 - mf1->ptr, ptr1 - start1, mf2->ptr, start2 - mf2->ptr, ptr2 - start2, options, output);
+  }
+  
+  xdl_free(hunks.data);
+  
+  return err;
+}
+
+// Binary patches: the base and result sizes as varints, then varint
+// instructions (length << 2 | op) that copy or skip the next base bytes or
+// insert literal bytes. There is no context, so patches are applied in a
+// single pass over the base.
+#define BARE_XDIFF_PATCH_COPY 0
+#define BARE_XDIFF_PATCH_SKIP 1
+#define BARE_XDIFF_PATCH_INSERT 2
+
+typedef struct {
+  bare_xdiff_output_t ops;
+  size_t base_len;
+  size_t base_offset; // Base bytes consumed so far
+  size_t result_len;
+} bare_xdiff_patch_encoder_t;
+
+// Append a single binary patch instruction
+static int
+bare_xdiff_patch_op(bare_xdiff_patch_encoder_t *encoder, int op, const char *data, size_t len) {
+  if (len == 0) return 0;
+  
+  if (bare_xdiff_output_varint(&encoder->ops, ((uint64_t)len << 2) | op) < 0) return -1;
+  
+  if (op == BARE_XDIFF_PATCH_INSERT) {
+    if (bare_xdiff_output_append(&encoder->ops, data, len) < 0) return -1;
+  }
+  
+  if (op != BARE_XDIFF_PATCH_SKIP) encoder->result_len += len;
+  if (op != BARE_XDIFF_PATCH_INSERT) encoder->base_offset += len;
+  
+  return 0;
+}
+
+// Encode a byte range edit, copying the unchanged base bytes before it
+static int
+bare_xdiff_patch_edit(bare_xdiff_patch_encoder_t *encoder, size_t a_offset, size_t a_length, const char *b, size_t b_length) {
+  if (bare_xdiff_patch_op(encoder, BARE_XDIFF_PATCH_COPY, NULL, a_offset - encoder->base_offset) < 0) return -1;
+  if (bare_xdiff_patch_op(encoder, BARE_XDIFF_PATCH_SKIP, NULL, a_length) < 0) return -1;
+  if (bare_xdiff_patch_op(encoder, BARE_XDIFF_PATCH_INSERT, b, b_length) < 0) return -1;
+  return 0;
+}
+
+// Diff two files into a binary patch. Line hunks are used as is, while
+// word and char granularity encode the refined edits for smaller patches.
+static int
+bare_xdiff_diff_binary(mmfile_t *mf1, mmfile_t *mf2, const bare_xdiff_diff_options_t *options, bare_xdiff_output_t *output) {
+  bare_xdiff_patch_encoder_t encoder;
+  memset(&encoder, 0, sizeof(encoder));
+  encoder.base_len = mf1->size;
+  
+  int err = 0;
+  
+  if (options->granularity != BARE_XDIFF_GRANULARITY_LINE) {
+    bare_xdiff_output_t edits;
+    memset(&edits, 0, sizeof(edits));
+    
+    err = bare_xdiff_refine(mf1, mf2, options, &edits);
+    
+    for (size_t i = 0; err == 0 && i + 4 * sizeof(uint32_t) <= edits.len; i += 4 * sizeof(uint32_t)) {
+      uint32_t edit[4];
+      memcpy(edit, edits.data + i, sizeof(edit));
+      err = bare_xdiff_patch_edit(&encoder, edit[0], edit[1], mf2->ptr + edit[2], edit[3]);
+    }
+    
+    xdl_free(edits.data);
+  } else {
+    xpparam_t xpp;
+    bare_xdiff_xpparam(options, &xpp);
+    
+    // The patch has to rebuild mf2 exactly, so only options that place the
+    // changes apply, not those that leave changes out
+    xpp.flags &= XDF_DIFF_ALGORITHM_MASK;
+    xpp.ignore_regex = NULL;
+    xpp.ignore_regex_nr = 0;
+    
+    bare_xdiff_hunks_t hunks;
+    memset(&hunks, 0, sizeof(hunks));
+    
+    err = bare_xdiff_diff_hunks(mf1, mf2, &xpp, &hunks);
+    
+    const char *end1 = mf1->ptr + mf1->size;
+    const char *end2 = mf2->ptr + mf2->size;
+    const char *ptr1 = mf1->ptr;
+    const char *ptr2 = mf2->ptr;
+    long line1 = 0, line2 = 0;
+    
+    for (size_t i = 0; err == 0 && i < hunks.len; i++) {
+      bare_xdiff_hunk_t *hunk = &hunks.data[i];
+      
+      const char *start1 = ptr1 = bare_xdiff_seek_line(ptr1, end1, &line1, hunk->a_start);
+      const char *start2 = ptr2 = bare_xdiff_seek_line(ptr2, end2, &line2, hunk->b_start);
+      
+      ptr1 = bare_xdiff_seek_line(ptr1, end1, &line1, hunk->a_start + hunk->a_count);
+      ptr2 = bare_xdiff_seek_line(ptr2, end2, &line2, hunk->b_start + hunk->b_count);
+      
+      err = bare_xdiff_patch_edit(&encoder, start1 - mf1->ptr, ptr1 - start1, start2, ptr2 - start2);
+    }
+    
+    xdl_free(hunks.data);
+  }
+  
+  // Copy whatever is left of the base
+  if (err == 0) err = bare_xdiff_patch_op(&encoder, BARE_XDIFF_PATCH_COPY, NULL, encoder.base_len - encoder.base_offset);
+  
+  if (err == 0) err = bare_xdiff_output_varint(output, encoder.base_len);
+  if (err == 0) err = bare_xdiff_output_varint(output, encoder.result_len);
+  if (err == 0 && encoder.ops.len) err = bare_xdiff_output_append(output, encoder.ops.data, encoder.ops.len);
+  
+  xdl_free(encoder.ops.data);
+  
+  return err;
+}
+
+// Apply a binary patch to its base in a single pass
+int
+bare_xdiff_apply_patch(const char *base, size_t base_len, const char *patch, size_t patch_len, char **result, size_t *result_len) {
+  const unsigned char *ptr = (const unsigned char *)patch;
+  const unsigned char *end = ptr + patch_len;
+  uint64_t expected_len, target_len;
+  
+  if (bare_xdiff_read_varint(&ptr, end, &expected_len) < 0) return -1;
+  if (bare_xdiff_read_varint(&ptr, end, &target_len) < 0) return -1;
+  
+  // The result is at most the base plus every inserted byte
+  if (expected_len != base_len || target_len > (uint64_t)base_len + (uint64_t)(end - ptr) || (size_t)target_len != target_len) {
+    return -1;
+  }
+  
+  char *target = xdl_malloc(target_len ? target_len : 1);
+  if (!target) return -1;
+  
+  size_t pos = 0, base_offset = 0;
+  
+  while (ptr < end) {
+    uint64_t op;
+    if (bare_xdiff_read_varint(&ptr, end, &op) < 0) goto err;
+    
+    uint64_t len = op >> 2;
+    
+    switch (op & 3) {
+    case BARE_XDIFF_PATCH_COPY:
+      if (len > base_len - base_offset || len > target_len - pos) goto err;
+      memcpy(target + pos, base + base_offset, len);
+      base_offset += len;
+      pos += len;
+      break;
+    
+    case BARE_XDIFF_PATCH_SKIP:
+      if (len > base_len - base_offset) goto err;
+      base_offset += len;
+      break;
+    
+    case BARE_XDIFF_PATCH_INSERT:
+      if (len > (uint64_t)(end - ptr) || len > target_len - pos) goto err;
+      memcpy(target + pos, ptr, len);
+      ptr += len;
+      pos += len;
+      break;
+    
+    default:
+      goto err;
+    }
+  }
+  
+  if (pos != target_len || base_offset != base_len) goto err;
+  
+  *result = target;
+  *result_len = pos;
+  return 0;
+
+err:
+  xdl_free(target);
+  return -1;
+}
+
+// Find the end of the line starting at ptr, including its newline
+static const char *
+bare_xdiff_line_end(const char *ptr, const char *end) {
+  const char *newline = memchr(ptr, '\n', end - ptr);
+  return newline ? newline + 1 : end;
+}
+
+// Parse a decimal number that fits in a long
+static const char *
+bare_xdiff_parse_number(const char *ptr, const char *end, long *value) {
+  const char *digits = ptr;
+  long result = 0;
+  
+  while (ptr < end && *ptr >= '0' && *ptr <= '9') {
+    if (result > (INT32_MAX - 9) / 10) return NULL;
+    result = result * 10 + (*ptr++ - '0');
+  }
+  
+  if (ptr == digits) return NULL;
+  
+  *value = result;
+  return ptr;
+}
+
+// Parse a hunk header range of the form "start[,count]"
+static const char *
+bare_xdiff_parse_range(const char *ptr, const char *end, long *start, long *count) {
+  ptr = bare_xdiff_parse_number(ptr, end, start);
+  if (!ptr) return NULL;
+  
+  *count = 1;
+  
+  if (ptr < end && *ptr == ',') {
+    ptr = bare_xdiff_parse_number(ptr + 1, end, count);
+  }
+  
+  return ptr;
+}
+
+// Copy the lines of a change run that start with from, replacing the prefix
+// with to. "\ No newline" markers travel with the line they follow.
+static char *
+bare_xdiff_invert_run(const char *ptr, const char *end, char from, char to, char *out) {
+  char last = 0;
+  
+  while (ptr < end) {
+    const char *line_end = bare_xdiff_line_end(ptr, end);
+    
+    if (*ptr != '\\') last = *ptr;
+    
+    if (last == from) {
+      memcpy(out, ptr, line_end - ptr);
+      if (*ptr != '\\') *out = to;
+      out += line_end - ptr;
+    }
+    
+    ptr = line_end;
+  }
+  
+  return out;
+}
+
+// Invert a unified diff in a single pass, so that it turns b back into a.
+// Hunk ranges and file headers are swapped and each change run is reordered
+// so that the removed lines come first. The result has the same length.
+int
+bare_xdiff_invert_patch(const char *patch, size_t patch_len, char **result, size_t *result_len) {
+  const char *ptr = patch;
+  const char *end = patch + patch_len;
+  
+  char *inverted = xdl_malloc(patch_len ? patch_len : 1);
+  if (!inverted) return -1;
+  
+  char *out = inverted;
+  
+  // Lines left in the current hunk on each side
+  long old_left = 0, new_left = 0;
+  
+  while (ptr < end) {
+    const char *line_end = bare_xdiff_line_end(ptr, end);
+    size_t len = line_end - ptr;
+    
+    if (old_left > 0 || new_left > 0) {
+      if (*ptr == '-' || *ptr == '+') {
+        const char *run = ptr;
+        
+        while (ptr < end && (*ptr == '-' || *ptr == '+' || *ptr == '\\')) {
+          if (*ptr == '-' && old_left-- <= 0) goto err;
+          if (*ptr == '+' && new_left-- <= 0) goto err;
+          
+          ptr = bare_xdiff_line_end(ptr, end);
+          
+          // Stop at the end of the hunk, as file headers also start with - and +
+          if (old_left == 0 && new_left == 0 && (ptr == end || *ptr != '\\')) break;
+        }
+        
+        out = bare_xdiff_invert_run(run, ptr, '+', '-', out);
+        out = bare_xdiff_invert_run(run, ptr, '-', '+', out);
+        continue;
+      }
+      
+      if (*ptr == ' ' || *ptr == '\n' || *ptr == '\r') {
+        if (old_left-- <= 0 || new_left-- <= 0) goto err;
+      } else if (*ptr != '\\') {
+        goto err;
+      }
+    } else if (len >= 4 && memcmp(ptr, "@@ -", 4) == 0) {
+      long old_start, old_count, new_start, new_count;
+      
+      const char *old_range = ptr + 4;
+      const char *old_range_end = bare_xdiff_parse_range(old_range, line_end, &old_start, &old_count);
+      if (!old_range_end || line_end - old_range_end < 2 || memcmp(old_range_end, " +", 2) != 0) goto err;
+      
+      const char *new_range = old_range_end + 2;
+      const char *new_range_end = bare_xdiff_parse_range(new_range, line_end, &new_start, &new_count);
+      if (!new_range_end || line_end - new_range_end < 3 || memcmp(new_range_end, " @@", 3) != 0) goto err;
+      
+      memcpy(out, "@@ -", 4);
+      out += 4;
+      memcpy(out, new_range, new_range_end - new_range);
+      out += new_range_end - new_range;
+      memcpy(out, " +", 2);
+      out += 2;
+      memcpy(out, old_range, old_range_end - old_range);
+      out += old_range_end - old_range;
+      memcpy(out, new_range_end, line_end - new_range_end);
+      out += line_end - new_range_end;
+      
+      old_left = old_count;
+      new_left = new_count;
+      
+      ptr = line_end;
+      continue;
+    } else if (len >= 4 && memcmp(ptr, "--- ", 4) == 0 && line_end[-1] == '\n') {
+      const char *next_end = bare_xdiff_line_end(line_end, end);
+      
+      if (next_end - line_end >= 4 && memcmp(line_end, "+++ ", 4) == 0 && next_end[-1] == '\n') {
+        memcpy(out, "--- ", 4);
+        out += 4;
+        memcpy(out, line_end + 4, next_end - line_end - 4);
+        out += next_end - line_end - 4;
+        memcpy(out, "+++ ", 4);
+        out += 4;
+        memcpy(out, ptr + 4, len - 4);
+        out += len - 4;
+        
+        ptr = next_end;
+        continue;
+      }
+    }
+    
+    // Context lines, markers and anything outside of hunks are kept as is
+    memcpy(out, ptr, len);
+    out += len;
+    ptr = line_end;
+  }
+  
+  // A hunk was cut short
+  if (old_left > 0 || new_left > 0) goto err;
+  
+  assert((size_t)(out - inverted) == patch_len);
+  
+  *result = inverted;
+  *result_len = patch_len;
+  return 0;
+
+err:
+  xdl_free(inverted);
+  return -1;
+}
+
+// Append a line to a parsed patch
+static int
+bare_xdiff_patch_push_line(bare_xdiff_parsed_patch_t *patch, const char *ptr, size_t len) {
+  if (patch->lines_len == patch->lines_capacity) {
+    size_t new_capacity = patch->lines_capacity ? patch->lines_capacity * 2 : 64;
+    bare_xdiff_line_t *new_lines = xdl_realloc(patch->lines, new_capacity * sizeof(bare_xdiff_line_t));
+    if (!new_lines) {
+      return -1;
+    }
+    patch->lines = new_lines;
+    patch->lines_capacity = new_capacity;
+  }
+  
+  patch->lines[patch->lines_len].ptr = ptr;
+  patch->lines[patch->lines_len].len = len;
+  patch->lines_len++;
+  
+  return 0;
+}
+
+// Append a hunk to a parsed patch, returning NULL on allocation failure
+static bare_xdiff_patch_hunk_t *
+bare_xdiff_patch_push_hunk(bare_xdiff_parsed_patch_t *patch) {
+  if (patch->len == patch->capacity) {
+    size_t new_capacity = patch->capacity ? patch->capacity * 2 : 16;
+    bare_xdiff_patch_hunk_t *new_hunks = xdl_realloc(patch->hunks, new_capacity * sizeof(bare_xdiff_patch_hunk_t));
+    if (!new_hunks) {
+      return NULL;
+    }
+    patch->hunks = new_hunks;
+    patch->capacity = new_capacity;
+  }
+  
+  bare_xdiff_patch_hunk_t *hunk = &patch->hunks[patch->len++];
+  memset(hunk, 0, sizeof(*hunk));
+  
+  return hunk;
+}
+
+// Free the tables of a parsed patch
+static void
+bare_xdiff_patch_free(bare_xdiff_parsed_patch_t *patch) {
+  xdl_free(patch->hunks);
+  xdl_free(patch->lines);
+  memset(patch, 0, sizeof(*patch));
+}
+
+// Collect the lines of one side of a hunk body, where side is '-' or '+'
+static int
+bare_xdiff_patch_push_side(bare_xdiff_parsed_patch_t *patch, const char *ptr, const char *end, char side) {
+  bool last = false;
+  
+  while (ptr < end) {
+    const char *line_end = bare_xdiff_line_end(ptr, end);
+    
+    if (*ptr == '\\') {
+      // The previous line has no trailing newline
+      if (last) {
+        bare_xdiff_line_t *line = &patch->lines[patch->lines_len - 1];
+        if (line->len == 0 || line->ptr[line->len - 1] != '\n') return -1;
+        line->len--;
+      }
+    } else if (*ptr == '\n') {
+      if (bare_xdiff_patch_push_line(patch, ptr, 1) < 0) return -1;
+      last = true;
+    } else {
+      last = *ptr == ' ' || *ptr == side;
+      if (last && bare_xdiff_patch_push_line(patch, ptr + 1, line_end - ptr - 1) < 0) return -1;
+    }
+    
+    ptr = line_end;
+  }
+  
+  return 0;
+}
+
+// Parse a single file unified diff into hunks. Lines other than file
+// headers and hunks, such as "diff --git" and "index", are skipped.
+static int
+bare_xdiff_patch_parse(const char *patch, size_t patch_len, bare_xdiff_parsed_patch_t *result) {
+  const char *ptr = patch;
+  const char *end = patch + patch_len;
+  
+  // Difference between new and old line positions after the last hunk
+  long delta = 0;
+  long old_end = 0;
+  
+  memset(result, 0, sizeof(*result));
+  
+  while (ptr < end) {
+    const char *line_end = bare_xdiff_line_end(ptr, end);
+    size_t len = line_end - ptr;
+    
+    if (len >= 4 && memcmp(ptr, "--- ", 4) == 0) {
+      // Patches touching several files can't be composed
+      if (result->old_header.ptr || result->len) goto err;
+      result->old_header.ptr = ptr;
+      result->old_header.len = len;
+    } else if (len >= 4 && memcmp(ptr, "+++ ", 4) == 0) {
+      if (result->new_header.ptr || result->len) goto err;
+      result->new_header.ptr = ptr;
+      result->new_header.len = len;
+    } else if (len >= 4 && memcmp(ptr, "@@ -", 4) == 0) {
+      long old_start, old_count, new_start, new_count;
+      
+      const char *range = bare_xdiff_parse_range(ptr + 4, line_end, &old_start, &old_count);
+      if (!range || line_end - range < 2 || memcmp(range, " +", 2) != 0) goto err;
+      
+      range = bare_xdiff_parse_range(range + 2, line_end, &new_start, &new_count);
+      if (!range || line_end - range < 3 || memcmp(range, " @@", 3) != 0) goto err;
+      
+      // Headers of empty ranges name the line before them
+      if (old_count > 0) old_start--;
+      if (new_count > 0) new_start--;
+      
+      // Hunks must be in order and agree with the lines added before them
+      if (old_start < old_end || new_start - old_start != delta) goto err;
+      
+      // Find the end of the hunk body
+      const char *body = line_end;
+      long old_left = old_count, new_left = new_count;
+      
+      ptr = body;
+      
+      while (ptr < end && (old_left > 0 || new_left > 0 || *ptr == '\\')) {
+        if (*ptr == '-') {
+          if (old_left-- <= 0) goto err;
+        } else if (*ptr == '+') {
+          if (new_left-- <= 0) goto err;
+        } else if (*ptr == ' ' || *ptr == '\n') {
+          if (old_left-- <= 0 || new_left-- <= 0) goto err;
+        } else if (*ptr != '\\') {
+          goto err;
+        }
+        
+        ptr = bare_xdiff_line_end(ptr, end);
+      }
+      
+      if (old_left > 0 || new_left > 0) goto err;
+      
+      bare_xdiff_patch_hunk_t *hunk = bare_xdiff_patch_push_hunk(result);
+      if (!hunk) goto err;
+      
+      hunk->old_start = old_start;
+      hunk->old_count = old_count;
+      hunk->new_start = new_start;
+      hunk->new_count = new_count;
+      
+      hunk->old_lines = result->lines_len;
+      if (bare_xdiff_patch_push_side(result, body, ptr, '-') < 0) goto err;
+      
+      hunk->new_lines = result->lines_len;
+      if (bare_xdiff_patch_push_side(result, body, ptr, '+') < 0) goto err;
+      
+      delta += new_count - old_count;
+      old_end = old_start + old_count;
+      continue;
+    }
+    
+    ptr = line_end;
+  }
+  
+  return 0;
+
+err:
+  bare_xdiff_patch_free(result);
+  return -1;
+}
+
+// Check whether two lines have the same content
+static bool
+bare_xdiff_line_equal(const bare_xdiff_line_t *a, const bare_xdiff_line_t *b) {
+  return a->len == b->len && memcmp(a->ptr, b->ptr, a->len) == 0;
+}
+
+// Compose a patch from a to b with a patch from b to c into a patch from a
+// to c. Hunks are grouped into clusters whose ranges in b overlap or touch,
+// and every line of b that both patches know about must agree.
+static int
+bare_xdiff_patch_compose(const bare_xdiff_parsed_patch_t *x, const bare_xdiff_parsed_patch_t *y, bare_xdiff_parsed_patch_t *result) {
+  size_t i = 0, j = 0;
+  
+  // Difference between line positions in b and a, and in c and b
+  long x_delta = 0, y_delta = 0;
+  
+  // Known lines of b within the current cluster
+  bare_xdiff_line_t *known = NULL;
+  size_t known_capacity = 0;
+  
+  memset(result, 0, sizeof(*result));
+  result->old_header = x->old_header.ptr ? x->old_header : y->old_header;
+  result->new_header = y->new_header.ptr ? y->new_header : x->new_header;
+  
+  while (i < x->len || j < y->len) {
+    long start;
+    
+    if (j == y->len || (i < x->len && x->hunks[i].new_start <= y->hunks[j].old_start)) {
+      start = x->hunks[i].new_start;
+    } else {
+      start = y->hunks[j].old_start;
+    }
+    
+    long end = start;
+    long old_start = start - x_delta;
+    long new_start = start + y_delta;
+    size_t x_first = i, y_first = j;
+    
+    // Grow the cluster while hunks of either patch overlap or touch it
+    for (;;) {
+      if (i < x->len && x->hunks[i].new_start <= end) {
+        const bare_xdiff_patch_hunk_t *hunk = &x->hunks[i++];
+        if (hunk->new_start + hunk->new_count > end) end = hunk->new_start + hunk->new_count;
+        x_delta += hunk->new_count - hunk->old_count;
+      } else if (j < y->len && y->hunks[j].old_start <= end) {
+        const bare_xdiff_patch_hunk_t *hunk = &y->hunks[j++];
+        if (hunk->old_start + hunk->old_count > end) end = hunk->old_start + hunk->old_count;
+        y_delta += hunk->new_count - hunk->old_count;
+      } else {
+        break;
+      }
+    }
+    
+    size_t known_len = end - start;
+    
+    if (known_len > known_capacity) {
+      xdl_free(known);
+      known = xdl_malloc(known_len * sizeof(bare_xdiff_line_t));
+      if (!known) goto err;
+      known_capacity = known_len;
+    }
+    
+    if (known_len) memset(known, 0, known_len * sizeof(bare_xdiff_line_t));
+    
+    for (size_t k = x_first; k < i; k++) {
+      const bare_xdiff_patch_hunk_t *hunk = &x->hunks[k];
+      for (long l = 0; l < hunk->new_count; l++) {
+        known[hunk->new_start - start + l] = x->lines[hunk->new_lines + l];
+      }
+    }
+    
+    for (size_t k = y_first; k < j; k++) {
+      const bare_xdiff_patch_hunk_t *hunk = &y->hunks[k];
+      for (long l = 0; l < hunk->old_count; l++) {
+        bare_xdiff_line_t *line = &known[hunk->old_start - start + l];
+        const bare_xdiff_line_t *other = &y->lines[hunk->old_lines + l];
+        if (line->ptr && !bare_xdiff_line_equal(line, other)) goto err;
+        *line = *other;
+      }
+    }
+    
+    bare_xdiff_patch_hunk_t *hunk = bare_xdiff_patch_push_hunk(result);
+    if (!hunk) goto err;
+    
+    hunk->old_start = old_start;
+    hunk->new_start = new_start;
+    
+    // Lines of a: old sides of the first patch, and b where it made no change
+    hunk->old_lines = result->lines_len;
+    
+    for (long pos = start; pos < end || x_first < i;) {
+      if (x_first < i && x->hunks[x_first].new_start == pos) {
+        const bare_xdiff_patch_hunk_t *other = &x->hunks[x_first];
+        
+        for (long l = 0; l < other->old_count; l++) {
+          if (bare_xdiff_patch_push_line(result, x->lines[other->old_lines + l].ptr, x->lines[other->old_lines + l].len) < 0) goto err;
+        }
+        pos += other->new_count;
+        x_first++;
+      } else {
+        if (pos >= end || !known[pos - start].ptr) goto err;
+        if (bare_xdiff_patch_push_line(result, known[pos - start].ptr, known[pos - start].len) < 0) goto err;
+        pos++;
+      }
+    }
+    
+    // Lines of c: new sides of the second patch, and b where it made no change
+    hunk->new_lines = result->lines_len;
+    
+    for (long pos = start; pos < end || y_first < j;) {
+      if (y_first < j && y->hunks[y_first].old_start == pos) {
+        const bare_xdiff_patch_hunk_t *other = &y->hunks[y_first];
+        
+        for (long l = 0; l < other->new_count; l++) {
+          if (bare_xdiff_patch_push_line(result, y->lines[other->new_lines + l].ptr, y->lines[other->new_lines + l].len) < 0) goto err;
+        }
+        pos += other->old_count;
+        y_first++;
+      } else {
+        if (pos >= end || !known[pos - start].ptr) goto err;
+        if (bare_xdiff_patch_push_line(result, known[pos - start].ptr, known[pos - start].len) < 0) goto err;
+        pos++;
+      }
+    }
+    
+    hunk->old_count = hunk->new_lines - hunk->old_lines;
+    hunk->new_count = result->lines_len - hunk->new_lines;
+  }
+  
+  xdl_free(known);
+  return 0;
+
+err:
+  xdl_free(known);
+  bare_xdiff_patch_free(result);
+  return -1;
+}
+
+// Concatenate lines of a parsed patch into a buffer
+static int
+bare_xdiff_patch_join(const bare_xdiff_line_t *lines, long count, bare_xdiff_output_t *buffer) {
+  buffer->len = 0;
+  
+  for (long i = 0; i < count; i++) {
+    if (bare_xdiff_output_append(buffer, lines[i].ptr, lines[i].len) < 0) return -1;
+  }
+  
+  return 0;
+}
+
+// Write a parsed patch as a unified diff, diffing each hunk again so that
+// only lines that actually changed are marked and context is trimmed
+static int
+bare_xdiff_patch_emit(const bare_xdiff_parsed_patch_t *patch, bare_xdiff_output_t *output) {
+  int err = 0;
+  
+  if (patch->old_header.ptr && patch->new_header.ptr) {
+    if (bare_xdiff_output_append(output, patch->old_header.ptr, patch->old_header.len) < 0) return -1;
+    if (bare_xdiff_output_append(output, patch->new_header.ptr, patch->new_header.len) < 0) return -1;
+  }
+  
+  bare_xdiff_output_t a, b;
+  memset(&a, 0, sizeof(a));
+  memset(&b, 0, sizeof(b));
+  
+  xpparam_t xpp;
+  memset(&xpp, 0, sizeof(xpp));
+  
+  xdemitconf_t xecfg;
+  memset(&xecfg, 0, sizeof(xecfg));
+  xecfg.ctxlen = 3; // Context lines for unified diff
+  
+  bare_xdiff_offset_emitter_t emitter;
+  emitter.output = output;
+  emitter.func = NULL;
+  
+  xdemitcb_t ecb;
+  memset(&ecb, 0, sizeof(ecb));
+  ecb.out_hunk = xdiff_out_offset_hunk;
+  ecb.out_line = xdiff_out_offset_line;
+  ecb.priv = &emitter;
+  
+  for (size_t i = 0; i < patch->len && err == 0; i++) {
+    const bare_xdiff_patch_hunk_t *hunk = &patch->hunks[i];
+    
+    err = bare_xdiff_patch_join(patch->lines + hunk->old_lines, hunk->old_count, &a);
+    if (err == 0) err = bare_xdiff_patch_join(patch->lines + hunk->new_lines, hunk->new_count, &b);
+    if (err < 0) break;
+    
+    mmfile_t mf1, mf2;
+    mf1.ptr = a.data;
+    mf1.size = a.len;
+    mf2.ptr = b.data;
+    mf2.size = b.len;
+    
+    emitter.old_offset = hunk->old_start;
+    emitter.new_offset = hunk->new_start;
+    
+    err = xdl_diff(&mf1, &mf2, &xpp, &xecfg, &ecb);
+  }
+  
+  xdl_free(a.data);
+  xdl_free(b.data);
+  
+  return err;
+}
+
+// Compose a sequence of unified diffs into a single equivalent diff
+int
+bare_xdiff_compose_patches(void **patches, const size_t *lens, size_t count, bare_xdiff_output_t *output) {
+  bare_xdiff_parsed_patch_t composed, next, result;
+  
+  memset(&composed, 0, sizeof(composed));
+  
+  for (size_t i = 0; i < count; i++) {
+    if (bare_xdiff_patch_parse(patches[i], lens[i], i == 0 ? &composed : &next) < 0) {
+      bare_xdiff_patch_free(&composed);
+      return -1;
+    }
+    
+    if (i == 0) continue;
+    
+    int err = bare_xdiff_patch_compose(&composed, &next, &result);
+    
+    bare_xdiff_patch_free(&composed);
+    bare_xdiff_patch_free(&next);
+    
+    if (err < 0) return -1;
+    
+    composed = result;
+  }
+  
+  int err = bare_xdiff_patch_emit(&composed, output);
+  
+  bare_xdiff_patch_free(&composed);
+  
+  return err;
+}
+
+// Index the start of every line of a buffer, followed by the buffer length
+static int
+bare_xdiff_index_lines(const char *data, size_t len, size_t **lines, size_t *count) {
+  size_t capacity = 64, n = 0;
+  size_t *offsets = xdl_malloc(capacity * sizeof(size_t));
+  if (!offsets) return -1;
+  
+  const char *ptr = data, *end = data + len;
+  
+  while (ptr < end) {
+    if (n + 1 == capacity) {
+      size_t *new_offsets = xdl_realloc(offsets, capacity * 2 * sizeof(size_t));
+      if (!new_offsets) {
+        xdl_free(offsets);
+        return -1;
+      }
+      offsets = new_offsets;
+      capacity *= 2;
+    }
+    
+    offsets[n++] = ptr - data;
+    ptr = bare_xdiff_line_end(ptr, end);
+  }
+  
+  offsets[n] = len;
+  
+  *lines = offsets;
+  *count = n;
+  return 0;
+}
+
+static const char bare_xdiff_no_newline[] = "\n\\ No newline at end of file\n";
+
+// Append one line of a unified diff, marking a missing trailing newline the
+// same way as xdiff
+static int
+bare_xdiff_output_line(bare_xdiff_output_t *output, char prefix, const char *ptr, size_t len) {
+  if (bare_xdiff_output_append(output, &prefix, 1) < 0) return -1;
+  if (bare_xdiff_output_append(output, ptr, len) < 0) return -1;
+  
+  if (len == 0 || ptr[len - 1] != '\n') {
+    return bare_xdiff_output_append(output, bare_xdiff_no_newline, sizeof(bare_xdiff_no_newline) - 1);
+  }
+  
+  return 0;
+}
+
+// Write changes as a unified diff with ctxlen lines of context, grouping
+// changes into hunks the same way as xdiff
+int
+bare_xdiff_emit_changes(const char *a, const size_t *a_lines, long a_count, const bare_xdiff_change_t *changes, size_t count, long ctxlen, bare_xdiff_output_t *output) {
+  size_t i = 0;
+  
+  while (i < count) {
+    // Changes whose context would overlap share a hunk
+    size_t j = i;
+    while (j + 1 < count && changes[j + 1].a_start - (changes[j].a_start + changes[j].a_count) <= 2 * ctxlen) j++;
+    
+    const bare_xdiff_change_t *first = &changes[i];
+    const bare_xdiff_change_t *last = &changes[j];
+    
+    long a_start = first->a_start - ctxlen;
+    if (a_start < 0) a_start = 0;
+    
+    long a_end = last->a_start + last->a_count + ctxlen;
+    if (a_end > a_count) a_end = a_count;
+    
+    long b_start = first->b_start - (first->a_start - a_start);
+    long b_end = last->b_start + last->b_count + (a_end - (last->a_start + last->a_count));
+    
+    long old_count = a_end - a_start;
+    long new_count = b_end - b_start;
+    
+    if (bare_xdiff_output_hunk_header(output, old_count ? a_start + 1 : a_start, old_count, new_count ? b_start + 1 : b_start, new_count, NULL, 0) < 0) return -1;
+    
+    long line = a_start;
+    
+    for (size_t k = i; k <= j; k++) {
+      const bare_xdiff_change_t *change = &changes[k];
+      
+      for (; line < change->a_start + change->a_count; line++) {
+        char prefix = line < change->a_start ? ' ' : '-';
+        if (bare_xdiff_output_line(output, prefix, a + a_lines[line], a_lines[line + 1] - a_lines[line]) < 0) return -1;
+      }
+      
+      const char *ptr = change->b_data, *end = change->b_data + change->b_len;
+      
+      while (ptr < end) {
+        const char *line_end = bare_xdiff_line_end(ptr, end);
+        if (bare_xdiff_output_line(output, '+', ptr, line_end - ptr) < 0) return -1;
+        ptr = line_end;
+      }
+    }
+    
+    for (; line < a_end; line++) {
+      if (bare_xdiff_output_line(output, ' ', a + a_lines[line], a_lines[line + 1] - a_lines[line]) < 0) return -1;
+    }
+    
+    i = j + 1;
+  }
+  
+  return 0;
+}
+
+// Create a diff session over a copy of base
+bare_xdiff_session_t *
+bare_xdiff_session_create(const char *base, size_t base_len, uint32_t flags) {
+  bare_xdiff_session_t *session = xdl_malloc(sizeof(bare_xdiff_session_t));
+  if (!session) return NULL;
+  
+  memset(session, 0, sizeof(*session));
+  
+  session->base = xdl_malloc(base_len ? base_len : 1);
+  if (!session->base) goto err;
+  
+  memcpy(session->base, base, base_len);
+  session->base_len = base_len;
+  session->current_len = base_len;
+  session->flags = flags;
+  
+  if (bare_xdiff_index_lines(session->base, base_len, &session->lines, &session->lines_len) < 0) goto err;
+  
+  return session;
+
+err:
+  xdl_free(session->base);
+  xdl_free(session);
+  return NULL;
+}
+
+// Free the buffers of a diff session, leaving the session itself
+void
+bare_xdiff_session_clear(bare_xdiff_session_t *session) {
+  for (size_t i = 0; i < session->len; i++) xdl_free(session->hunks[i].data);
+  
+  xdl_free(session->hunks);
+  xdl_free(session->lines);
+  xdl_free(session->base);
+  
+  memset(session, 0, sizeof(*session));
+}
+
+// Find the base line containing a base offset. The end of the base belongs
+// to its last line unless that line is terminated.
+static size_t
+bare_xdiff_session_line_at(const bare_xdiff_session_t *session, size_t offset) {
+  size_t low = 0, high = session->lines_len;
+  
+  while (low < high) {
+    size_t mid = low + (high - low + 1) / 2;
+    if (session->lines[mid] <= offset) low = mid;
+    else high = mid - 1;
+  }
+  
+  if (low == session->lines_len && low > 0 && session->base[session->base_len - 1] != '\n') low--;
+  
+  return low;
+}
+
+// Difference in length between a session hunk and the base lines it replaces
+static int64_t
+bare_xdiff_session_hunk_delta(const bare_xdiff_session_t *session, const bare_xdiff_session_hunk_t *hunk) {
+  return (int64_t)hunk->len - (int64_t)(session->lines[hunk->end] - session->lines[hunk->start]);
+}
+
+// Apply an edit to the current document of a session and diff the affected
+// lines against the base again. The region that is diffed again extends to
+// the nearest lines that are unchanged, so hunks outside of it are kept.
+int
+bare_xdiff_session_edit(bare_xdiff_session_t *session, size_t offset, size_t delete_len, const char *insert, size_t insert_len) {
+  bare_xdiff_session_hunk_t *hunks = session->hunks;
+  const size_t *lines = session->lines;
+  
+  if (offset > session->current_len || delete_len > session->current_len - offset) return -1;
+  
+  size_t edit_end = offset + delete_len;
+  
+  // Find the first base line and hunk of the window
+  int64_t shift = 0, window_shift = 0;
+  size_t k = 0, first_hunk, first_line;
+  
+  for (;;) {
+    if (k == session->len || (int64_t)offset < (int64_t)lines[hunks[k].start] + shift) {
+      size_t line = bare_xdiff_session_line_at(session, offset - shift);
+      
+      // Merge with a hunk that ends right before the edited line
+      if (k > 0 && hunks[k - 1].end == line) {
+        first_hunk = k - 1;
+        first_line = hunks[k - 1].start;
+        window_shift = shift - bare_xdiff_session_hunk_delta(session, &hunks[k - 1]);
+      } else {
+        first_hunk = k;
+        first_line = line;
+        window_shift = shift;
+      }
+      break;
+    }
+    
+    if ((int64_t)offset <= (int64_t)lines[hunks[k].start] + shift + (int64_t)hunks[k].len) {
+      first_hunk = k;
+      first_line = hunks[k].start;
+      window_shift = shift;
+      break;
+    }
+    
+    shift += bare_xdiff_session_hunk_delta(session, &hunks[k++]);
+  }
+  
+  // Find the end base line and hunk of the window
+  size_t last_hunk, last_line;
+  
+  k = first_hunk;
+  shift = window_shift;
+  
+  for (;;) {
+    if (k == session->len || (int64_t)edit_end < (int64_t)lines[hunks[k].start] + shift) {
+      size_t line = bare_xdiff_session_line_at(session, edit_end - shift);
+      last_hunk = k;
+      last_line = line < session->lines_len ? line + 1 : session->lines_len;
+      break;
+    }
+    
+    int64_t hunk_end = (int64_t)lines[hunks[k].start] + shift + (int64_t)hunks[k].len;
+    
+    if ((int64_t)edit_end <= hunk_end) {
+      last_hunk = k + 1;
+      last_line = hunks[k].end;
+      
+      // An edit at the end of a hunk touches the line after it
+      if ((int64_t)edit_end == hunk_end && last_line < session->lines_len) last_line++;
+      break;
+    }
+    
+    shift += bare_xdiff_session_hunk_delta(session, &hunks[k++]);
+  }
+  
+  // Merge with hunks that start right after the window
+  while (last_hunk < session->len && hunks[last_hunk].start <= last_line) {
+    if (hunks[last_hunk].end > last_line) last_line = hunks[last_hunk].end;
+    last_hunk++;
+  }
+  
+  // Materialize the current lines of the window and apply the edit
+  size_t window_start = (size_t)((int64_t)lines[first_line] + window_shift);
+  size_t window_len = lines[last_line] - lines[first_line];
+  
+  for (k = first_hunk; k < last_hunk; k++) {
+    window_len += bare_xdiff_session_hunk_delta(session, &hunks[k]);
+  }
+  
+  assert(window_start <= offset && edit_end <= window_start + window_len);
+  
+  size_t edited_len = window_len - delete_len + insert_len;
+  char *window = xdl_malloc(edited_len > window_len ? edited_len : window_len ? window_len : 1);
+  if (!window) return -1;
+  
+  char *ptr = window;
+  size_t line = first_line;
+  
+  for (k = first_hunk; k < last_hunk; k++) {
+    memcpy(ptr, session->base + lines[line], lines[hunks[k].start] - lines[line]);
+    ptr += lines[hunks[k].start] - lines[line];
+    memcpy(ptr, hunks[k].data, hunks[k].len);
+    ptr += hunks[k].len;
+    line = hunks[k].end;
+  }
+  
+  memcpy(ptr, session->base + lines[line], lines[last_line] - lines[line]);
+  
+  size_t edit_start = offset - window_start;
+  memmove(window + edit_start + insert_len, window + edit_start + delete_len, window_len - edit_start - delete_len);
+  memcpy(window + edit_start, insert, insert_len);
+  
+  // Diff the window against the same lines of the base
+  mmfile_t mf1, mf2;
+  mf1.ptr = session->base + lines[first_line];
+  mf1.size = lines[last_line] - lines[first_line];
+  mf2.ptr = window;
+  mf2.size = edited_len;
+  
+  bare_xdiff_hunks_t changes;
+  memset(&changes, 0, sizeof(changes));
+  
+  size_t *window_lines = NULL, window_lines_len;
+  
+  int err = bare_xdiff_collect_hunks(&mf1, &mf2, session->flags, &changes);
+  if (err == 0) err = bare_xdiff_index_lines(window, edited_len, &window_lines, &window_lines_len);
+  
+  // Make room for the new hunks in place of the old ones
+  size_t removed = last_hunk - first_hunk;
+  size_t new_len = session->len - removed + changes.len;
+  
+  if (err == 0 && new_len > session->capacity) {
+    size_t new_capacity = session->capacity ? session->capacity * 2 : 16;
+    if (new_capacity < new_len) new_capacity = new_len;
+    
+    bare_xdiff_session_hunk_t *new_hunks = xdl_realloc(session->hunks, new_capacity * sizeof(bare_xdiff_session_hunk_t));
+    if (new_hunks) {
+      session->hunks = hunks = new_hunks;
+      session->capacity = new_capacity;
+    } else {
+      err = -1;
+    }
+  }
+  
+  // Copy the changed lines out of the window
+  bare_xdiff_session_hunk_t *added = NULL;
+  
+  if (err == 0 && changes.len) {
+    added = xdl_malloc(changes.len * sizeof(bare_xdiff_session_hunk_t));
+    if (!added) err = -1;
+  }
+  
+  size_t copied = 0;
+  
+  for (; err == 0 && copied < changes.len; copied++) {
+    const bare_xdiff_hunk_t *change = &changes.data[copied];
+    bare_xdiff_session_hunk_t *hunk = &added[copied];
+    
+    hunk->start = first_line + change->a_start;
+    hunk->end = hunk->start + change->a_count;
+    hunk->len = window_lines[change->b_start + change->b_count] - window_lines[change->b_start];
+    hunk->lines = change->b_count;
+    hunk->data = xdl_malloc(hunk->len ? hunk->len : 1);
+    
+    if (!hunk->data) {
+      err = -1;
+      break;
+    }
+    
+    memcpy(hunk->data, window + window_lines[change->b_start], hunk->len);
+  }
+  
+  if (err == 0) {
+    for (k = first_hunk; k < last_hunk; k++) xdl_free(hunks[k].data);
+    
+    if (last_hunk < session->len) {
+      memmove(&hunks[first_hunk + changes.len], &hunks[last_hunk], (session->len - last_hunk) * sizeof(bare_xdiff_session_hunk_t));
+    }
+    if (changes.len) memcpy(&hunks[first_hunk], added, changes.len * sizeof(bare_xdiff_session_hunk_t));
+    
+    session->len = new_len;
+    session->current_len = session->current_len - delete_len + insert_len;
+  } else {
+    for (size_t i = 0; i < copied; i++) xdl_free(added[i].data);
+  }
+  
+  xdl_free(added);
+  xdl_free(window_lines);
+  xdl_free(changes.data);
+  xdl_free(window);
+  
+  return err;
+}
+
+// Collect the hunks of a session as changes against the base
+int
+bare_xdiff_session_changes(const bare_xdiff_session_t *session, bare_xdiff_change_t **result) {
+  bare_xdiff_change_t *changes = xdl_malloc((session->len ? session->len : 1) * sizeof(bare_xdiff_change_t));
+  if (!changes) return -1;
+  
+  long delta = 0;
+  
+  for (size_t i = 0; i < session->len; i++) {
+    const bare_xdiff_session_hunk_t *hunk = &session->hunks[i];
+    bare_xdiff_change_t *change = &changes[i];
+    
+    change->a_start = hunk->start;
+    change->a_count = hunk->end - hunk->start;
+    change->b_start = hunk->start + delta;
+    change->b_count = hunk->lines;
+    change->b_data = hunk->data;
+    change->b_len = hunk->len;
+    
+    delta += change->b_count - change->a_count;
+  }
+  
+  *result = changes;
+  return 0;
+}
+
+#define BARE_XDIFF_PRIME64_1 0x9e3779b185ebca87ULL
+#define BARE_XDIFF_PRIME64_2 0xc2b2ae3d27d4eb4fULL
+#define BARE_XDIFF_PRIME64_3 0x165667b19e3779f9ULL
+#define BARE_XDIFF_PRIME64_4 0x85ebca77c2b2ae63ULL
+#define BARE_XDIFF_PRIME64_5 0x27d4eb2f165667c5ULL
+
+static inline uint64_t
+bare_xdiff_read64(const unsigned char *ptr) {
+  uint64_t value;
+  memcpy(&value, ptr, sizeof(value));
+  return value;
+}
+
+static inline uint64_t
+bare_xdiff_hash_round(uint64_t acc, uint64_t input) {
+  acc += input * BARE_XDIFF_PRIME64_2;
+  acc = bare_xdiff_rotl64(acc, 31);
+  return acc * BARE_XDIFF_PRIME64_1;
+}
+
+static inline uint64_t
+bare_xdiff_hash_merge(uint64_t acc, uint64_t lane) {
+  acc ^= bare_xdiff_hash_round(0, lane);
+  return acc * BARE_XDIFF_PRIME64_1 + BARE_XDIFF_PRIME64_4;
+}
+
+// Fast 64-bit hash of a buffer, processing four 8 byte lanes at a time
+// following XXH64
+uint64_t
+bare_xdiff_hash64(const void *data, size_t len, uint64_t seed) {
+  const unsigned char *ptr = data;
+  const unsigned char *end = ptr + len;
+  uint64_t hash;
+  
+  if (len >= 32) {
+    uint64_t v1 = seed + BARE_XDIFF_PRIME64_1 + BARE_XDIFF_PRIME64_2;
+    uint64_t v2 = seed + BARE_XDIFF_PRIME64_2;
+    uint64_t v3 = seed;
+    uint64_t v4 = seed - BARE_XDIFF_PRIME64_1;
+    
+    do {
+      v1 = bare_xdiff_hash_round(v1, bare_xdiff_read64(ptr));
+      v2 = bare_xdiff_hash_round(v2, bare_xdiff_read64(ptr + 8));
+      v3 = bare_xdiff_hash_round(v3, bare_xdiff_read64(ptr + 16));
+      v4 = bare_xdiff_hash_round(v4, bare_xdiff_read64(ptr + 24));
+      ptr += 32;
+    } while (end - ptr >= 32);
+    
+    hash = bare_xdiff_rotl64(v1, 1) + bare_xdiff_rotl64(v2, 7) + bare_xdiff_rotl64(v3, 12) + bare_xdiff_rotl64(v4, 18);
+    hash = bare_xdiff_hash_merge(hash, v1);
+    hash = bare_xdiff_hash_merge(hash, v2);
+    hash = bare_xdiff_hash_merge(hash, v3);
+    hash = bare_xdiff_hash_merge(hash, v4);
+  } else {
+    hash = seed + BARE_XDIFF_PRIME64_5;
+  }
+  
+  hash += len;
+  
+  for (; end - ptr >= 8; ptr += 8) {
+    hash ^= bare_xdiff_hash_round(0, bare_xdiff_read64(ptr));
+    hash = bare_xdiff_rotl64(hash, 27) * BARE_XDIFF_PRIME64_1 + BARE_XDIFF_PRIME64_4;
+  }
+  
+  for (; ptr < end; ptr++) {
+    hash ^= *ptr * BARE_XDIFF_PRIME64_5;
+    hash = bare_xdiff_rotl64(hash, 11) * BARE_XDIFF_PRIME64_1;
+  }
+  
+  hash ^= hash >> 33;
+  hash *= BARE_XDIFF_PRIME64_2;
+  hash ^= hash >> 29;
+  hash *= BARE_XDIFF_PRIME64_3;
+  hash ^= hash >> 32;
+  
+  return hash;
+}
+
+// Estimated native memory of preparing and searching one line: its record,
+// hash, change and index entries, a classifier bucket and its share of the
+// Myers k-vectors
+#define BARE_XDIFF_MEMORY_PER_LINE 96
+
+// Estimated native memory of one record class in the xdiff classifier
+#define BARE_XDIFF_MEMORY_PER_CLASS 56
+
+// Estimate the native memory xdiff uses for the given lines and classes
+uint64_t
+bare_xdiff_estimate_memory(uint64_t lines, uint64_t classes) {
+  return lines * BARE_XDIFF_MEMORY_PER_LINE + classes * BARE_XDIFF_MEMORY_PER_CLASS;
+}
+
+// Count the lines of a buffer, including a last line without a newline
+static uint64_t
+bare_xdiff_line_count(const char *ptr, const char *end) {
+  if (ptr == end) return 0;
+  
+  return bare_xdiff_count_newlines(ptr, end - ptr) + (end[-1] != '\n');
+}
+
+// Count the lines of each file and the distinct lines across all of them,
+// which are the record classes xdiff creates when no whitespace flags are set
+static int
+bare_xdiff_count_lines(const mmfile_t *files, size_t count, bare_xdiff_stats_t *stats) {
+  size_t total = 0;
+  
+  for (size_t i = 0; i < count; i++) {
+    stats->lines[i] = bare_xdiff_line_count(files[i].ptr, files[i].ptr + files[i].size);
+    total += stats->lines[i];
+  }
+  
+  // Open addressing table of line hashes, kept at most half full
+  size_t capacity = 16;
+  while (capacity < total * 2) capacity *= 2;
+  
+  uint64_t *table = xdl_malloc(capacity * sizeof(uint64_t));
+  if (!table) return -1;
+  memset(table, 0, capacity * sizeof(uint64_t));
+  
+  stats->classes = 0;
+  
+  for (size_t i = 0; i < count; i++) {
+    const char *ptr = files[i].ptr, *end = ptr + files[i].size;
+    
+    while (ptr < end) {
+      const char *next = bare_xdiff_line_end(ptr, end);
+      uint64_t hash = bare_xdiff_hash64(ptr, next - ptr, 0);
+      if (hash == 0) hash = 1;  // 0 marks an empty slot
+      
+      size_t slot = hash & (capacity - 1);
+      while (table[slot] && table[slot] != hash) slot = (slot + 1) & (capacity - 1);
+      
+      if (!table[slot]) {
+        table[slot] = hash;
+        stats->classes++;
+      }
+      
+      ptr = next;
+    }
+  }
+  
+  xdl_free(table);
+  return 0;
+}
+
+// Estimate the memory xdiff needs to diff two files, assuming that every line
+// is distinct. This is an upper bound that takes no allocation to compute.
+static uint64_t
+bare_xdiff_estimate_diff(const mmfile_t *mf1, const mmfile_t *mf2) {
+  uint64_t lines = bare_xdiff_line_count(mf1->ptr, mf1->ptr + mf1->size) + bare_xdiff_line_count(mf2->ptr, mf2->ptr + mf2->size);
+  
+  return bare_xdiff_estimate_memory(lines, lines);
+}
+
+// Whether a line matches any line of a file, compared the same way as by
+// xdiff with the given flags
+static bool
+bare_xdiff_line_occurs(const char *line, const char *line_end, const mmfile_t *file, uint32_t flags) {
+  const char *ptr = line;
+  unsigned long hash = xdl_hash_record(&ptr, line_end, flags);
+  
+  ptr = file->ptr;
+  const char *end = ptr + file->size;
+  
+  while (ptr < end) {
+    const char *start = ptr;
+    
+    if (xdl_hash_record(&ptr, end, flags) == hash && xdl_recmatch(start, ptr - start, line, line_end - line, flags)) {
+      return true;
+    }
+  }
+  
+  return false;
+}
+
+// Most lines kept next to the common ends of a pair of files because they
+// also occur between them
+#define BARE_XDIFF_TRIM_MAX_KEPT 32
+
+// Leave out the lines both files start and end with, apart from the ctxlen
+// lines of context next to the first and last change. xdiff would skip those
+// lines as well, but only after hashing and indexing all of them. As in
+// xdiff, the common end is only searched for after the whole common start.
+// Changes are slid along equal lines after the search, which could carry
+// them past the left out lines, so the lines next to the ends are kept as
+// long as they occur between them. If that takes too many lines, nothing is
+// left out. The hunks of the middle can still differ from those of the whole
+// files, as xdiff sets aside lines that repeat often relative to the number
+// of lines it is given. Returns the number of lines left out at the start.
+static long
+bare_xdiff_trim_ends(mmfile_t *mf1, mmfile_t *mf2, long ctxlen, uint32_t flags) {
+  const char *a = mf1->ptr, *b = mf2->ptr;
+  size_t len1 = mf1->size, len2 = mf2->size;
+  size_t min = len1 < len2 ? len1 : len2;
+  
+  // Common prefix, rounded down to the start of a line
+  size_t prefix = bare_xdiff_common_prefix(a, b, min);
+  while (prefix > 0 && a[prefix - 1] != '\n') prefix--;
+  
+  // Common suffix after the prefix, rounded up to the start of a line in both
+  // files
+  size_t suffix = bare_xdiff_common_suffix(a + len1, b + len2, min - prefix);
+  
+  while (suffix > 0) {
+    size_t start1 = len1 - suffix, start2 = len2 - suffix;
+    if ((start1 == 0 || a[start1 - 1] == '\n') && (start2 == 0 || b[start2 - 1] == '\n')) break;
+    suffix--;
+  }
+  
+  for (int kept = 0; prefix > 0 || suffix > 0; kept++) {
+    mmfile_t middle1 = {(char *)a + prefix, (long)(len1 - prefix - suffix)};
+    mmfile_t middle2 = {(char *)b + prefix, (long)(len2 - prefix - suffix)};
+    
+    const char *line = a + prefix, *line_end = a + prefix;
+    
+    if (prefix > 0) {
+      line--;
+      while (line > a && line[-1] != '\n') line--;
+    }
+    
+    if (line == line_end || !(bare_xdiff_line_occurs(line, line_end, &middle1, flags) || bare_xdiff_line_occurs(line, line_end, &middle2, flags))) {
+      if (suffix == 0) break;
+      
+      line = a + len1 - suffix;
+      line_end = bare_xdiff_line_end(line, a + len1);
+      
+      if (!(bare_xdiff_line_occurs(line, line_end, &middle1, flags) || bare_xdiff_line_occurs(line, line_end, &middle2, flags))) break;
+    }
+    
+    if (kept == BARE_XDIFF_TRIM_MAX_KEPT) return 0;
+    
+    if (line < a + prefix) {
+      prefix = line - a;
+    } else {
+      suffix -= line_end - line;
+    }
+  }
+  
+  // Keep the context lines
+  for (long i = 0; i < ctxlen && prefix > 0; i++) {
+    prefix--;
+    while (prefix > 0 && a[prefix - 1] != '\n') prefix--;
+  }
+  
+  for (long i = 0; i < ctxlen && suffix > 0; i++) {
+    const char *start = a + len1 - suffix;
+    suffix -= bare_xdiff_line_end(start, a + len1) - start;
+  }
+  
+  mf1->ptr += prefix;
+  mf1->size -= prefix + suffix;
+  mf2->ptr += prefix;
+  mf2->size -= prefix + suffix;
+  
+  return (long)bare_xdiff_line_count(a, a + prefix);
+}
+
+// Fit a diff into max_memory by leaving out the lines both files start and
+// end with. Returns the number of lines left out at the start, or
+// BARE_XDIFF_ERROR_MEMORY if the rest still does not fit.
+static long
+bare_xdiff_fit_memory(mmfile_t *mf1, mmfile_t *mf2, long ctxlen, uint32_t flags, uint64_t max_memory) {
+  if (bare_xdiff_estimate_diff(mf1, mf2) <= max_memory) return 0;
+  
+  long offset = bare_xdiff_trim_ends(mf1, mf2, ctxlen, flags);
+  
+  if (bare_xdiff_estimate_diff(mf1, mf2) > max_memory) return BARE_XDIFF_ERROR_MEMORY;
+  
+  return offset;
+}
+
+// Time the preparation of a pair of files on its own, counting the lines
+// of each and the record classes xdiff sorts them into. xdl_diff() does not
+// report when it moves on from preparing to searching, so the stats option
+// prepares the files once more up front and subtracts this time.
+static int
+bare_xdiff_time_prepare(mmfile_t *mf1, mmfile_t *mf2, xpparam_t const *xpp, uint64_t *elapsed, uint64_t lines[2], uint64_t *classes) {
+  uint64_t start = bare_xdiff_hrtime();
+  
+  xdfenv_t xe;
+  if (xdl_prepare_env(mf1, mf2, xpp, &xe) < 0) return -1;
+  
+  *elapsed += bare_xdiff_hrtime() - start;
+  
+  // Preparing replaces the hash of every record with the index of its class
+  xdfile_t *xdf[2] = {&xe.xdf1, &xe.xdf2};
+  unsigned long count = 0;
+  
+  for (int i = 0; i < 2; i++) {
+    lines[i] = xdf[i]->nrec;
+    
+    for (long j = 0; j < xdf[i]->nrec; j++) {
+      if (xdf[i]->recs[j]->ha >= count) count = xdf[i]->recs[j]->ha + 1;
+    }
+  }
+  
+  *classes = count;
+  
+  xdl_free_env(&xe);
+  return 0;
+}
+
+// Emitter that notes when xdiff starts emitting and counts the hunks
+typedef struct {
+  bare_xdiff_output_t *output;
+  bare_xdiff_stats_t *stats;
+  uint64_t emit_start;
+  long offset;
+  const bare_xdiff_func_line_t *func;
+} bare_xdiff_stats_emitter_t;
+
+// Callback for xdiff hunk headers when collecting stats (ecb.out_hunk)
+static int
+xdiff_out_stats_hunk(void *priv, long old_begin, long old_nr, long new_begin, long new_nr, const char *func, long funclen) {
+  bare_xdiff_stats_emitter_t *emitter = (bare_xdiff_stats_emitter_t *)priv;
+  
+  if (emitter->emit_start == 0) emitter->emit_start = bare_xdiff_hrtime();
+  emitter->stats->hunks++;
+  
+  if (funclen == 0 && emitter->func) {
+    func = emitter->func->buf;
+    funclen = emitter->func->len;
+  }
+  
+  return bare_xdiff_output_hunk_header(emitter->output, old_begin + emitter->offset, old_nr, new_begin + emitter->offset, new_nr, func, funclen);
+}
+
+// Callback for xdiff diff output when collecting stats
+static int
+xdiff_out_stats_line(void *priv, mmbuffer_t *mb, int nbuf) {
+  bare_xdiff_stats_emitter_t *emitter = (bare_xdiff_stats_emitter_t *)priv;
+  
+  return xdiff_out_line(emitter->output, mb, nbuf);
+}
+
+// Run a unified line diff, timing the search and emit phases when stats
+// are requested. Hunk headers are shifted by offset lines when the files
+// are slices of the inputs, and take func as their function line if they
+// have none in the slice.
+static int
+bare_xdiff_run_unified(mmfile_t *mf1, mmfile_t *mf2, const bare_xdiff_diff_options_t *options, long offset, const bare_xdiff_func_line_t *func, bare_xdiff_output_t *output, bare_xdiff_stats_t *stats) {
+  // Configure xdiff parameters
+  xpparam_t xpp;
+  bare_xdiff_xpparam(options, &xpp);
+  
+  xdemitconf_t xecfg;
+  memset(&xecfg, 0, sizeof(xecfg));
+  xecfg.ctxlen = 3; // Context lines for unified diff
+  
+  // xdiff only looks for function lines ahead of each hunk, going no further
+  // back than the start of the previous one
+  if (options->func_names) {
+    xecfg.flags |= XDL_EMIT_FUNCNAMES;
+    xecfg.find_func = bare_xdiff_find_func;
+    xecfg.find_func_priv = (void *)options;
+  }
+  
+  // Set up output handler
+  xdemitcb_t ecb;
+  memset(&ecb, 0, sizeof(ecb));
+  ecb.out_line = xdiff_out_line;
+  ecb.priv = output;
+  
+  if (!stats) {
+    if (offset == 0) return xdl_diff(mf1, mf2, &xpp, &xecfg, &ecb);
+    
+    bare_xdiff_offset_emitter_t emitter = {output, offset, offset, func};
+    ecb.out_hunk = xdiff_out_offset_hunk;
+    ecb.out_line = xdiff_out_offset_line;
+    ecb.priv = &emitter;
+    
+    return xdl_diff(mf1, mf2, &xpp, &xecfg, &ecb);
+  }
+  
+  if (bare_xdiff_time_prepare(mf1, mf2, &xpp, &stats->prepare_ns, stats->lines, &stats->classes) < 0) return -1;
+  
+  bare_xdiff_stats_emitter_t emitter = {output, stats, 0, offset, func};
+  ecb.out_hunk = xdiff_out_stats_hunk;
+  ecb.out_line = xdiff_out_stats_line;
+  ecb.priv = &emitter;
+  
+  uint64_t start = bare_xdiff_hrtime();
+  int ret = xdl_diff(mf1, mf2, &xpp, &xecfg, &ecb);
+  uint64_t end = bare_xdiff_hrtime();
+  
+  // Without hunks all of the time is spent preparing and searching
+  uint64_t emit_start = emitter.emit_start ? emitter.emit_start : end;
+  uint64_t search_ns = emit_start - start;
+  
+  stats->search_ns = search_ns > stats->prepare_ns ? search_ns - stats->prepare_ns : 0;
+  stats->emit_ns = end - emit_start;
+  
+  return ret;
+}
+
+// Run a diff with the given options, writing the result to output and
+// filling in stats if not NULL
+int
+bare_xdiff_run_diff(mmfile_t *mf1, mmfile_t *mf2, const bare_xdiff_diff_options_t *options, bare_xdiff_output_t *output, bare_xdiff_stats_t *stats) {
+  bool unified = options->encoding == BARE_XDIFF_ENCODING_UNIFIED && options->granularity == BARE_XDIFF_GRANULARITY_LINE;
+  
+  // Check the memory budget before allocating anything. Unified diffs with
+  // the default algorithm only need the changed middle of the files,
+  // everything else has to fit as a whole. Patience and histogram diffs count
+  // lines across the whole files, so their hunks could change.
+  mmfile_t a = *mf1, b = *mf2;
+  long offset = 0;
+  
+  if (options->max_memory) {
+    if (unified && XDF_DIFF_ALG(options->flags) == 0) {
+      offset = bare_xdiff_fit_memory(&a, &b, 3, options->flags, options->max_memory);
+      if (offset < 0) return BARE_XDIFF_ERROR_MEMORY;
+    } else if (bare_xdiff_estimate_diff(mf1, mf2) > options->max_memory) {
+      return BARE_XDIFF_ERROR_MEMORY;
+    }
+  }
+  
+  // Hunks ahead of the first function line of the middle get theirs from
+  // the lines left out
+  bare_xdiff_func_line_t func;
+  bool func_before = unified && options->func_names && a.ptr != mf1->ptr;
+  
+  if (func_before) bare_xdiff_find_func_before(mf1, a.ptr, options, &func);
+  
+  // Unified line diffs count lines and classes while preparing the files
+  // for stats
+  if (stats && !unified) {
+    mmfile_t files[2] = {*mf1, *mf2};
+    if (bare_xdiff_count_lines(files, 2, stats) < 0) return -1;
+  }
+  
+  uint64_t start = stats ? bare_xdiff_hrtime() : 0;
+  int ret;
+  
+  if (options->encoding == BARE_XDIFF_ENCODING_BINARY) {
+    ret = bare_xdiff_diff_binary(mf1, mf2, options, output);
+  } else if (options->granularity != BARE_XDIFF_GRANULARITY_LINE) {
+    ret = bare_xdiff_refine(mf1, mf2, options, output);
+  } else {
+    ret = bare_xdiff_run_unified(&a, &b, options, offset, func_before ? &func : NULL, output, stats);
+  }
+  
+  if (ret < 0 || !stats) return ret;
+  
+  // Binary patches and refined edits are written while searching
+  if (!unified) stats->search_ns = bare_xdiff_hrtime() - start;
+  
+  stats->bytes = output->len;
+  stats->estimated_memory = bare_xdiff_estimate_memory(stats->lines[0] + stats->lines[1], stats->classes) + output->capacity;
+  
+  // Only the middle of trimmed files is prepared, but the lines left out
+  // still count
+  stats->lines[0] += offset + bare_xdiff_line_count(a.ptr + a.size, mf1->ptr + mf1->size);
+  stats->lines[1] += offset + bare_xdiff_line_count(b.ptr + b.size, mf2->ptr + mf2->size);
+  
+  return ret;
+}
+
+// Run a three-way merge, filling in stats if not NULL
+int
+bare_xdiff_run_merge(mmfile_t *ancestor, mmfile_t *ours, mmfile_t *theirs, xmparam_t const *xmp, mmbuffer_t *result, bare_xdiff_stats_t *stats) {
+  if (!stats) return xdl_merge(ancestor, ours, theirs, xmp, result);
+  
+  // xdl_merge() diffs the ancestor against both sides before merging
+  uint64_t lines[2], classes[2];
+  
+  if (bare_xdiff_time_prepare(ancestor, ours, &xmp->xpp, &stats->prepare_ns, &stats->lines[0], &classes[0]) < 0) return -1;
+  if (bare_xdiff_time_prepare(ancestor, theirs, &xmp->xpp, &stats->prepare_ns, lines, &classes[1]) < 0) return -1;
+  
+  stats->lines[2] = lines[1];
+  stats->classes = classes[0] > classes[1] ? classes[0] : classes[1];
+  
+  uint64_t start = bare_xdiff_hrtime();
+  int ret = xdl_merge(ancestor, ours, theirs, xmp, result);
+  uint64_t elapsed = bare_xdiff_hrtime() - start;
+  
+  if (ret < 0) return ret;
+  
+  // The merged output is written while merging, so it counts as searching
+  stats->search_ns = elapsed > stats->prepare_ns ? elapsed - stats->prepare_ns : 0;
+  stats->hunks = ret;
+  stats->bytes = result->size;
+  
+  // Both diffs are kept until the merge is done
+  stats->estimated_memory = bare_xdiff_estimate_memory(stats->lines[0] + stats->lines[1], classes[0]) + bare_xdiff_estimate_memory(stats->lines[0] + stats->lines[2], classes[1]) + result->size;
+  
+  return ret;
+}
+
+// Binary deltas use the git pack delta layout: the source and target sizes
+// as varints, then instructions that either copy a range of the source
+// (0x80 | offset and size byte flags) or insert 1-127 literal bytes
+#define BARE_XDIFF_DELTA_BLOCK 16
+#define BARE_XDIFF_DELTA_MAX_CHAIN 64
+#define BARE_XDIFF_DELTA_MAX_COPY 0xffffff
+#define BARE_XDIFF_DELTA_MAX_INSERT 0x7f
+#define BARE_XDIFF_DELTA_HASH_PRIME 0x01000193u
+
+// Polynomial hash of one block, kept rolling while scanning the target
+static uint32_t
+bare_xdiff_delta_hash(const unsigned char *ptr) {
+  uint32_t hash = 0;
+  for (int i = 0; i < BARE_XDIFF_DELTA_BLOCK; i++) {
+    hash = hash * BARE_XDIFF_DELTA_HASH_PRIME + ptr[i];
+  }
+  return hash;
+}
+
+// Emit literal bytes as insert instructions
+static int
+bare_xdiff_delta_insert(bare_xdiff_output_t *output, const char *data, size_t size) {
+  while (size > 0) {
+    unsigned char len = size > BARE_XDIFF_DELTA_MAX_INSERT ? BARE_XDIFF_DELTA_MAX_INSERT : (unsigned char)size;
+    if (bare_xdiff_output_append(output, &len, 1) < 0) return -1;
+    if (bare_xdiff_output_append(output, data, len) < 0) return -1;
+    data += len;
+    size -= len;
+  }
+  return 0;
+}
+
+// Emit a source range as copy instructions, omitting zero offset and size bytes
+static int
+bare_xdiff_delta_copy(bare_xdiff_output_t *output, size_t offset, size_t size) {
+  while (size > 0) {
+    size_t len = size > BARE_XDIFF_DELTA_MAX_COPY ? BARE_XDIFF_DELTA_MAX_COPY : size;
+    unsigned char buf[8];
+    size_t i = 1;
+    
+    buf[0] = 0x80;
+    for (int k = 0; k < 4; k++) {
+      unsigned char byte = (offset >> (8 * k)) & 0xff;
+      if (byte) {
+        buf[i++] = byte;
+        buf[0] |= 1 << k;
+      }
+    }
+    for (int k = 0; k < 3; k++) {
+      unsigned char byte = (len >> (8 * k)) & 0xff;
+      if (byte) {
+        buf[i++] = byte;
+        buf[0] |= 0x10 << k;
+      }
+    }
+    
+    if (bare_xdiff_output_append(output, buf, i) < 0) return -1;
+    offset += len;
+    size -= len;
+  }
+  return 0;
+}
+
+// Compute a delta that turns source into target. Source blocks are indexed by
+// hash, then the target is scanned with a rolling hash and every hit is
+// extended greedily in both directions.
+int
+bare_xdiff_delta(const char *source, size_t source_len, const char *target, size_t target_len, bare_xdiff_output_t *output) {
+  // Copy offsets are encoded in 32 bits
+  if ((uint64_t)source_len > UINT32_MAX) {
+    return -1;
+  }
+  
+  if (bare_xdiff_output_varint(output, source_len) < 0) return -1;
+  if (bare_xdiff_output_varint(output, target_len) < 0) return -1;
+  
+  size_t blocks = source_len / BARE_XDIFF_DELTA_BLOCK;
+  
+  // Small sources or targets have nothing worth indexing
+  if (blocks == 0 || target_len < BARE_XDIFF_DELTA_BLOCK) {
+    return bare_xdiff_delta_insert(output, target, target_len);
+  }
+  
+  uint32_t size = 1;
+  while (size < blocks) size <<= 1;
+  uint32_t mask = size - 1;
+  
+  uint32_t *buckets = xdl_malloc(size * sizeof(uint32_t));
+  uint32_t *next = xdl_malloc(blocks * sizeof(uint32_t));
+  
+  if (!buckets || !next) {
+    xdl_free(buckets);
+    xdl_free(next);
+    return -1;
+  }
+  
+  memset(buckets, 0, size * sizeof(uint32_t));
+  
+  // Index from the end so each chain starts with the earliest block
+  for (size_t i = blocks; i-- > 0;) {
+    uint32_t hash = bare_xdiff_delta_hash((const unsigned char *)source + i * BARE_XDIFF_DELTA_BLOCK) & mask;
+    next[i] = buckets[hash];
+    buckets[hash] = (uint32_t)i + 1;
+  }
+  
+  // Weight of the byte leaving the rolling window
+  uint32_t outgoing = 1;
+  for (int i = 1; i < BARE_XDIFF_DELTA_BLOCK; i++) {
+    outgoing *= BARE_XDIFF_DELTA_HASH_PRIME;
+  }
+  
+  const unsigned char *t = (const unsigned char *)target;
+  size_t pos = 0, literal = 0;
+  uint32_t hash = bare_xdiff_delta_hash(t);
+  int err = 0;
+  
+  while (err == 0 && pos + BARE_XDIFF_DELTA_BLOCK <= target_len) {
+    size_t best_offset = 0, best_len = 0;
+    int chain = 0;
+    
+    for (uint32_t i = buckets[hash & mask]; i && chain < BARE_XDIFF_DELTA_MAX_CHAIN; i = next[i - 1], chain++) {
+      size_t offset = (size_t)(i - 1) * BARE_XDIFF_DELTA_BLOCK;
+      size_t max = source_len - offset < target_len - pos ? source_len - offset : target_len - pos;
+      size_t len = bare_xdiff_common_prefix(source + offset, target + pos, max);
+      if (len > best_len) {
+        best_offset = offset;
+        best_len = len;
+      }
+    }
+    
+    if (best_len >= BARE_XDIFF_DELTA_BLOCK) {
+      // Grow the match backwards into bytes that would otherwise be literals
+      size_t max = best_offset < pos - literal ? best_offset : pos - literal;
+      size_t back = bare_xdiff_common_suffix(source + best_offset, target + pos, max);
+      best_offset -= back;
+      pos -= back;
+      best_len += back;
+      
+      err = bare_xdiff_delta_insert(output, target + literal, pos - literal);
+      if (err == 0) err = bare_xdiff_delta_copy(output, best_offset, best_len);
+      
+      pos += best_len;
+      literal = pos;
+      
+      if (pos + BARE_XDIFF_DELTA_BLOCK <= target_len) {
+        hash = bare_xdiff_delta_hash(t + pos);
+      }
+      continue;
+    }
+    
+    if (pos + BARE_XDIFF_DELTA_BLOCK < target_len) {
+      hash = (hash - t[pos] * outgoing) * BARE_XDIFF_DELTA_HASH_PRIME + t[pos + BARE_XDIFF_DELTA_BLOCK];
+    }
+    pos++;
+  }
+  
+  if (err == 0) err = bare_xdiff_delta_insert(output, target + literal, target_len - literal);
+  
+  xdl_free(buckets);
+  xdl_free(next);
+  
+  return err;
+}
+
+// Apply a delta to its source. Every instruction is bounds checked so that
+// corrupt or mismatched deltas fail instead of reading out of range.
+int
+bare_xdiff_apply_delta(const char *source, size_t source_len, const char *delta, size_t delta_len, char **result, size_t *result_len) {
+  const unsigned char *ptr = (const unsigned char *)delta;
+  const unsigned char *end = ptr + delta_len;
+  uint64_t expected_len, target_len;
+  
+  if (bare_xdiff_read_varint(&ptr, end, &expected_len) < 0) return -1;
+  if (bare_xdiff_read_varint(&ptr, end, &target_len) < 0) return -1;
+  
+  // No instruction produces more than BARE_XDIFF_DELTA_MAX_COPY bytes, which
+  // rejects corrupt sizes before allocating
+  if (expected_len != source_len || target_len > (uint64_t)(end - ptr) * BARE_XDIFF_DELTA_MAX_COPY || (size_t)target_len != target_len) {
+    return -1;
+  }
+  
+  char *target = xdl_malloc(target_len ? target_len : 1);
+  if (!target) return -1;
+  
+  size_t pos = 0;
+  
+  while (ptr < end) {
+    unsigned char op = *ptr++;
+    
+    if (op & 0x80) {
+      size_t offset = 0, size = 0;
+      
+      for (int k = 0; k < 4; k++) {
+        if (op & (1 << k)) {
+          if (ptr >= end) goto err;
+          offset |= (size_t)*ptr++ << (8 * k);
+        }
+      }
+      for (int k = 0; k < 3; k++) {
+        if (op & (0x10 << k)) {
+          if (ptr >= end) goto err;
+          size |= (size_t)*ptr++ << (8 * k);
+        }
+      }
+      if (size == 0) size = 0x10000;
+      
+      if (offset > source_len || size > source_len - offset || size > target_len - pos) goto err;
+      
+      memcpy(target + pos, source + offset, size);
+      pos += size;
+    } else if (op) {
+      if (op > (size_t)(end - ptr) || op > target_len - pos) goto err;
+      
+      memcpy(target + pos, ptr, op);
+      ptr += op;
+      pos += op;
+    } else {
+      // Opcode 0 is reserved
+      goto err;
+    }
+  }
+  
+  if (pos != target_len) goto err;
+  
+  *result = target;
+  *result_len = pos;
+  return 0;
+
+err:
+  xdl_free(target);
+  return -1;
+}
+
+// Sketches use one permutation MinHash: the top bits of the hash of a line
+// pick one of the slots and each slot keeps the smallest of the low bits
+#define BARE_XDIFF_SKETCH_BITS 7
+
+// Largest share of the files at the threshold the index may miss
+#define BARE_XDIFF_SKETCH_MISS 0.01
+
+// Spread the bits of an xdiff record hash over all 64 bits, with the
+// avalanche of XXH64
+static inline uint64_t
+bare_xdiff_mix64(uint64_t hash) {
+  hash ^= hash >> 33;
+  hash *= BARE_XDIFF_PRIME64_2;
+  hash ^= hash >> 29;
+  hash *= BARE_XDIFF_PRIME64_3;
+  hash ^= hash >> 32;
+  
+  return hash;
+}
+
+// Sketch the distinct lines of a file. Lines are hashed by xdiff the same way
+// it hashes records when preparing a diff, so that the whitespace flags
+// apply. Empty slots borrow the value of a slot that is not, picked by
+// hashing the slot until one is found, so that the sketches of small files
+// borrow from the same slots and stay comparable slot by slot.
+void
+bare_xdiff_sketch(const char *data, size_t len, uint32_t flags, bare_xdiff_sketch_t *sketch) {
+  uint32_t mins[BARE_XDIFF_SKETCH_SIZE];
+  memset(mins, 0xff, sizeof(mins));
+  
+  const char *ptr = data, *end = data + len;
+  
+  while (ptr < end) {
+    uint64_t hash = bare_xdiff_mix64(xdl_hash_record(&ptr, end, flags));
+    size_t slot = (size_t)(hash >> (64 - BARE_XDIFF_SKETCH_BITS));
+    
+    // The largest value marks an empty slot
+    uint32_t value = (uint32_t)hash;
+    if (value == UINT32_MAX) value--;
+    
+    if (value < mins[slot]) mins[slot] = value;
+  }
+  
+  sketch->empty = len == 0;
+  
+  for (size_t i = 0; i < BARE_XDIFF_SKETCH_SIZE && !sketch->empty; i++) {
+    size_t j = i;
+    
+    for (uint64_t attempt = 1; mins[j] == UINT32_MAX; attempt++) {
+      j = (size_t)(bare_xdiff_mix64(((uint64_t)i << 32) | attempt) >> (64 - BARE_XDIFF_SKETCH_BITS));
+    }
+    
+    sketch->mins[i] = mins[j];
+  }
+}
+
+// Estimated Jaccard similarity of the distinct lines of two sketched files.
+// Empty files are similar to nothing.
+double
+bare_xdiff_sketch_similarity(const bare_xdiff_sketch_t *a, const bare_xdiff_sketch_t *b) {
+  if (a->empty || b->empty) return 0;
+  
+  size_t equal = 0;
+  
+  for (size_t i = 0; i < BARE_XDIFF_SKETCH_SIZE; i++) {
+    equal += a->mins[i] == b->mins[i];
+  }
+  
+  return (double)equal / BARE_XDIFF_SKETCH_SIZE;
+}
+
+// Slots per band of the similarity index. Files become candidates when all
+// slots of any band are equal, so more slots per band means fewer candidates
+// to score. Uses the most slots for which a pair at the threshold still ends
+// up a candidate often enough.
+static size_t
+bare_xdiff_sketch_rows(double threshold) {
+  size_t rows = 1;
+  
+  while (rows < BARE_XDIFF_SKETCH_SIZE) {
+    size_t next = rows * 2;
+    
+    double band = 1;
+    for (size_t i = 0; i < next; i++) band *= threshold;
+    
+    double miss = 1;
+    for (size_t i = 0; i < BARE_XDIFF_SKETCH_SIZE / next; i++) miss *= 1 - band;
+    
+    if (miss > BARE_XDIFF_SKETCH_MISS) break;
+    rows = next;
+  }
+  
+  return rows;
+}
+
+// Band of a sketch in the similarity index
+typedef struct {
+  uint32_t key;
+  uint32_t index;
+} bare_xdiff_band_t;
+
+static int
+bare_xdiff_band_compare(const void *a, const void *b) {
+  const bare_xdiff_band_t *x = a, *y = b;
+  
+  if (x->key != y->key) return x->key < y->key ? -1 : 1;
+  return x->index < y->index ? -1 : x->index > y->index;
+}
+
+// Order matches by descending score, then by index for stable results
+static int
+bare_xdiff_match_compare(const void *a, const void *b) {
+  const bare_xdiff_match_t *x = a, *y = b;
+  
+  if (x->score != y->score) return x->score > y->score ? -1 : 1;
+  if (x->a != y->a) return x->a < y->a ? -1 : 1;
+  return x->b < y->b ? -1 : x->b > y->b;
+}
+
+static inline uint32_t
+bare_xdiff_band_key(const bare_xdiff_sketch_t *sketch, size_t band, size_t rows) {
+  return (uint32_t)bare_xdiff_hash64(&sketch->mins[band * rows], rows * sizeof(uint32_t), band);
+}
+
+// Match the files of a to the files of b with the most similar lines. Files
+// of b are indexed by bands of their sketches, so only the files of b that
+// share a band with a file of a are scored. Pairs at or above the threshold
+// are then taken from the most similar down, using every file at most once,
+// and written to output as bare_xdiff_match_t.
+int
+bare_xdiff_similarity(const mmfile_t *a, size_t a_len, const mmfile_t *b, size_t b_len, uint32_t flags, double threshold, bare_xdiff_output_t *output) {
+  size_t rows = bare_xdiff_sketch_rows(threshold);
+  size_t bands = BARE_XDIFF_SKETCH_SIZE / rows;
+  size_t total = a_len + b_len;
+  
+  bare_xdiff_sketch_t *sketches = xdl_malloc((total ? total : 1) * sizeof(bare_xdiff_sketch_t));
+  bare_xdiff_band_t *index = xdl_malloc((b_len ? b_len : 1) * bands * sizeof(bare_xdiff_band_t));
+  uint32_t *seen = xdl_malloc((b_len ? b_len : 1) * sizeof(uint32_t));
+  bool *used = xdl_malloc((total ? total : 1) * sizeof(bool));
+  bare_xdiff_output_t candidates;
+  memset(&candidates, 0, sizeof(candidates));
+  
+  if (!sketches || !index || !seen || !used) goto err;
+  
+  for (size_t i = 0; i < a_len; i++) bare_xdiff_sketch(a[i].ptr, a[i].size, flags, &sketches[i]);
+  for (size_t i = 0; i < b_len; i++) bare_xdiff_sketch(b[i].ptr, b[i].size, flags, &sketches[a_len + i]);
+  
+  // Index the bands of b, in one sorted run of keys per band
+  size_t indexed = 0;
+  
+  for (size_t i = 0; i < b_len; i++) {
+    if (!sketches[a_len + i].empty) indexed++;
+  }
+  
+  for (size_t band = 0; band < bands; band++) {
+    bare_xdiff_band_t *run = &index[band * indexed];
+    size_t len = 0;
+    
+    for (size_t i = 0; i < b_len; i++) {
+      const bare_xdiff_sketch_t *sketch = &sketches[a_len + i];
+      if (sketch->empty) continue;
+      
+      run[len].key = bare_xdiff_band_key(sketch, band, rows);
+      run[len].index = (uint32_t)i;
+      len++;
+    }
+    
+    qsort(run, len, sizeof(bare_xdiff_band_t), bare_xdiff_band_compare);
+  }
+  
+  // Score each file of b once per file of a that it shares a band with
+  memset(seen, 0xff, (b_len ? b_len : 1) * sizeof(uint32_t));
+  
+  for (size_t i = 0; i < a_len; i++) {
+    const bare_xdiff_sketch_t *sketch = &sketches[i];
+    if (sketch->empty) continue;
+    
+    for (size_t band = 0; band < bands; band++) {
+      const bare_xdiff_band_t *run = &index[band * indexed];
+      uint32_t key = bare_xdiff_band_key(sketch, band, rows);
+      
+      size_t low = 0, high = indexed;
+      
+      while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (run[mid].key < key) low = mid + 1;
+        else high = mid;
+      }
+      
+      for (; low < indexed && run[low].key == key; low++) {
+        uint32_t j = run[low].index;
+        if (seen[j] == (uint32_t)i) continue;
+        seen[j] = (uint32_t)i;
+        
+        double score = bare_xdiff_sketch_similarity(sketch, &sketches[a_len + j]);
+        if (score < threshold) continue;
+        
+        bare_xdiff_match_t match = {(uint32_t)i, j, score};
+        if (bare_xdiff_output_append(&candidates, &match, sizeof(match)) < 0) goto err;
+      }
+    }
+  }
+  
+  // Take the best pairs first, each file at most once
+  bare_xdiff_match_t *matches = (bare_xdiff_match_t *)candidates.data;
+  size_t len = candidates.len / sizeof(bare_xdiff_match_t);
+  
+  if (len > 0) qsort(matches, len, sizeof(bare_xdiff_match_t), bare_xdiff_match_compare);
+  
+  memset(used, 0, (total ? total : 1) * sizeof(bool));
+  
+  for (size_t i = 0; i < len; i++) {
+    if (used[matches[i].a] || used[a_len + matches[i].b]) continue;
+    used[matches[i].a] = used[a_len + matches[i].b] = true;
+    
+    if (bare_xdiff_output_append(output, &matches[i], sizeof(bare_xdiff_match_t)) < 0) goto err;
+  }
+  
+  xdl_free(sketches);
+  xdl_free(index);
+  xdl_free(seen);
+  xdl_free(used);
+  xdl_free(candidates.data);
+  return 0;
+
+err:
+  xdl_free(sketches);
+  xdl_free(index);
+  xdl_free(seen);
+  xdl_free(used);
+  xdl_free(candidates.data);
+  return -1;
+}
+
+// Trace every line of the last of a chain of revisions back to the revision
+// that added it. Origins are carried forward one revision at a time: lines
+// outside the changes keep the origin of the line they were unchanged from,
+// and the lines of a change take the index of the revision it leads to.
+// Changes that do not account for every line of the revisions they lead to,
+// as with diffs that leave out blank lines, fail rather than being traced.
+int
+bare_xdiff_blame(const mmfile_t *revisions, const bare_xdiff_hunks_t *changes, size_t len, uint32_t **origins, size_t *origins_len) {
+  const mmfile_t *first = &revisions[0];
+  size_t lines = bare_xdiff_line_count(first->ptr, first->ptr + first->size);
+  size_t capacity = lines;
+  
+  for (size_t i = 0; i + 1 < len; i++) {
+    for (size_t j = 0; j < changes[i].len; j++) {
+      lines += changes[i].data[j].b_count;
+      lines -= changes[i].data[j].a_count;
+    }
+    
+    if (lines != bare_xdiff_line_count(revisions[i + 1].ptr, revisions[i + 1].ptr + revisions[i + 1].size)) return -1;
+    
+    if (lines > capacity) capacity = lines;
+  }
+  
+  uint32_t *current = xdl_malloc((capacity ? capacity : 1) * sizeof(uint32_t));
+  uint32_t *next = xdl_malloc((capacity ? capacity : 1) * sizeof(uint32_t));
+  
+  if (!current || !next) goto err;
+  
+  lines = bare_xdiff_line_count(first->ptr, first->ptr + first->size);
+  memset(current, 0, lines * sizeof(uint32_t));
+  
+  for (size_t i = 0; i + 1 < len; i++) {
+    size_t a = 0, b = 0;
+    
+    for (size_t j = 0; j < changes[i].len; j++) {
+      const bare_xdiff_hunk_t *change = &changes[i].data[j];
+      
+      size_t unchanged = (size_t)change->b_start - b;
+      if ((size_t)change->b_start < b || a + unchanged + (size_t)change->a_count > lines) goto err;
+      
+      memcpy(next + b, current + a, unchanged * sizeof(uint32_t));
+      a += unchanged + (size_t)change->a_count;
+      b += unchanged;
+      
+      for (long k = 0; k < change->b_count; k++) next[b++] = (uint32_t)(i + 1);
+    }
+    
+    size_t remaining = lines - a;
+    memcpy(next + b, current + a, remaining * sizeof(uint32_t));
+    lines = b + remaining;
+    
+    uint32_t *swap = current;
+    current = next;
+    next = swap;
+  }
+  
+  xdl_free(next);
+  
+  *origins = current;
+  *origins_len = lines;
+  return 0;
+
+err:
+  xdl_free(current);
+  xdl_free(next);
+  return -1;
+}
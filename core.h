@@ -0,0 +1,258 @@
+#ifndef BARE_XDIFF_CORE_H
+#define BARE_XDIFF_CORE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "xdiff.h"
+
+// Diff granularity: plain unified diff, or token-level edit ranges
+#define BARE_XDIFF_GRANULARITY_LINE 0
+#define BARE_XDIFF_GRANULARITY_WORD 1
+#define BARE_XDIFF_GRANULARITY_CHAR 2
+
+// Diff output encoding: unified diff text, or compact binary patch
+#define BARE_XDIFF_ENCODING_UNIFIED 0
+#define BARE_XDIFF_ENCODING_BINARY 1
+
+// Returned when a diff does not fit in its memory budget
+#define BARE_XDIFF_ERROR_MEMORY -2
+
+// Diff options parsed from JavaScript
+typedef struct {
+  uint32_t flags;
+  int32_t granularity;
+  int32_t encoding;
+  bool stats;
+  uint64_t max_memory;  // Estimated bytes xdiff may use, 0 for no limit
+  char **anchors;  // Prefixes of lines to keep unchanged if they are unique
+  size_t anchors_len;
+  xdl_regex_t **ignore_regex;  // Changes to lines that all match are left out
+  size_t ignore_regex_len;
+  uint64_t ignore_regex_hash;  // Hash of the patterns of ignore_regex
+  bool func_names;  // Add the function line of each hunk to its header
+  xdl_regex_t **func_regex;  // Patterns of function lines, or NULL for the default rule
+  size_t func_regex_len;
+  uint64_t func_regex_hash;  // Hash of the patterns of func_regex
+} bare_xdiff_diff_options_t;
+
+// Per-phase timings and counters of a single diff or merge
+typedef struct {
+  uint64_t prepare_ns;
+  uint64_t search_ns;
+  uint64_t emit_ns;
+  uint64_t copy_ns;
+  uint64_t lines[3];  // Lines of each input
+  uint64_t classes;   // Distinct lines across the inputs
+  uint64_t hunks;
+  uint64_t bytes;
+  uint64_t estimated_memory;
+} bare_xdiff_stats_t;
+
+// Output buffer for capturing xdiff output
+typedef struct {
+  char *data;
+  size_t len;
+  size_t capacity;
+} bare_xdiff_output_t;
+
+// Changed line range reported by xdiff (0-based line numbers)
+typedef struct {
+  long a_start;
+  long a_count;
+  long b_start;
+  long b_count;
+} bare_xdiff_hunk_t;
+
+// Growable list of changed line ranges
+typedef struct {
+  bare_xdiff_hunk_t *data;
+  size_t len;
+  size_t capacity;
+} bare_xdiff_hunks_t;
+
+// Line of a parsed unified diff, pointing into the patch
+typedef struct {
+  const char *ptr;
+  size_t len;
+} bare_xdiff_line_t;
+
+// Hunk of a parsed unified diff: old lines replaced by new lines, including
+// context on both sides. Starts are 0-based line positions.
+typedef struct {
+  long old_start;
+  long old_count;
+  long new_start;
+  long new_count;
+  size_t old_lines;  // Index of the first old line
+  size_t new_lines;  // Index of the first new line
+} bare_xdiff_patch_hunk_t;
+
+// Parsed single file unified diff
+typedef struct {
+  bare_xdiff_patch_hunk_t *hunks;
+  size_t len;
+  size_t capacity;
+  bare_xdiff_line_t *lines;
+  size_t lines_len;
+  size_t lines_capacity;
+  bare_xdiff_line_t old_header;  // "--- " line, if any
+  bare_xdiff_line_t new_header;  // "+++ " line, if any
+} bare_xdiff_parsed_patch_t;
+
+// Change between two files: a_count lines of a at a_start are replaced by
+// the b_count lines of b at b_start, whose bytes are b_data
+typedef struct {
+  long a_start;
+  long a_count;
+  long b_start;
+  long b_count;
+  const char *b_data;
+  size_t b_len;
+} bare_xdiff_change_t;
+
+// Hunk of a diff session: base lines [start, end) replaced by data
+typedef struct {
+  size_t start;
+  size_t end;
+  char *data;
+  size_t len;
+  size_t lines;  // Number of lines in data
+} bare_xdiff_session_hunk_t;
+
+// Diff session between an immutable base and a document edited in place
+typedef struct {
+  char *base;
+  size_t base_len;
+  size_t *lines;  // Offsets of base lines, followed by base_len
+  size_t lines_len;
+  bare_xdiff_session_hunk_t *hunks;
+  size_t len;
+  size_t capacity;
+  size_t current_len;
+  uint32_t flags;
+} bare_xdiff_session_t;
+
+// Number of slots in the MinHash sketch of a file
+#define BARE_XDIFF_SKETCH_SIZE 128
+
+// MinHash sketch of the distinct lines of a file
+typedef struct {
+  uint32_t mins[BARE_XDIFF_SKETCH_SIZE];
+  bool empty;
+} bare_xdiff_sketch_t;
+
+// Pair of similar files: index a of the first set and index b of the second
+typedef struct {
+  uint32_t a;
+  uint32_t b;
+  double score;  // Estimated share of distinct lines in common, 0 to 1
+} bare_xdiff_match_t;
+
+static inline uint64_t
+bare_xdiff_rotl64(uint64_t value, int bits) {
+  return (value << bits) | (value >> (64 - bits));
+}
+
+// Monotonic time in nanoseconds
+uint64_t
+bare_xdiff_hrtime(void);
+
+// Append bytes to an output buffer, growing it if needed
+int
+bare_xdiff_output_append(bare_xdiff_output_t *output, const void *data, size_t size);
+
+// Run a diff with the given options, writing the result to output and
+// filling in stats if not NULL
+int
+bare_xdiff_run_diff(mmfile_t *mf1, mmfile_t *mf2, const bare_xdiff_diff_options_t *options, bare_xdiff_output_t *output, bare_xdiff_stats_t *stats);
+
+// Collect the changed line ranges between two files, without context
+int
+bare_xdiff_collect_hunks(mmfile_t *mf1, mmfile_t *mf2, uint32_t flags, bare_xdiff_hunks_t *hunks);
+
+// Run a three-way merge, filling in stats if not NULL
+int
+bare_xdiff_run_merge(mmfile_t *ancestor, mmfile_t *ours, mmfile_t *theirs, xmparam_t const *xmp, mmbuffer_t *result, bare_xdiff_stats_t *stats);
+
+// Compute a delta that turns source into target. Source blocks are indexed by
+// hash, then the target is scanned with a rolling hash and every hit is
+// extended greedily in both directions.
+int
+bare_xdiff_delta(const char *source, size_t source_len, const char *target, size_t target_len, bare_xdiff_output_t *output);
+
+// Apply a delta to its source. Every instruction is bounds checked so that
+// corrupt or mismatched deltas fail instead of reading out of range.
+int
+bare_xdiff_apply_delta(const char *source, size_t source_len, const char *delta, size_t delta_len, char **result, size_t *result_len);
+
+// Apply a binary patch to its base in a single pass
+int
+bare_xdiff_apply_patch(const char *base, size_t base_len, const char *patch, size_t patch_len, char **result, size_t *result_len);
+
+// Invert a unified diff in a single pass, so that it turns b back into a.
+// Hunk ranges and file headers are swapped and each change run is reordered
+// so that the removed lines come first. The result has the same length.
+int
+bare_xdiff_invert_patch(const char *patch, size_t patch_len, char **result, size_t *result_len);
+
+// Compose a sequence of unified diffs into a single equivalent diff
+int
+bare_xdiff_compose_patches(void **patches, const size_t *lens, size_t count, bare_xdiff_output_t *output);
+
+// Create a diff session over a copy of base
+bare_xdiff_session_t *
+bare_xdiff_session_create(const char *base, size_t base_len, uint32_t flags);
+
+// Apply an edit to the current document of a session and diff the affected
+// lines against the base again. The region that is diffed again extends to
+// the nearest lines that are unchanged, so hunks outside of it are kept.
+int
+bare_xdiff_session_edit(bare_xdiff_session_t *session, size_t offset, size_t delete_len, const char *insert, size_t insert_len);
+
+// Collect the hunks of a session as changes against the base
+int
+bare_xdiff_session_changes(const bare_xdiff_session_t *session, bare_xdiff_change_t **result);
+
+// Free the buffers of a diff session, leaving the session itself
+void
+bare_xdiff_session_clear(bare_xdiff_session_t *session);
+
+// Write changes as a unified diff with ctxlen lines of context, grouping
+// changes into hunks the same way as xdiff
+int
+bare_xdiff_emit_changes(const char *a, const size_t *a_lines, long a_count, const bare_xdiff_change_t *changes, size_t count, long ctxlen, bare_xdiff_output_t *output);
+
+// Fast 64-bit hash of a buffer, processing four 8 byte lanes at a time
+// following XXH64
+uint64_t
+bare_xdiff_hash64(const void *data, size_t len, uint64_t seed);
+
+// Estimate the native memory xdiff uses for the given lines and classes
+uint64_t
+bare_xdiff_estimate_memory(uint64_t lines, uint64_t classes);
+
+// Sketch the distinct lines of a file, hashed the same way as by xdiff with
+// the given flags
+void
+bare_xdiff_sketch(const char *data, size_t len, uint32_t flags, bare_xdiff_sketch_t *sketch);
+
+// Estimated Jaccard similarity of the distinct lines of two sketched files
+double
+bare_xdiff_sketch_similarity(const bare_xdiff_sketch_t *a, const bare_xdiff_sketch_t *b);
+
+// Match the files of a to the most similar files of b, writing the pairs at
+// or above the threshold to output as bare_xdiff_match_t, most similar first.
+// Every file is part of at most one pair.
+int
+bare_xdiff_similarity(const mmfile_t *a, size_t a_len, const mmfile_t *b, size_t b_len, uint32_t flags, double threshold, bare_xdiff_output_t *output);
+
+// Trace every line of the last of len revisions back to the revision that
+// added it, given the revisions and the changes between each pair of
+// consecutive revisions. Writes the index of that revision for every line of
+// the last revision to origins.
+int
+bare_xdiff_blame(const mmfile_t *revisions, const bare_xdiff_hunks_t *changes, size_t len, uint32_t **origins, size_t *origins_len);
+
+#endif // BARE_XDIFF_CORE_H
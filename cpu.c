@@ -0,0 +1,407 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cpu.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define BARE_XDIFF_CPU_X64
+#include <immintrin.h>
+#if !defined(_MSC_VER) || defined(__clang__)
+#include <cpuid.h>
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define BARE_XDIFF_CPU_ARM64
+#include <arm_neon.h>
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+// Kernels for a feature are compiled for it with a target attribute rather
+// than for the whole module, so that the prebuilds run on any CPU
+#if defined(__GNUC__) || defined(__clang__)
+#define BARE_XDIFF_TARGET(features) __attribute__((target(features)))
+#else
+#define BARE_XDIFF_TARGET(features)
+#endif
+
+#if defined(BARE_XDIFF_CPU_X64)
+static inline int
+bare_xdiff_popcount64(uint64_t value) {
+#if defined(_MSC_VER) && !defined(__clang__)
+  return (int)__popcnt64(value);
+#else
+  return __builtin_popcountll(value);
+#endif
+}
+#endif
+
+#if defined(BARE_XDIFF_CPU_X64) || defined(BARE_XDIFF_CPU_ARM64)
+// Index of the lowest set bit of a non-zero value
+static inline int
+bare_xdiff_ctz64(uint64_t value) {
+#if defined(_MSC_VER) && !defined(__clang__)
+  unsigned long index;
+  _BitScanForward64(&index, value);
+  return (int)index;
+#else
+  return __builtin_ctzll(value);
+#endif
+}
+
+// Number of leading zero bits of a non-zero value
+static inline int
+bare_xdiff_clz64(uint64_t value) {
+#if defined(_MSC_VER) && !defined(__clang__)
+  unsigned long index;
+  _BitScanReverse64(&index, value);
+  return 63 - (int)index;
+#else
+  return __builtin_clzll(value);
+#endif
+}
+#endif
+
+// Portable kernels
+
+static size_t
+bare_xdiff_count_newlines_scalar(const char *ptr, size_t len) {
+  size_t count = 0;
+  
+  for (size_t i = 0; i < len; i++) count += ptr[i] == '\n';
+  
+  return count;
+}
+
+static size_t
+bare_xdiff_common_prefix_scalar(const char *a, const char *b, size_t len) {
+  size_t i = 0;
+  
+  while (i + sizeof(uint64_t) <= len) {
+    uint64_t x, y;
+    memcpy(&x, a + i, sizeof(x));
+    memcpy(&y, b + i, sizeof(y));
+    if (x != y) break;
+    i += sizeof(uint64_t);
+  }
+  
+  while (i < len && a[i] == b[i]) i++;
+  
+  return i;
+}
+
+static size_t
+bare_xdiff_common_suffix_scalar(const char *a_end, const char *b_end, size_t len) {
+  size_t i = 0;
+  
+  while (i + sizeof(uint64_t) <= len) {
+    uint64_t x, y;
+    memcpy(&x, a_end - i - sizeof(x), sizeof(x));
+    memcpy(&y, b_end - i - sizeof(y), sizeof(y));
+    if (x != y) break;
+    i += sizeof(uint64_t);
+  }
+  
+  while (i < len && *(a_end - i - 1) == *(b_end - i - 1)) i++;
+  
+  return i;
+}
+
+#if defined(BARE_XDIFF_CPU_X64)
+
+// AVX2 kernels, comparing 32 bytes at a time and reading the result as a bit
+// mask with one bit per byte
+
+BARE_XDIFF_TARGET("avx2,popcnt")
+static size_t
+bare_xdiff_count_newlines_avx2(const char *ptr, size_t len) {
+  const __m256i newline = _mm256_set1_epi8('\n');
+  size_t count = 0, i = 0;
+  
+  for (; i + 32 <= len; i += 32) {
+    __m256i chunk = _mm256_loadu_si256((const __m256i *)(ptr + i));
+    count += bare_xdiff_popcount64((uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, newline)));
+  }
+  
+  return count + bare_xdiff_count_newlines_scalar(ptr + i, len - i);
+}
+
+BARE_XDIFF_TARGET("avx2")
+static size_t
+bare_xdiff_common_prefix_avx2(const char *a, const char *b, size_t len) {
+  size_t i = 0;
+  
+  for (; i + 32 <= len; i += 32) {
+    __m256i x = _mm256_loadu_si256((const __m256i *)(a + i));
+    __m256i y = _mm256_loadu_si256((const __m256i *)(b + i));
+    uint32_t mismatch = ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y));
+    if (mismatch) return i + bare_xdiff_ctz64(mismatch);
+  }
+  
+  return i + bare_xdiff_common_prefix_scalar(a + i, b + i, len - i);
+}
+
+BARE_XDIFF_TARGET("avx2")
+static size_t
+bare_xdiff_common_suffix_avx2(const char *a_end, const char *b_end, size_t len) {
+  size_t i = 0;
+  
+  for (; i + 32 <= len; i += 32) {
+    __m256i x = _mm256_loadu_si256((const __m256i *)(a_end - i - 32));
+    __m256i y = _mm256_loadu_si256((const __m256i *)(b_end - i - 32));
+    uint32_t mismatch = ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y));
+    if (mismatch) return i + bare_xdiff_clz64(mismatch) - 32;
+  }
+  
+  return i + bare_xdiff_common_suffix_scalar(a_end - i, b_end - i, len - i);
+}
+
+// AVX-512 kernels, comparing 64 bytes at a time into a mask register. The
+// remainder is handled by the AVX2 kernels, which every AVX-512 CPU supports.
+
+BARE_XDIFF_TARGET("avx512f,avx512bw,avx2,popcnt")
+static size_t
+bare_xdiff_count_newlines_avx512(const char *ptr, size_t len) {
+  const __m512i newline = _mm512_set1_epi8('\n');
+  size_t count = 0, i = 0;
+  
+  for (; i + 64 <= len; i += 64) {
+    __m512i chunk = _mm512_loadu_si512((const void *)(ptr + i));
+    count += bare_xdiff_popcount64(_mm512_cmpeq_epi8_mask(chunk, newline));
+  }
+  
+  return count + bare_xdiff_count_newlines_avx2(ptr + i, len - i);
+}
+
+BARE_XDIFF_TARGET("avx512f,avx512bw,avx2")
+static size_t
+bare_xdiff_common_prefix_avx512(const char *a, const char *b, size_t len) {
+  size_t i = 0;
+  
+  for (; i + 64 <= len; i += 64) {
+    __m512i x = _mm512_loadu_si512((const void *)(a + i));
+    __m512i y = _mm512_loadu_si512((const void *)(b + i));
+    uint64_t mismatch = _mm512_cmpneq_epi8_mask(x, y);
+    if (mismatch) return i + bare_xdiff_ctz64(mismatch);
+  }
+  
+  return i + bare_xdiff_common_prefix_avx2(a + i, b + i, len - i);
+}
+
+BARE_XDIFF_TARGET("avx512f,avx512bw,avx2")
+static size_t
+bare_xdiff_common_suffix_avx512(const char *a_end, const char *b_end, size_t len) {
+  size_t i = 0;
+  
+  for (; i + 64 <= len; i += 64) {
+    __m512i x = _mm512_loadu_si512((const void *)(a_end - i - 64));
+    __m512i y = _mm512_loadu_si512((const void *)(b_end - i - 64));
+    uint64_t mismatch = _mm512_cmpneq_epi8_mask(x, y);
+    if (mismatch) return i + bare_xdiff_clz64(mismatch);
+  }
+  
+  return i + bare_xdiff_common_suffix_avx2(a_end - i, b_end - i, len - i);
+}
+
+static void
+bare_xdiff_cpuid(uint32_t leaf, uint32_t subleaf, uint32_t regs[4]) {
+#if defined(_MSC_VER) && !defined(__clang__)
+  int info[4];
+  __cpuidex(info, (int)leaf, (int)subleaf);
+  for (int i = 0; i < 4; i++) regs[i] = (uint32_t)info[i];
+#else
+  __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+// Register state that the OS saves on context switches (XCR0)
+static uint64_t
+bare_xdiff_xgetbv(void) {
+#if defined(_MSC_VER) && !defined(__clang__)
+  return _xgetbv(0);
+#else
+  uint32_t eax, edx;
+  __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+  return (uint64_t)edx << 32 | eax;
+#endif
+}
+
+static uint32_t
+bare_xdiff_cpu_detect(void) {
+  uint32_t regs[4], features = 0;
+  
+  bare_xdiff_cpuid(0, 0, regs);
+  if (regs[0] < 7) return 0;
+  
+  // The CPU must support AVX and POPCNT, and the OS must save the AVX
+  // registers through XSAVE
+  bare_xdiff_cpuid(1, 0, regs);
+  if (!(regs[2] & (1u << 23)) || !(regs[2] & (1u << 27)) || !(regs[2] & (1u << 28))) return 0;
+  
+  uint64_t xcr0 = bare_xdiff_xgetbv();
+  if ((xcr0 & 0x6) != 0x6) return 0;  // XMM and YMM
+  
+  bare_xdiff_cpuid(7, 0, regs);
+  
+  if (regs[1] & (1u << 5)) {
+    features |= BARE_XDIFF_CPU_AVX2;
+    
+    // Opmask and ZMM state, AVX-512 F and BW
+    if ((xcr0 & 0xe0) == 0xe0 && (regs[1] & (1u << 16)) && (regs[1] & (1u << 30))) {
+      features |= BARE_XDIFF_CPU_AVX512;
+    }
+  }
+  
+  return features;
+}
+
+#elif defined(BARE_XDIFF_CPU_ARM64)
+
+// NEON kernels, comparing 16 bytes at a time. NEON is part of the ARM64
+// baseline, so there is nothing to detect.
+
+static size_t
+bare_xdiff_count_newlines_neon(const char *ptr, size_t len) {
+  const uint8x16_t newline = vdupq_n_u8('\n');
+  const uint8x16_t one = vdupq_n_u8(1);
+  size_t count = 0, i = 0;
+  
+  for (; i + 16 <= len; i += 16) {
+    uint8x16_t chunk = vld1q_u8((const uint8_t *)ptr + i);
+    count += vaddvq_u8(vandq_u8(vceqq_u8(chunk, newline), one));
+  }
+  
+  return count + bare_xdiff_count_newlines_scalar(ptr + i, len - i);
+}
+
+// Narrow a byte comparison to a mask with 4 bits per byte, in byte order
+static inline uint64_t
+bare_xdiff_neon_mask(uint8x16_t eq) {
+  return vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+}
+
+static size_t
+bare_xdiff_common_prefix_neon(const char *a, const char *b, size_t len) {
+  size_t i = 0;
+  
+  for (; i + 16 <= len; i += 16) {
+    uint8x16_t x = vld1q_u8((const uint8_t *)a + i);
+    uint8x16_t y = vld1q_u8((const uint8_t *)b + i);
+    uint64_t mismatch = ~bare_xdiff_neon_mask(vceqq_u8(x, y));
+    if (mismatch) return i + (bare_xdiff_ctz64(mismatch) >> 2);
+  }
+  
+  return i + bare_xdiff_common_prefix_scalar(a + i, b + i, len - i);
+}
+
+static size_t
+bare_xdiff_common_suffix_neon(const char *a_end, const char *b_end, size_t len) {
+  size_t i = 0;
+  
+  for (; i + 16 <= len; i += 16) {
+    uint8x16_t x = vld1q_u8((const uint8_t *)a_end - i - 16);
+    uint8x16_t y = vld1q_u8((const uint8_t *)b_end - i - 16);
+    uint64_t mismatch = ~bare_xdiff_neon_mask(vceqq_u8(x, y));
+    if (mismatch) return i + (bare_xdiff_clz64(mismatch) >> 2);
+  }
+  
+  return i + bare_xdiff_common_suffix_scalar(a_end - i, b_end - i, len - i);
+}
+
+static uint32_t
+bare_xdiff_cpu_detect(void) {
+  return BARE_XDIFF_CPU_NEON;
+}
+
+#else
+
+static uint32_t
+bare_xdiff_cpu_detect(void) {
+  return 0;
+}
+
+#endif
+
+static uint32_t bare_xdiff_cpu_detected = 0;
+static uint32_t bare_xdiff_cpu_selected = 0;
+static bool bare_xdiff_cpu_scalar = false;
+
+static size_t (*bare_xdiff_count_newlines_kernel)(const char *, size_t) = bare_xdiff_count_newlines_scalar;
+static size_t (*bare_xdiff_common_prefix_kernel)(const char *, const char *, size_t) = bare_xdiff_common_prefix_scalar;
+static size_t (*bare_xdiff_common_suffix_kernel)(const char *, const char *, size_t) = bare_xdiff_common_suffix_scalar;
+
+// Detect the features of the CPU and select the fastest kernels it supports
+void
+bare_xdiff_cpu_init(void) {
+  bare_xdiff_cpu_detected = bare_xdiff_cpu_detect();
+  bare_xdiff_cpu_selected = 0;
+  
+  bare_xdiff_count_newlines_kernel = bare_xdiff_count_newlines_scalar;
+  bare_xdiff_common_prefix_kernel = bare_xdiff_common_prefix_scalar;
+  bare_xdiff_common_suffix_kernel = bare_xdiff_common_suffix_scalar;
+  
+  const char *force = getenv("BARE_XDIFF_FORCE_SCALAR");
+  bare_xdiff_cpu_scalar = force && force[0] != '\0' && strcmp(force, "0") != 0;
+  
+  if (bare_xdiff_cpu_scalar) return;
+
+#if defined(BARE_XDIFF_CPU_X64)
+  if (bare_xdiff_cpu_detected & BARE_XDIFF_CPU_AVX512) {
+    bare_xdiff_cpu_selected = BARE_XDIFF_CPU_AVX512;
+    bare_xdiff_count_newlines_kernel = bare_xdiff_count_newlines_avx512;
+    bare_xdiff_common_prefix_kernel = bare_xdiff_common_prefix_avx512;
+    bare_xdiff_common_suffix_kernel = bare_xdiff_common_suffix_avx512;
+  } else if (bare_xdiff_cpu_detected & BARE_XDIFF_CPU_AVX2) {
+    bare_xdiff_cpu_selected = BARE_XDIFF_CPU_AVX2;
+    bare_xdiff_count_newlines_kernel = bare_xdiff_count_newlines_avx2;
+    bare_xdiff_common_prefix_kernel = bare_xdiff_common_prefix_avx2;
+    bare_xdiff_common_suffix_kernel = bare_xdiff_common_suffix_avx2;
+  }
+#elif defined(BARE_XDIFF_CPU_ARM64)
+  bare_xdiff_cpu_selected = BARE_XDIFF_CPU_NEON;
+  bare_xdiff_count_newlines_kernel = bare_xdiff_count_newlines_neon;
+  bare_xdiff_common_prefix_kernel = bare_xdiff_common_prefix_neon;
+  bare_xdiff_common_suffix_kernel = bare_xdiff_common_suffix_neon;
+#endif
+}
+
+// Features detected by bare_xdiff_cpu_init()
+uint32_t
+bare_xdiff_cpu_features(void) {
+  return bare_xdiff_cpu_detected;
+}
+
+// Feature the selected kernels use, or 0 for the portable kernels
+uint32_t
+bare_xdiff_cpu_kernels(void) {
+  return bare_xdiff_cpu_selected;
+}
+
+// Whether BARE_XDIFF_FORCE_SCALAR was set
+bool
+bare_xdiff_cpu_forced_scalar(void) {
+  return bare_xdiff_cpu_scalar;
+}
+
+// Number of newlines in a buffer
+size_t
+bare_xdiff_count_newlines(const char *ptr, size_t len) {
+  return bare_xdiff_count_newlines_kernel(ptr, len);
+}
+
+// Number of leading bytes two buffers have in common, up to len
+size_t
+bare_xdiff_common_prefix(const char *a, const char *b, size_t len) {
+  return bare_xdiff_common_prefix_kernel(a, b, len);
+}
+
+// Number of trailing bytes two buffers ending at a_end and b_end have in
+// common, up to len
+size_t
+bare_xdiff_common_suffix(const char *a_end, const char *b_end, size_t len) {
+  return bare_xdiff_common_suffix_kernel(a_end, b_end, len);
+}
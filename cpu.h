@@ -0,0 +1,44 @@
+#ifndef BARE_XDIFF_CPU_H
+#define BARE_XDIFF_CPU_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// CPU features the kernels are specialized for
+#define BARE_XDIFF_CPU_AVX2   (1 << 0)
+#define BARE_XDIFF_CPU_AVX512 (1 << 1)  // AVX-512 F and BW
+#define BARE_XDIFF_CPU_NEON   (1 << 2)
+
+// Detect the features of the CPU and select the fastest kernels it supports.
+// Setting BARE_XDIFF_FORCE_SCALAR in the environment selects the portable
+// kernels instead. Until this is called the portable kernels are used.
+void
+bare_xdiff_cpu_init(void);
+
+// Features detected by bare_xdiff_cpu_init()
+uint32_t
+bare_xdiff_cpu_features(void);
+
+// Feature the selected kernels use, or 0 for the portable kernels
+uint32_t
+bare_xdiff_cpu_kernels(void);
+
+// Whether BARE_XDIFF_FORCE_SCALAR was set
+bool
+bare_xdiff_cpu_forced_scalar(void);
+
+// Number of newlines in a buffer
+size_t
+bare_xdiff_count_newlines(const char *ptr, size_t len);
+
+// Number of leading bytes two buffers have in common, up to len
+size_t
+bare_xdiff_common_prefix(const char *a, const char *b, size_t len);
+
+// Number of trailing bytes two buffers ending at a_end and b_end have in
+// common, up to len
+size_t
+bare_xdiff_common_suffix(const char *a_end, const char *b_end, size_t len);
+
+#endif // BARE_XDIFF_CPU_H
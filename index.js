@@ -1,6 +1,23 @@
 const binding = require('./binding')
 const b4a = require('b4a')
 
+// Patterns that fail to compile throw rather than match nothing. POSIX
+// regular expressions are not available on Windows.
+function checkPatterns(name, options) {
+  if (!options) return
+  if (binding.regex) {
+    if (Array.isArray(options.ignoreLines)) binding.checkPatterns(options.ignoreLines)
+    if (Array.isArray(options.funcNames)) binding.checkPatterns(options.funcNames)
+    return
+  }
+  if (options.ignoreLines) {
+    throw new Error(`${name}() does not support ignoreLines on this platform`)
+  }
+  if (Array.isArray(options.funcNames)) {
+    throw new Error(`${name}() does not support funcNames patterns on this platform`)
+  }
+}
+
 /**
  * Generates a patch from two buffers.
  * @param {Uint8Array} a - The original data.
@@ -9,14 +26,23 @@ const b4a = require('b4a')
  * @param {boolean} [options.ignoreWhitespace] - Ignore whitespace differences.
  * @param {boolean} [options.ignoreWhitespaceChange] - Ignore changes in whitespace.
  * @param {boolean} [options.ignoreWhitespaceAtEol] - Ignore whitespace at end of line.
+ * @param {boolean} [options.ignoreCrAtEol] - Ignore a carriage return before the line feed, so CRLF and LF lines are equal.
  * @param {boolean} [options.ignoreBlankLines] - Ignore blank line changes.
  * @param {'minimal'|'patience'|'histogram'} [options.algorithm] - Diff algorithm to use.
- * @returns {Promise<Uint8Array>} A Promise that resolves with a Uint8Array containing the patch.
+ * @param {'line'|'word'|'char'} [options.granularity] - Refine changed lines into word or character edits.
+ * @param {'unified'|'binary'} [options.encoding] - Emit a unified diff or a compact binary patch for applyPatch().
+ * @param {boolean} [options.stats] - Also return per-phase timings and counters of the diff as {output, stats}.
+ * @param {number} [options.maxMemory] - Budget in bytes for the estimated native memory. Unified diffs with the default algorithm over it leave out their common ends, which may change the hunks, and other diffs fail.
+ * @param {Array<string|Uint8Array>} [options.anchors] - Keep unique lines starting with one of these unchanged, using the patience algorithm.
+ * @param {string[]} [options.ignoreLines] - Leave out changes to lines that all match one of these POSIX extended regular expressions.
+ * @param {boolean|string[]} [options.funcNames] - Add the closest line ahead of each hunk that starts with an identifier, or matches one of these POSIX extended regular expressions, to its header.
+ * @returns {Promise<Uint8Array|Uint32Array|{output: Uint8Array|Uint32Array, stats: Object}>} A Promise that resolves with a Uint8Array containing the patch, or a Uint32Array of [aOffset, aLength, bOffset, bLength] edits when refining.
  */
 async function diff(a, b, options = {}) {
   if (!b4a.isBuffer(a) || !b4a.isBuffer(b)) {
     throw new Error('diff() requires Uint8Array inputs')
   }
+  checkPatterns('diff', options)
   return new Promise((resolve, reject) => {
     binding.diff(a, b, options, (err, result) => {
       if (err) reject(err)
@@ -36,7 +62,9 @@ async function diff(a, b, options = {}) {
  * @param {'ours'|'theirs'|'union'} [options.favor] - Conflict resolution preference.
  * @param {'normal'|'diff3'|'zealous_diff3'} [options.style] - Merge output style.
  * @param {number} [options.markerSize] - Conflict marker size (default: 7).
- * @returns {Promise<{conflict: boolean, output: Uint8Array}>} A Promise that resolves with an object containing conflict status and merged data.
+ * @param {boolean} [options.normalizeEol] - Treat CRLF and LF line endings as equal.
+ * @param {boolean} [options.stats] - Also return per-phase timings and counters of the merge.
+ * @returns {Promise<{conflict: boolean, output: Uint8Array, stats?: Object}>} A Promise that resolves with an object containing conflict status and merged data.
  */
 async function merge(o, a, b, options = {}) {
   if (!b4a.isBuffer(o) || !b4a.isBuffer(a) || !b4a.isBuffer(b)) {
@@ -58,14 +86,23 @@ async function merge(o, a, b, options = {}) {
  * @param {boolean} [options.ignoreWhitespace] - Ignore whitespace differences.
  * @param {boolean} [options.ignoreWhitespaceChange] - Ignore changes in whitespace.
  * @param {boolean} [options.ignoreWhitespaceAtEol] - Ignore whitespace at end of line.
+ * @param {boolean} [options.ignoreCrAtEol] - Ignore a carriage return before the line feed, so CRLF and LF lines are equal.
  * @param {boolean} [options.ignoreBlankLines] - Ignore blank line changes.
  * @param {'minimal'|'patience'|'histogram'} [options.algorithm] - Diff algorithm to use.
- * @returns {Uint8Array} A Uint8Array containing the patch.
+ * @param {'line'|'word'|'char'} [options.granularity] - Refine changed lines into word or character edits.
+ * @param {'unified'|'binary'} [options.encoding] - Emit a unified diff or a compact binary patch for applyPatch().
+ * @param {boolean} [options.stats] - Also return per-phase timings and counters of the diff as {output, stats}.
+ * @param {number} [options.maxMemory] - Budget in bytes for the estimated native memory. Unified diffs with the default algorithm over it leave out their common ends, which may change the hunks, and other diffs fail.
+ * @param {Array<string|Uint8Array>} [options.anchors] - Keep unique lines starting with one of these unchanged, using the patience algorithm.
+ * @param {string[]} [options.ignoreLines] - Leave out changes to lines that all match one of these POSIX extended regular expressions.
+ * @param {boolean|string[]} [options.funcNames] - Add the closest line ahead of each hunk that starts with an identifier, or matches one of these POSIX extended regular expressions, to its header.
+ * @returns {Uint8Array|Uint32Array|{output: Uint8Array|Uint32Array, stats: Object}} A Uint8Array containing the patch, or a Uint32Array of [aOffset, aLength, bOffset, bLength] edits when refining.
  */
 function diffSync(a, b, options = {}) {
   if (!b4a.isBuffer(a) || !b4a.isBuffer(b)) {
     throw new Error('diffSync() requires Uint8Array inputs')
   }
+  checkPatterns('diffSync', options)
   const result = binding.diffSync(a, b, options)
   return result
 }
@@ -80,7 +117,9 @@ function diffSync(a, b, options = {}) {
  * @param {'ours'|'theirs'|'union'} [options.favor] - Conflict resolution preference.
  * @param {'normal'|'diff3'|'zealous_diff3'} [options.style] - Merge output style.
  * @param {number} [options.markerSize] - Conflict marker size (default: 7).
- * @returns {{conflict: boolean, output: Uint8Array}} An object containing conflict status and merged data.
+ * @param {boolean} [options.normalizeEol] - Treat CRLF and LF line endings as equal.
+ * @param {boolean} [options.stats] - Also return per-phase timings and counters of the merge.
+ * @returns {{conflict: boolean, output: Uint8Array, stats?: Object}} An object containing conflict status and merged data.
  */
 function mergeSync(o, a, b, options = {}) {
   if (!b4a.isBuffer(o) || !b4a.isBuffer(a) || !b4a.isBuffer(b)) {
@@ -90,9 +129,434 @@ function mergeSync(o, a, b, options = {}) {
   return result
 }
 
+/**
+ * Generates patches from one buffer to each of many others in a single job.
+ * The base is copied once and the diffs run in parallel.
+ * @param {Uint8Array} base - The original data.
+ * @param {Uint8Array[]} targets - The modified data to diff the base against.
+ * @param {Object} [options] - Diff options, the same as for diff() and applied to every target.
+ * @returns {Promise<Array<Uint8Array|Uint32Array|{output: Uint8Array|Uint32Array, stats: Object}>>} A Promise that resolves with the result of diff() for each target, in order.
+ */
+async function diffMany(base, targets, options = {}) {
+  if (!b4a.isBuffer(base) || !Array.isArray(targets) || !targets.every(b4a.isBuffer)) {
+    throw new Error('diffMany() requires a Uint8Array base and an array of Uint8Array targets')
+  }
+  checkPatterns('diffMany', options)
+  return new Promise((resolve, reject) => {
+    binding.diffMany(base, targets, options, (err, result) => {
+      if (err) reject(err)
+      else resolve(result)
+    })
+  })
+}
+
+/**
+ * Generates patches from one buffer to each of many others (synchronous version).
+ * @param {Uint8Array} base - The original data.
+ * @param {Uint8Array[]} targets - The modified data to diff the base against.
+ * @param {Object} [options] - Diff options, the same as for diff() and applied to every target.
+ * @returns {Array<Uint8Array|Uint32Array|{output: Uint8Array|Uint32Array, stats: Object}>} The result of diffSync() for each target, in order.
+ */
+function diffManySync(base, targets, options = {}) {
+  if (!b4a.isBuffer(base) || !Array.isArray(targets) || !targets.every(b4a.isBuffer)) {
+    throw new Error('diffManySync() requires a Uint8Array base and an array of Uint8Array targets')
+  }
+  checkPatterns('diffManySync', options)
+  return binding.diffManySync(base, targets, options)
+}
+
+/**
+ * Diffs the files of two directory trees natively, walking the trees and
+ * diffing changed files in parallel on the thread pool.
+ * @param {string} a - Path of the original tree.
+ * @param {string} b - Path of the modified tree.
+ * @param {Object} [options] - Diff options, the same as for diff() and applied to every file.
+ * @returns {AsyncIterable<{path: string, status: 'modified'|'added'|'removed', patch: Uint8Array|Uint32Array|{output: Uint8Array|Uint32Array, stats: Object}}>} The changed files, as soon as each is diffed.
+ */
+async function * diffTrees(a, b, options = {}) {
+  if (typeof a !== 'string' || typeof b !== 'string') {
+    throw new Error('diffTrees() requires directory paths')
+  }
+  checkPatterns('diffTrees', options)
+
+  let entries = []
+  let done = false
+  let error = null
+  let wake = null
+
+  const handle = binding.diffTrees(a, b, options, (path, status, patch) => {
+    entries.push({ path, status, patch })
+    if (wake) wake()
+  }, (err) => {
+    done = true
+    error = err
+    if (wake) wake()
+  })
+
+  // Files are taken a batch at a time and reported as read, so the threads
+  // wait rather than queue without bound. Diffing stops if the iteration ends
+  // early; the handle is only valid until the callback has been called.
+  try {
+    while (true) {
+      const batch = entries
+      entries = []
+      for (const entry of batch) yield entry
+      if (!done && batch.length > 0) binding.diffTreesRead(handle, batch.length)
+      if (entries.length > 0) continue
+      if (error) throw error
+      if (done) return
+      await new Promise((resolve) => { wake = resolve })
+      wake = null
+    }
+  } finally {
+    if (!done) binding.diffTreesCancel(handle)
+  }
+}
+
+/**
+ * Finds the files of one set most similar to the files of another, for
+ * example to detect renames.
+ * @param {Uint8Array[]} a - The first set of files.
+ * @param {Uint8Array[]} b - The second set of files.
+ * @param {Object} [options] - Similarity options.
+ * @param {number} [options.threshold] - Lowest score of a match, from 0 to 1 (default: 0.5).
+ * @param {boolean} [options.ignoreWhitespace] - Ignore whitespace differences.
+ * @param {boolean} [options.ignoreWhitespaceChange] - Ignore changes in whitespace.
+ * @param {boolean} [options.ignoreWhitespaceAtEol] - Ignore whitespace at end of line.
+ * @param {boolean} [options.ignoreCrAtEol] - Ignore a carriage return before the line feed.
+ * @returns {Promise<Array<{a: number, b: number, score: number}>>} A Promise that resolves with the matching pairs of indices, most similar first.
+ */
+async function similarity(a, b, options = {}) {
+  if (!Array.isArray(a) || !Array.isArray(b) || !a.every(b4a.isBuffer) || !b.every(b4a.isBuffer)) {
+    throw new Error('similarity() requires arrays of Uint8Array inputs')
+  }
+  return new Promise((resolve, reject) => {
+    binding.similarity(a, b, options, (err, result) => {
+      if (err) reject(err)
+      else resolve(result)
+    })
+  })
+}
+
+/**
+ * Finds the files of one set most similar to the files of another (synchronous version).
+ * @param {Uint8Array[]} a - The first set of files.
+ * @param {Uint8Array[]} b - The second set of files.
+ * @param {Object} [options] - Similarity options, the same as for similarity().
+ * @returns {Array<{a: number, b: number, score: number}>} The matching pairs of indices, most similar first.
+ */
+function similaritySync(a, b, options = {}) {
+  if (!Array.isArray(a) || !Array.isArray(b) || !a.every(b4a.isBuffer) || !b.every(b4a.isBuffer)) {
+    throw new Error('similaritySync() requires arrays of Uint8Array inputs')
+  }
+  return binding.similaritySync(a, b, options)
+}
+
+/**
+ * Finds the revision that added every line of the last of a chain of
+ * revisions, diffing the consecutive revisions in parallel.
+ * @param {Uint8Array[]} revisions - The revisions, oldest first.
+ * @param {Object} [options] - Diff options, of which the whitespace and algorithm options apply. ignoreBlankLines and ignoreLines are rejected, as every line has to be traced.
+ * @returns {Promise<Uint32Array>} A Promise that resolves with the index of the revision that added each line of the last revision.
+ */
+async function blame(revisions, options = {}) {
+  if (!Array.isArray(revisions) || revisions.length === 0 || !revisions.every(b4a.isBuffer)) {
+    throw new Error('blame() requires a non-empty array of Uint8Array inputs')
+  }
+  if (options.ignoreBlankLines || options.ignoreLines) {
+    throw new Error('blame() does not support ignoreBlankLines or ignoreLines')
+  }
+  return new Promise((resolve, reject) => {
+    binding.blame(revisions, options, (err, result) => {
+      if (err) reject(err)
+      else resolve(result)
+    })
+  })
+}
+
+/**
+ * Finds the revision that added every line of the last of a chain of revisions (synchronous version).
+ * @param {Uint8Array[]} revisions - The revisions, oldest first.
+ * @param {Object} [options] - Diff options, the same as for blame().
+ * @returns {Uint32Array} The index of the revision that added each line of the last revision.
+ */
+function blameSync(revisions, options = {}) {
+  if (!Array.isArray(revisions) || revisions.length === 0 || !revisions.every(b4a.isBuffer)) {
+    throw new Error('blameSync() requires a non-empty array of Uint8Array inputs')
+  }
+  if (options.ignoreBlankLines || options.ignoreLines) {
+    throw new Error('blameSync() does not support ignoreBlankLines or ignoreLines')
+  }
+  return binding.blameSync(revisions, options)
+}
+
+/**
+ * Computes a binary delta that turns one buffer into another.
+ * @param {Uint8Array} a - The source data.
+ * @param {Uint8Array} b - The target data.
+ * @returns {Promise<Uint8Array>} A Promise that resolves with a Uint8Array containing the delta.
+ */
+async function delta(a, b) {
+  if (!b4a.isBuffer(a) || !b4a.isBuffer(b)) {
+    throw new Error('delta() requires Uint8Array inputs')
+  }
+  return new Promise((resolve, reject) => {
+    binding.delta(a, b, (err, result) => {
+      if (err) reject(err)
+      else resolve(result)
+    })
+  })
+}
+
+/**
+ * Applies a binary delta to the buffer it was computed from.
+ * @param {Uint8Array} a - The source data.
+ * @param {Uint8Array} delta - The delta produced by delta() or deltaSync().
+ * @returns {Promise<Uint8Array>} A Promise that resolves with a Uint8Array containing the target data.
+ */
+async function applyDelta(a, delta) {
+  if (!b4a.isBuffer(a) || !b4a.isBuffer(delta)) {
+    throw new Error('applyDelta() requires Uint8Array inputs')
+  }
+  return new Promise((resolve, reject) => {
+    binding.applyDelta(a, delta, (err, result) => {
+      if (err) reject(err)
+      else resolve(result)
+    })
+  })
+}
+
+/**
+ * Computes a binary delta that turns one buffer into another (synchronous version).
+ * @param {Uint8Array} a - The source data.
+ * @param {Uint8Array} b - The target data.
+ * @returns {Uint8Array} A Uint8Array containing the delta.
+ */
+function deltaSync(a, b) {
+  if (!b4a.isBuffer(a) || !b4a.isBuffer(b)) {
+    throw new Error('deltaSync() requires Uint8Array inputs')
+  }
+  return binding.deltaSync(a, b)
+}
+
+/**
+ * Applies a binary delta to the buffer it was computed from (synchronous version).
+ * @param {Uint8Array} a - The source data.
+ * @param {Uint8Array} delta - The delta produced by delta() or deltaSync().
+ * @returns {Uint8Array} A Uint8Array containing the target data.
+ */
+function applyDeltaSync(a, delta) {
+  if (!b4a.isBuffer(a) || !b4a.isBuffer(delta)) {
+    throw new Error('applyDeltaSync() requires Uint8Array inputs')
+  }
+  return binding.applyDeltaSync(a, delta)
+}
+
+/**
+ * Applies a binary patch produced by diff() with encoding: 'binary'.
+ * @param {Uint8Array} a - The original data the patch was computed from.
+ * @param {Uint8Array} patch - The binary patch.
+ * @returns {Promise<Uint8Array>} A Promise that resolves with a Uint8Array containing the patched data.
+ */
+async function applyPatch(a, patch) {
+  if (!b4a.isBuffer(a) || !b4a.isBuffer(patch)) {
+    throw new Error('applyPatch() requires Uint8Array inputs')
+  }
+  return new Promise((resolve, reject) => {
+    binding.applyPatch(a, patch, (err, result) => {
+      if (err) reject(err)
+      else resolve(result)
+    })
+  })
+}
+
+/**
+ * Applies a binary patch produced by diff() with encoding: 'binary' (synchronous version).
+ * @param {Uint8Array} a - The original data the patch was computed from.
+ * @param {Uint8Array} patch - The binary patch.
+ * @returns {Uint8Array} A Uint8Array containing the patched data.
+ */
+function applyPatchSync(a, patch) {
+  if (!b4a.isBuffer(a) || !b4a.isBuffer(patch)) {
+    throw new Error('applyPatchSync() requires Uint8Array inputs')
+  }
+  return binding.applyPatchSync(a, patch)
+}
+
+/**
+ * Inverts a unified diff so that it turns b back into a.
+ * @param {Uint8Array} patch - The unified diff to invert.
+ * @returns {Promise<Uint8Array>} A Promise that resolves with a Uint8Array containing the inverted patch.
+ */
+async function invertPatch(patch) {
+  if (!b4a.isBuffer(patch)) {
+    throw new Error('invertPatch() requires a Uint8Array input')
+  }
+  return new Promise((resolve, reject) => {
+    binding.invertPatch(patch, (err, result) => {
+      if (err) reject(err)
+      else resolve(result)
+    })
+  })
+}
+
+/**
+ * Inverts a unified diff so that it turns b back into a (synchronous version).
+ * @param {Uint8Array} patch - The unified diff to invert.
+ * @returns {Uint8Array} A Uint8Array containing the inverted patch.
+ */
+function invertPatchSync(patch) {
+  if (!b4a.isBuffer(patch)) {
+    throw new Error('invertPatchSync() requires a Uint8Array input')
+  }
+  return binding.invertPatchSync(patch)
+}
+
+/**
+ * Composes a sequence of unified diffs into a single equivalent diff.
+ * @param {Uint8Array[]} patches - Unified diffs of the same file, each applying to the result of the previous one.
+ * @returns {Promise<Uint8Array>} A Promise that resolves with a Uint8Array containing the composed patch.
+ */
+async function composePatches(patches) {
+  if (!Array.isArray(patches) || !patches.every(b4a.isBuffer)) {
+    throw new Error('composePatches() requires an array of Uint8Array inputs')
+  }
+  return new Promise((resolve, reject) => {
+    binding.composePatches(patches, (err, result) => {
+      if (err) reject(err)
+      else resolve(result)
+    })
+  })
+}
+
+/**
+ * Composes a sequence of unified diffs into a single equivalent diff (synchronous version).
+ * @param {Uint8Array[]} patches - Unified diffs of the same file, each applying to the result of the previous one.
+ * @returns {Uint8Array} A Uint8Array containing the composed patch.
+ */
+function composePatchesSync(patches) {
+  if (!Array.isArray(patches) || !patches.every(b4a.isBuffer)) {
+    throw new Error('composePatchesSync() requires an array of Uint8Array inputs')
+  }
+  return binding.composePatchesSync(patches)
+}
+
+/**
+ * Configures the diff result cache.
+ * @param {Object} options - Cache options.
+ * @param {number} [options.maxBytes] - Upper bound on the size of cached results, 0 disables the cache.
+ */
+function configureCache(options = {}) {
+  binding.configureCache(options)
+}
+
+/**
+ * Returns counters of the diff result cache.
+ * @returns {{hits: number, misses: number, evictions: number, entries: number, bytes: number, maxBytes: number}} Cache statistics.
+ */
+function cacheStats() {
+  return binding.cacheStats()
+}
+
+/**
+ * Returns module wide counters and histograms of the operations run on the
+ * thread pool, for scraping into monitoring.
+ * @returns {{queued: number, running: number, completed: number, failed: number, bytesCopied: number, memory: number, latency: {sizes: number[], bounds: number[], counts: number[][]}, queueWait: {bounds: number[], counts: number[]}}} Module metrics.
+ */
+function metrics() {
+  return binding.metrics()
+}
+
+/**
+ * Returns the CPU features detected at load and the kernels selected for
+ * scanning and comparing inputs.
+ * @returns {{avx2: boolean, avx512: boolean, neon: boolean, forceScalar: boolean, kernels: 'avx512'|'avx2'|'neon'|'scalar'}} CPU features.
+ */
+function cpuFeatures() {
+  return binding.cpuFeatures()
+}
+
+/**
+ * A diff between an immutable base and a document that is edited in place.
+ * Edits only diff the lines around them again, so keeping the diff up to
+ * date costs time proportional to the size of the edit rather than the file.
+ */
+class DiffSession {
+  /**
+   * @param {Uint8Array} base - The original data.
+   * @param {Object} [options] - Diff options.
+   * @param {'minimal'|'patience'|'histogram'} [options.algorithm] - Diff algorithm to use.
+   */
+  constructor(base, options = {}) {
+    if (!b4a.isBuffer(base)) {
+      throw new Error('DiffSession requires a Uint8Array base')
+    }
+    this._handle = binding.sessionCreate(base, options)
+  }
+
+  /**
+   * Applies an edit to the current document.
+   * @param {number} offset - Byte offset of the edit in the current document.
+   * @param {number} deleteLength - Number of bytes to delete at offset.
+   * @param {Uint8Array|string} [insert] - Bytes to insert at offset.
+   */
+  edit(offset, deleteLength, insert = b4a.alloc(0)) {
+    if (typeof insert === 'string') insert = b4a.from(insert)
+    if (!b4a.isBuffer(insert)) {
+      throw new Error('edit() requires a Uint8Array or string to insert')
+    }
+    binding.sessionEdit(this._handle, offset, deleteLength, insert)
+  }
+
+  /**
+   * Returns the changed line ranges between the base and the current document.
+   * @returns {Uint32Array} A Uint32Array of [aStart, aCount, bStart, bCount] 0-based line ranges.
+   */
+  hunks() {
+    return binding.sessionHunks(this._handle)
+  }
+
+  /**
+   * Returns the unified diff between the base and the current document.
+   * @returns {Uint8Array} A Uint8Array containing the patch.
+   */
+  patch() {
+    return binding.sessionPatch(this._handle)
+  }
+
+  /**
+   * Releases the memory held by the session.
+   */
+  destroy() {
+    binding.sessionDestroy(this._handle)
+  }
+}
+
 module.exports = {
   diff,
   merge,
   diffSync,
-  mergeSync
+  mergeSync,
+  diffMany,
+  diffManySync,
+  similarity,
+  similaritySync,
+  blame,
+  blameSync,
+  diffTrees,
+  delta,
+  applyDelta,
+  deltaSync,
+  applyDeltaSync,
+  applyPatch,
+  applyPatchSync,
+  invertPatch,
+  invertPatchSync,
+  composePatches,
+  composePatchesSync,
+  DiffSession,
+  configureCache,
+  cacheStats,
+  metrics,
+  cpuFeatures
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 const test = require('brittle')
 const b4a = require('b4a')
-const { diff, merge, diffSync, mergeSync } = require('.')
+const fs = require('fs')
+const { diff, merge, diffSync, mergeSync, diffMany, diffManySync, similarity, similaritySync, blame, blameSync, diffTrees, delta, applyDelta, deltaSync, applyDeltaSync, applyPatch, applyPatchSync, invertPatch, invertPatchSync, composePatches, composePatchesSync, DiffSession, configureCache, cacheStats, metrics, cpuFeatures } = require('.')
 
 test('diff - simple text change', async (t) => {
   const a = b4a.from('hello world\n')
@@ -222,6 +223,7 @@ common end`)
   t.ok(minimal.length > 0, 'minimal algorithm produces diff')
   t.ok(patience.length > 0, 'patience algorithm produces diff') 
   t.ok(histogram.length > 0, 'histogram algorithm produces diff')
+  t.ok(b4a.toString(diffSync(a, b, { algorithm: 'minimal' })).includes('+modified line'), 'minimal algorithm produces diff')
   
   // All should handle the same changes
   const minStr = b4a.toString(minimal)
@@ -718,4 +720,618 @@ test('sync vs async performance comparison', async (t) => {
   
   t.alike(syncResult, asyncResult, 'sync and async produce identical large diff results')
   t.ok(syncTime >= 0 && asyncTime >= 0, 'both sync and async complete successfully')
-})
\ No newline at end of file
+})
+
+test('diff granularity - word', async (t) => {
+  const a = b4a.from('the quick brown fox\n')
+  const b = b4a.from('the quick red fox\n')
+  
+  const edits = await diff(a, b, { granularity: 'word' })
+  
+  t.ok(edits instanceof Uint32Array, 'returns edit ranges')
+  t.alike(Array.from(edits), [10, 5, 10, 3], 'only the changed word is reported')
+})
+
+test('diff granularity - char', async (t) => {
+  const a = b4a.from('line1\nhéllo\nline3\n')
+  const b = b4a.from('line1\nhèllo!\nline3\n')
+  
+  const edits = diffSync(a, b, { granularity: 'char' })
+  
+  t.alike(Array.from(edits), [7, 2, 7, 2, 12, 0, 12, 1], 'multibyte characters are kept whole')
+  t.alike(edits, await diff(a, b, { granularity: 'char' }), 'sync and async produce identical edits')
+})
+
+test('diff granularity - identical inputs', (t) => {
+  const a = b4a.from('same content\n')
+  
+  const edits = diffSync(a, a, { granularity: 'word' })
+  t.is(edits.length, 0, 'no edits for identical content')
+})
+
+test('delta - roundtrip binary data', async (t) => {
+  const a = b4a.alloc(64 * 1024)
+  for (let i = 0; i < a.length; i++) a[i] = (i * 7919) % 251
+  
+  const b = b4a.concat([a.subarray(0, 1000), b4a.from([0, 1, 2, 3]), a.subarray(2000, 40000), a.subarray(50000)])
+  
+  const d = await delta(a, b)
+  t.ok(d.length < 100, 'delta is compact')
+  
+  const restored = await applyDelta(a, d)
+  t.alike(restored, b, 'applying the delta restores the target')
+})
+
+test('delta - empty and unrelated inputs', (t) => {
+  const a = b4a.from('source data that shares nothing')
+  const b = b4a.from('XYZ')
+  
+  t.alike(applyDeltaSync(a, deltaSync(a, b)), b, 'unrelated target is stored as literals')
+  t.alike(applyDeltaSync(b4a.alloc(0), deltaSync(b4a.alloc(0), b)), b, 'empty source')
+  t.is(applyDeltaSync(a, deltaSync(a, b4a.alloc(0))).length, 0, 'empty target')
+})
+
+test('delta - sync and async produce identical results', async (t) => {
+  const a = b4a.from('line1\nline2\nline3\nline4\nline5\n'.repeat(20))
+  const b = b4a.from('line1\nline2\nchanged\nline4\nline5\n'.repeat(20))
+  
+  t.alike(deltaSync(a, b), await delta(a, b), 'identical deltas')
+})
+
+test('applyDelta - rejects invalid deltas', async (t) => {
+  const a = b4a.from('hello world, hello world, hello world\n')
+  const b = b4a.from('hello world, hello there, hello world\n')
+  const d = deltaSync(a, b)
+  
+  t.exception(() => applyDeltaSync(b4a.from('other source'), d), /Invalid delta/, 'wrong source')
+  t.exception(() => applyDeltaSync(a, d.subarray(0, d.length - 1)), /Invalid delta/, 'truncated delta')
+  await t.exception(applyDelta(a, b4a.from([0xff])), /Invalid delta/, 'garbage delta')
+})
+
+test('diff encoding - binary patch roundtrip', async (t) => {
+  const lines = []
+  for (let i = 0; i < 200; i++) lines.push(`line ${i} with some content`)
+  const a = b4a.from(lines.join('\n') + '\n')
+  
+  lines[10] = 'changed line'
+  lines.splice(100, 5)
+  lines.push('appended without newline')
+  const b = b4a.from(lines.join('\n'))
+  
+  const patch = await diff(a, b, { encoding: 'binary' })
+  const unified = await diff(a, b)
+  
+  t.ok(patch.length < unified.length / 2, 'binary patch is smaller than unified output')
+  t.alike(await applyPatch(a, patch), b, 'applying the patch restores the target')
+  t.alike(applyPatchSync(a, diffSync(a, b, { encoding: 'binary' })), b, 'sync roundtrip')
+  
+  const spaced = b4a.from('a b\nc\n\nd \r\n')
+  const respaced = b4a.from('a  b\nc\nd\n')
+  
+  for (const option of ['ignoreWhitespace', 'ignoreWhitespaceChange', 'ignoreWhitespaceAtEol', 'ignoreCrAtEol', 'ignoreBlankLines']) {
+    t.alike(applyPatchSync(spaced, diffSync(spaced, respaced, { encoding: 'binary', [option]: true })), respaced, `${option} does not apply`)
+  }
+})
+
+test('diff encoding - binary patch with word granularity', (t) => {
+  const a = b4a.from('the quick brown fox\njumps over the lazy dog\n')
+  const b = b4a.from('the quick red fox\njumps over the lazy cat\n')
+  
+  const lines = diffSync(a, b, { encoding: 'binary' })
+  const words = diffSync(a, b, { encoding: 'binary', granularity: 'word' })
+  
+  t.ok(words instanceof Uint8Array, 'binary encoding takes precedence over edit ranges')
+  t.ok(words.length < lines.length, 'word edits produce a smaller patch')
+  t.alike(applyPatchSync(a, words), b, 'applying the patch restores the target')
+})
+
+test('applyPatch - rejects invalid patches', async (t) => {
+  const a = b4a.from('line1\nline2\nline3\n')
+  const b = b4a.from('line1\nchanged\nline3\n')
+  const patch = diffSync(a, b, { encoding: 'binary' })
+  
+  t.exception(() => applyPatchSync(b, patch), /Invalid patch/, 'wrong base')
+  t.exception(() => applyPatchSync(a, patch.subarray(0, patch.length - 1)), /Invalid patch/, 'truncated patch')
+  await t.exception(applyPatch(a, b4a.from([0xff])), /Invalid patch/, 'garbage patch')
+})
+
+test('invertPatch - basic', async (t) => {
+  const a = b4a.from('line1\nline2\nline3\nline4\n')
+  const b = b4a.from('line1\nchanged\nline3\nline4\nline5\n')
+  
+  const patch = await diff(a, b)
+  const inverted = await invertPatch(patch)
+  
+  t.is(b4a.toString(inverted), b4a.toString(await diff(b, a)), 'matches diffing in reverse')
+  t.alike(invertPatchSync(inverted), patch, 'inverting twice restores the patch')
+})
+
+test('invertPatch - file headers and missing newline', (t) => {
+  const patch = b4a.from([
+    '--- a/file.txt',
+    '+++ b/file.txt',
+    '@@ -1,2 +1 @@',
+    '-x',
+    '-y',
+    '+z',
+    '\\ No newline at end of file',
+    ''
+  ].join('\n'))
+  
+  t.is(b4a.toString(invertPatchSync(patch)), [
+    '--- b/file.txt',
+    '+++ a/file.txt',
+    '@@ -1 +1,2 @@',
+    '-z',
+    '\\ No newline at end of file',
+    '+x',
+    '+y',
+    ''
+  ].join('\n'))
+})
+
+test('invertPatch - rejects invalid patches', async (t) => {
+  t.exception(() => invertPatchSync(b4a.from('@@ -1,2 +1,2 @@\n-x\n')), /Invalid patch/, 'truncated hunk')
+  await t.exception(invertPatch(b4a.from('@@ -x +1 @@\n')), /Invalid patch/, 'malformed header')
+})
+
+test('composePatches - basic', async (t) => {
+  const v1 = b4a.from('a\nb\nc\nd\ne\nf\ng\nh\ni\nj\n')
+  const v2 = b4a.from('a\nB\nc\nd\ne\nf\ng\nh\ni\nj\n')
+  const v3 = b4a.from('a\nB\nc\nd\ne\nf\ng\nh\ni\nJ\n')
+  const v4 = b4a.from('a\nb2\nc\nd\ne\nf\ng\nh\ni\nJ\nk')
+  
+  const patches = [await diff(v1, v2), await diff(v2, v3), await diff(v3, v4)]
+  const composed = await composePatches(patches)
+  
+  t.is(b4a.toString(composed), b4a.toString(await diff(v1, v4)), 'matches diffing the first and last version')
+  t.alike(composePatchesSync(patches), composed, 'sync matches async')
+})
+
+test('composePatches - changes that cancel out', (t) => {
+  const a = b4a.from('line1\nline2\nline3\n')
+  const b = b4a.from('line1\nchanged\nline3\n')
+  
+  const composed = composePatchesSync([diffSync(a, b), diffSync(b, a)])
+  
+  t.is(composed.length, 0, 'no changes left')
+})
+
+test('composePatches - rejects patches out of sequence', async (t) => {
+  const a = b4a.from('line1\nline2\nline3\n')
+  const b = b4a.from('line1\nchanged\nline3\n')
+  const patch = diffSync(a, b)
+  
+  t.exception(() => composePatchesSync([patch, patch]), /Patches do not apply in sequence/)
+  await t.exception(composePatches([patch, b4a.from('@@ -1 +1 @@\n')]), /Patches do not apply in sequence/)
+})
+
+test('DiffSession - edits', (t) => {
+  const base = b4a.from('line1\nline2\nline3\nline4\nline5\n')
+  const session = new DiffSession(base)
+  
+  t.alike(session.hunks(), new Uint32Array([]), 'no hunks before editing')
+  
+  session.edit(6, 5, 'changed')
+  t.alike(session.hunks(), new Uint32Array([1, 1, 1, 1]), 'replaced line')
+  
+  session.edit(0, 0, 'new\n')
+  t.alike(session.hunks(), new Uint32Array([0, 0, 0, 1, 1, 1, 2, 1]), 'inserted line')
+  
+  session.edit(10, 7, 'line2')
+  t.alike(session.hunks(), new Uint32Array([0, 0, 0, 1]), 'reverted line')
+  
+  const current = b4a.from('new\nline1\nline2\nline3\nline4\nline5\n')
+  t.is(b4a.toString(session.patch()), b4a.toString(diffSync(base, current)), 'patch matches diff')
+  
+  session.destroy()
+  t.exception(() => session.patch(), /Session destroyed/)
+})
+
+test('DiffSession - matches diff after many edits', (t) => {
+  const lines = []
+  for (let i = 0; i < 100; i++) lines.push(`line ${i}`)
+  
+  const base = b4a.from(lines.join('\n') + '\n')
+  const session = new DiffSession(base)
+  let current = b4a.toString(base)
+  
+  for (const [line, text] of [[10, 'ten'], [50, 'fifty'], [11, 'eleven'], [90, '']]) {
+    const offset = current.indexOf(`line ${line}\n`)
+    const length = `line ${line}`.length
+    session.edit(offset, length, text)
+    current = current.slice(0, offset) + text + current.slice(offset + length)
+  }
+  
+  t.is(b4a.toString(session.patch()), b4a.toString(diffSync(base, b4a.from(current))))
+  t.exception(() => session.edit(current.length + 1, 0, 'x'), /Edit out of range/)
+  
+  session.destroy()
+})
+
+test('configureCache - caches diff results', async (t) => {
+  configureCache({ maxBytes: 1024 * 1024 })
+  t.teardown(() => configureCache({ maxBytes: 0 }))
+  
+  const a = b4a.from('line1\nline2\nline3\n')
+  const b = b4a.from('line1\nchanged\nline3\n')
+  
+  const first = await diff(a, b)
+  const before = cacheStats()
+  const second = await diff(b4a.from(a), b4a.from(b))
+  const after = cacheStats()
+  
+  t.is(second, first, 'returns the cached result')
+  t.is(after.hits, before.hits + 1, 'counts the hit')
+  t.is(diffSync(a, b), first, 'sync shares the cache')
+  t.not(diffSync(a, b, { ignoreWhitespace: true }), first, 'options are part of the key')
+  t.exception(() => diffSync(a, b, { maxMemory: 1 }), /Diff exceeds maxMemory/, 'budgets are checked on cached inputs')
+  await t.exception(diff(a, b, { maxMemory: 1 }), /Diff exceeds maxMemory/)
+  
+  configureCache({ maxBytes: 0 })
+  t.is(cacheStats().entries, 0, 'disabling clears the cache')
+  t.not(diffSync(a, b), first, 'no longer cached')
+})
+
+test('configureCache - evicts least recently used', (t) => {
+  configureCache({ maxBytes: 2048 })
+  t.teardown(() => configureCache({ maxBytes: 0 }))
+  
+  const a = b4a.from('x\n'.repeat(100))
+  
+  for (let i = 0; i < 100; i++) diffSync(a, b4a.from(`changed ${i}\n` + 'x\n'.repeat(99)))
+  
+  const stats = cacheStats()
+  t.ok(stats.bytes <= 2048, 'stays within the bound')
+  t.ok(stats.evictions > 0, 'counts evictions')
+})
+
+test('diff - stats', async (t) => {
+  const a = b4a.from('line1\nline2\nline3\nline4\nline5\nline6\nline7\nline8\nline9\nline10\n')
+  const b = b4a.from('line1\nchanged\nline3\nline4\nline5\nline6\nline7\nline8\nline9\nline10\nline11\n')
+  
+  const { output, stats } = await diff(a, b, { stats: true })
+  
+  t.alike(output, diffSync(a, b), 'output is unchanged')
+  t.is(stats.linesA, 10)
+  t.is(stats.linesB, 11)
+  t.is(stats.classes, 12)
+  t.is(stats.hunks, 2)
+  t.is(stats.bytesEmitted, output.byteLength)
+  t.ok(stats.prepareNs >= 0 && stats.searchNs >= 0 && stats.emitNs >= 0 && stats.copyNs >= 0, 'reports timings')
+  t.ok(stats.estimatedMemory > a.byteLength + b.byteLength, 'estimates memory')
+  
+  const sync = diffSync(a, b, { stats: true })
+  t.is(sync.stats.hunks, 2, 'sync reports stats')
+  
+  const lines = []
+  for (let i = 0; i < 1000; i++) lines.push(`line ${i}\n`)
+  const large = b4a.from(lines.join(''))
+  lines[500] = 'changed\n'
+  
+  const narrowed = diffSync(large, b4a.from(lines.join('')), { stats: true, maxMemory: 20000 })
+  t.is(narrowed.stats.linesA, 1000, 'counts the lines left out of narrowed diffs')
+  t.ok(narrowed.stats.classes < 1000, 'counts the classes of the narrowed middle')
+})
+
+test('merge - stats', async (t) => {
+  const o = b4a.from('line1\nline2\nline3\n')
+  const a = b4a.from('line1\nours\nline3\n')
+  const b = b4a.from('line1\ntheirs\nline3\n')
+  
+  const result = await merge(o, a, b, { stats: true })
+  
+  t.ok(result.conflict)
+  t.is(result.stats.linesO, 3)
+  t.is(result.stats.linesA, 3)
+  t.is(result.stats.linesB, 3)
+  t.is(result.stats.classes, 4, 'counts the classes of the larger diff against the ancestor')
+  t.is(result.stats.conflicts, 1)
+  t.is(result.stats.bytesEmitted, result.output.byteLength)
+  
+  t.is(mergeSync(o, a, b).stats, undefined, 'off by default')
+  t.is(mergeSync(o, a, b, { stats: true }).stats.conflicts, 1, 'sync reports stats')
+})
+
+test('metrics', async (t) => {
+  const before = metrics()
+  
+  await diff(b4a.from('a\nb\n'), b4a.from('a\nc\n'))
+  await t.exception(applyPatch(b4a.from('a\n'), b4a.from([0xff])))
+  
+  const after = metrics()
+  
+  t.is(after.completed, before.completed + 1, 'counts completed operations')
+  t.is(after.failed, before.failed + 1, 'counts failures')
+  t.ok(after.bytesCopied > before.bytesCopied, 'counts copied bytes')
+  t.is(after.queued, 0)
+  t.is(after.running, 0)
+  t.is(after.memory, 0, 'releases native memory')
+  
+  const total = (m) => m.latency.counts.flat().reduce((sum, n) => sum + n, 0)
+  t.is(total(after), total(before) + 2, 'records latency')
+  t.is(after.latency.counts.length, after.latency.sizes.length + 1)
+  t.is(after.queueWait.counts.length, after.queueWait.bounds.length + 1)
+})
+
+test('diff - maxMemory', async (t) => {
+  const lines = []
+  for (let i = 0; i < 1000; i++) lines.push(`line ${i}`)
+  
+  const a = b4a.from(lines.join('\n') + '\n')
+  lines[500] = 'changed'
+  const b = b4a.from(lines.join('\n') + '\n')
+  
+  const expected = diffSync(a, b)
+  t.alike(await diff(a, b, { maxMemory: 20000 }), expected, 'trims the unchanged lines')
+  t.alike(diffSync(a, b, { maxMemory: 20000 }), expected, 'sync trims the unchanged lines')
+  
+  lines[0] = 'changed'
+  lines[999] = 'changed'
+  const c = b4a.from(lines.join('\n') + '\n')
+  
+  await t.exception(diff(a, c, { maxMemory: 20000 }), /Diff exceeds maxMemory/)
+  t.exception(() => diffSync(a, c, { maxMemory: 20000 }), /Diff exceeds maxMemory/)
+  t.exception(() => diffSync(a, b, { maxMemory: 1000, granularity: 'word' }), /Diff exceeds maxMemory/)
+  t.ok(diffSync(a, c, { maxMemory: 1024 * 1024 }).byteLength > 0, 'runs within the budget')
+})
+
+test('diff - maxMemory with repeated lines', async (t) => {
+  const head = []
+  const tail = []
+  for (let i = 0; i < 500; i++) head.push(`head ${i}`)
+  for (let i = 0; i < 500; i++) tail.push(`tail ${i}`)
+  
+  const text = (lines) => b4a.from(lines.join('\n') + '\n')
+  
+  const a = text([...head, ...Array(10).fill('r'), 'q', ...tail])
+  const b = text([...head, ...Array(11).fill('r'), 'q', ...tail])
+  
+  t.alike(diffSync(a, b, { maxMemory: 20000 }), diffSync(a, b), 'keeps the repeated lines')
+  t.alike(await diff(a, b, { maxMemory: 20000 }), diffSync(a, b))
+  
+  const c = text([...head, 'x', '', 'y', ...tail])
+  const d = text([...head, 'x', '', '', 'y', ...tail])
+  
+  t.alike(diffSync(c, d, { maxMemory: 20000 }), diffSync(c, d), 'keeps the context after a repeated line')
+  t.exception(() => diffSync(a, b, { maxMemory: 20000, algorithm: 'histogram' }), /Diff exceeds maxMemory/, 'only narrows the default algorithm')
+})
+
+test('cpuFeatures', (t) => {
+  const features = cpuFeatures()
+  
+  t.is(typeof features.avx2, 'boolean')
+  t.is(typeof features.avx512, 'boolean')
+  t.is(typeof features.neon, 'boolean')
+  t.is(typeof features.forceScalar, 'boolean')
+  t.ok(['avx512', 'avx2', 'neon', 'scalar'].includes(features.kernels))
+  
+  if (features.forceScalar) t.is(features.kernels, 'scalar', 'honours the override')
+})
+
+test('diffMany', async (t) => {
+  const lines = []
+  for (let i = 0; i < 100; i++) lines.push(`line ${i}`)
+  
+  const base = b4a.from(lines.join('\n') + '\n')
+  const targets = []
+  
+  for (let i = 0; i < 20; i++) {
+    const copy = lines.slice()
+    copy[i * 5] = `changed ${i}`
+    targets.push(b4a.from(copy.join('\n') + '\n'))
+  }
+  
+  targets.push(base)
+  
+  const results = await diffMany(base, targets, { algorithm: 'histogram' })
+  
+  t.is(results.length, targets.length)
+  t.alike(results, targets.map((target) => diffSync(base, target, { algorithm: 'histogram' })), 'matches diffing each target')
+  t.is(results[results.length - 1].length, 0, 'no changes against itself')
+  t.alike(diffManySync(base, targets, { algorithm: 'histogram' }), results, 'sync matches async')
+  
+  const [withStats] = await diffMany(base, targets.slice(0, 1), { stats: true })
+  t.alike(withStats.output, diffSync(base, targets[0]))
+  t.is(withStats.stats.linesA, 100, 'reports stats per target')
+  
+  t.alike(await diffMany(base, []), [], 'no targets')
+  await t.exception(diffMany(base, [b4a.from('a')], { maxMemory: 1 }), /Diff exceeds maxMemory/)
+  t.exception(() => diffManySync(base, 'not an array'))
+})
+
+test('similarity', async (t) => {
+  const file = (name, changed) => {
+    const lines = []
+    for (let i = 0; i < 50; i++) lines.push(i < changed ? `edited ${name} ${i}` : `${name} line ${i}`)
+    return b4a.from(lines.join('\n') + '\n')
+  }
+  
+  const a = [file('one', 0), file('two', 0), file('three', 0), b4a.alloc(0)]
+  const b = [file('three', 5), file('other', 0), file('one', 0), file('two', 30), b4a.alloc(0)]
+  
+  const matches = await similarity(a, b)
+  
+  t.is(matches.length, 2, 'matches similar files only')
+  t.alike(matches.map(({ a, b }) => [a, b]), [[0, 2], [2, 0]], 'most similar first')
+  t.is(matches[0].score, 1, 'identical files')
+  t.ok(matches[1].score > 0.5 && matches[1].score < 1)
+  
+  t.alike(similaritySync(a, b), matches, 'sync matches async')
+  t.is((await similarity(a, b, { threshold: 0.1 })).length, 3, 'lower threshold')
+  t.alike(await similarity([], b), [])
+  
+  const spaced = [b4a.from('  a\n  b\n  c\n')]
+  const plain = [b4a.from('a\nb\nc\n')]
+  
+  t.is(similaritySync(spaced, plain).length, 0)
+  t.is(similaritySync(spaced, plain, { ignoreWhitespace: true })[0].score, 1, 'ignores whitespace')
+  
+  t.exception(() => similaritySync('a', b))
+})
+
+test('diffTrees', async (t) => {
+  const dir = await t.tmp()
+  
+  for (const name of ['a/sub', 'a/same', 'b/sub', 'b/same', 'b/new']) {
+    fs.mkdirSync(`${dir}/${name}`, { recursive: true })
+  }
+  
+  fs.writeFileSync(`${dir}/a/sub/file.txt`, 'x\ny\nz\n')
+  fs.writeFileSync(`${dir}/b/sub/file.txt`, 'x\nY\nz\n')
+  fs.writeFileSync(`${dir}/a/same/file.txt`, 'same\n')
+  fs.writeFileSync(`${dir}/b/same/file.txt`, 'same\n')
+  fs.writeFileSync(`${dir}/a/gone.txt`, 'gone\n')
+  fs.writeFileSync(`${dir}/b/new/file.txt`, 'fresh\n')
+  
+  const entries = []
+  for await (const entry of diffTrees(`${dir}/a`, `${dir}/b`)) entries.push(entry)
+  entries.sort((x, y) => x.path < y.path ? -1 : 1)
+  
+  t.alike(entries.map(({ path, status }) => [path, status]), [
+    ['gone.txt', 'removed'],
+    ['new/file.txt', 'added'],
+    ['sub/file.txt', 'modified']
+  ], 'skips equal files')
+  
+  t.alike(entries[2].patch, diffSync(b4a.from('x\ny\nz\n'), b4a.from('x\nY\nz\n')))
+  t.alike(entries[1].patch, diffSync(b4a.alloc(0), b4a.from('fresh\n')), 'diffs added files against an empty file')
+  
+  for await (const { patch } of diffTrees(`${dir}/a/sub`, `${dir}/b/sub`, { stats: true })) {
+    t.is(patch.stats.linesA, 3, 'passes options to every file')
+  }
+  
+  await t.exception(async () => {
+    for await (const entry of diffTrees(`${dir}/a`, `${dir}/missing`)) t.fail(entry.path)
+  }, /Failed to read directory/)
+  
+  fs.mkdirSync(`${dir}/many/a`, { recursive: true })
+  fs.mkdirSync(`${dir}/many/b`, { recursive: true })
+  
+  for (let i = 0; i < 200; i++) {
+    fs.writeFileSync(`${dir}/many/a/${i}.txt`, `${i}\n`)
+    fs.writeFileSync(`${dir}/many/b/${i}.txt`, `${i + 1}\n`)
+  }
+  
+  let read = 0
+  for await (const entry of diffTrees(`${dir}/many/a`, `${dir}/many/b`)) {
+    if (entry && ++read === 3) break
+  }
+  t.is(read, 3, 'stops diffing when the iteration ends early')
+  
+  read = 0
+  for await (const entry of diffTrees(`${dir}/many/a`, `${dir}/many/b`)) {
+    if (entry) read++
+    if (read % 50 === 0) await new Promise((resolve) => setTimeout(resolve, 10))
+  }
+  t.is(read, 200, 'waits for slow readers without losing files')
+})
+
+test('blame', async (t) => {
+  const revisions = [
+    b4a.from('a\nb\nc\n'),
+    b4a.from('a\nB\nc\n'),
+    b4a.from('x\na\nB\nc\nd\n'),
+    b4a.from('x\na\nB\nd')
+  ]
+  
+  const origins = await blame(revisions)
+  t.ok(origins instanceof Uint32Array)
+  t.alike(Array.from(origins), [2, 0, 1, 3], 'traces every line to the revision that added it')
+  t.alike(blameSync(revisions), origins)
+  
+  t.alike(Array.from(blameSync([revisions[0]])), [0, 0, 0], 'attributes a single revision to itself')
+  t.alike(Array.from(blameSync([b4a.from(''), b4a.from('a\n'), b4a.from('a\nb\n'), b4a.from('b\n')])), [2])
+  
+  const spaced = [b4a.from('a\nb\n'), b4a.from('a\n  b\n')]
+  t.alike(Array.from(blameSync(spaced)), [0, 1])
+  t.alike(Array.from(blameSync(spaced, { ignoreWhitespace: true })), [0, 0], 'applies whitespace options')
+  
+  await t.exception(() => blame([]), /non-empty array/)
+  
+  const blank = [b4a.from('a\n'), b4a.from('a\n\n'), b4a.from('a\n\nx\n')]
+  t.exception(() => blameSync(blank, { ignoreBlankLines: true }), /does not support ignoreBlankLines/)
+  await t.exception(() => blame(blank, { ignoreBlankLines: true }), /does not support ignoreBlankLines/)
+  t.exception(() => blameSync(blank, { ignoreLines: ['x'] }), /does not support ignoreBlankLines or ignoreLines/)
+  t.alike(Array.from(blameSync(blank)), [0, 1, 2], 'traces blank lines')
+})
+
+test('diff with anchors', async (t) => {
+  const a = b4a.from('a\nb\nc\n')
+  const b = b4a.from('c\na\nb\n')
+  
+  t.is(b4a.toString(diffSync(a, b)), '@@ -1,3 +1,3 @@\n+c\n a\n b\n-c\n')
+  
+  const expected = '@@ -1,3 +1,3 @@\n-a\n-b\n c\n+a\n+b\n'
+  t.is(b4a.toString(diffSync(a, b, { anchors: ['c'] })), expected, 'keeps the anchored line')
+  t.is(b4a.toString(await diff(a, b, { anchors: [b4a.from('c')] })), expected, 'accepts buffers')
+  t.is(b4a.toString(diffSync(a, b, { anchors: [''] })), b4a.toString(diffSync(a, b, { algorithm: 'patience' })), 'skips empty anchors')
+  
+  t.not(b4a.toString(await diff(a, b, { anchors: ['c'] })), b4a.toString(await diff(a, b, { anchors: ['a'] })), 'caches by anchors')
+})
+
+test('diff with ignoreLines', { skip: Bare.platform === 'win32' }, async (t) => {
+  const a = b4a.from('Date: Mon\n1\n2\n3\n4\n5\nid=1\n')
+  const b = b4a.from('Date: Tue\n1\n2\n3\n4\n5\nid=2\n')
+  
+  t.is(b4a.toString(await diff(a, b, { ignoreLines: ['^Date:'] })), '@@ -4,4 +4,4 @@\n 3\n 4\n 5\n-id=1\n+id=2\n', 'leaves out changes to matching lines')
+  t.is((await diff(a, b, { ignoreLines: ['^Date:', 'id=[0-9]+'] })).byteLength, 0, 'caches by patterns')
+  t.is(diffSync(a, b, { ignoreLines: ['^Date:', 'id=[0-9]+'] }).byteLength, 0)
+  t.exception(() => diffSync(a, b, { ignoreLines: ['^Date:', '('] }), /Invalid pattern '\('/, 'rejects invalid patterns')
+  await t.exception(diff(a, b, { ignoreLines: ['('] }), /Invalid pattern/)
+  
+  const results = diffManySync(a, [b, b], { ignoreLines: ['^Date:'], encoding: 'binary' })
+  t.alike(applyPatchSync(a, results[1]), b, 'keeps matching lines in binary patches')
+})
+
+test('diff with ignoreLines on Windows', { skip: Bare.platform !== 'win32' }, async (t) => {
+  const a = b4a.from('a\n')
+  const b = b4a.from('b\n')
+  
+  t.exception(() => diffSync(a, b, { ignoreLines: ['a'] }), /does not support ignoreLines/)
+  await t.exception(diff(a, b, { ignoreLines: ['a'] }), /does not support ignoreLines/)
+})
+
+test('diff with ignoreCrAtEol', async (t) => {
+  const a = b4a.from('line1\nline2\nline3\n')
+  const b = b4a.from('line1\r\nline2\r\nchanged\r\n')
+  
+  t.is(b4a.toString(await diff(a, b, { ignoreCrAtEol: true })), '@@ -1,3 +1,3 @@\n line1\n line2\n-line3\n+changed\r\n')
+  t.is(diffSync(a, b4a.from('line1\r\nline2\r\nline3\r\n'), { ignoreCrAtEol: true }).byteLength, 0)
+})
+
+test('merge with normalizeEol', async (t) => {
+  const ancestor = b4a.from('line1\nline2\nline3\n')
+  const ours = b4a.from('line1\r\nline2\r\nline3\r\n')
+  const theirs = b4a.from('line1\nline2\nchanged\n')
+  
+  const result = await merge(ancestor, ours, theirs, { normalizeEol: true })
+  t.is(result.conflict, false)
+  t.is(b4a.toString(result.output), 'line1\r\nline2\r\nchanged\n')
+  t.alike(mergeSync(ancestor, ours, theirs, { normalizeEol: true }), result)
+  t.is(mergeSync(ancestor, ours, theirs).conflict, true, 'conflicts without it')
+})
+
+test('diff with funcNames', async (t) => {
+  const a = b4a.from('int main(void) {\n  a;\n  b;\n  c;\n  d;\n  e;\n}\n')
+  const b = b4a.from('int main(void) {\n  a;\n  b;\n  c;\n  d;\n  E;\n}\n')
+  
+  t.is(b4a.toString(await diff(a, b, { funcNames: true })), '@@ -3,5 +3,5 @@ int main(void) {\n   b;\n   c;\n   d;\n-  e;\n+  E;\n }\n')
+  
+  if (Bare.platform === 'win32') {
+    t.exception(() => diffSync(a, b, { funcNames: ['^int'] }), /does not support funcNames patterns/)
+  } else {
+    t.is(b4a.toString(diffSync(a, b, { funcNames: ['^int ([a-z]+)'] })).split('\n')[0], '@@ -3,5 +3,5 @@ main')
+    t.exception(() => diffSync(a, b, { funcNames: ['^int ([a-z]+'] }), /Invalid pattern/, 'rejects invalid patterns')
+  }
+  
+  t.is(b4a.toString(await diff(a, b)).split('\n')[0], '@@ -3,5 +3,5 @@', 'caches by funcNames')
+  
+  const lines = ['fn top']
+  for (let i = 0; i < 2000; i++) lines.push(' line ' + i)
+  const c = b4a.from(lines.join('\n') + '\n')
+  lines[1000] = ' changed'
+  const d = b4a.from(lines.join('\n') + '\n')
+  
+  t.is(b4a.toString(diffSync(c, d, { funcNames: true, maxMemory: 20000 })).split('\n')[0], '@@ -998,7 +998,7 @@ fn top', 'finds function lines ahead of the narrowed middle')
+})
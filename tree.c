@@ -0,0 +1,291 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <uv.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#include "core.h"
+#include "cpu.h"
+#include "tree.h"
+#include "xinclude.h"
+
+// Join two paths with '/', or return a copy of name if dir is empty
+static char *
+bare_xdiff_path_join(const char *dir, const char *name) {
+  size_t dir_len = strlen(dir), name_len = strlen(name);
+  
+  char *path = xdl_malloc(dir_len + name_len + 2);
+  if (!path) return NULL;
+  
+  size_t len = 0;
+  
+  if (dir_len > 0) {
+    memcpy(path, dir, dir_len);
+    len = dir_len;
+    path[len++] = '/';
+  }
+  
+  memcpy(path + len, name, name_len + 1);
+  
+  return path;
+}
+
+// Append a path to a tree, which takes ownership of it
+static int
+bare_xdiff_tree_push(bare_xdiff_tree_t *tree, char *path) {
+  if (tree->len == tree->capacity) {
+    size_t new_capacity = tree->capacity ? tree->capacity * 2 : 64;
+    char **new_paths = xdl_realloc(tree->paths, new_capacity * sizeof(char *));
+    if (!new_paths) return -1;
+    tree->paths = new_paths;
+    tree->capacity = new_capacity;
+  }
+  
+  tree->paths[tree->len++] = path;
+  return 0;
+}
+
+// Type of a directory entry that the file system did not report, without
+// following symbolic links
+static uv_dirent_type_t
+bare_xdiff_tree_type(uv_loop_t *loop, const char *root, const char *relative) {
+  char *path = bare_xdiff_path_join(root, relative);
+  if (!path) return UV_DIRENT_UNKNOWN;
+  
+  uv_fs_t req;
+  int err = uv_fs_lstat(loop, &req, path, NULL);
+  uint64_t mode = req.statbuf.st_mode;
+  uv_fs_req_cleanup(&req);
+  xdl_free(path);
+  
+  if (err < 0) return UV_DIRENT_UNKNOWN;
+  if ((mode & S_IFMT) == S_IFDIR) return UV_DIRENT_DIR;
+  if ((mode & S_IFMT) == S_IFREG) return UV_DIRENT_FILE;
+  
+  return UV_DIRENT_UNKNOWN;
+}
+
+// List the files below the relative directory of root
+static int
+bare_xdiff_tree_walk(uv_loop_t *loop, const char *root, const char *relative, bare_xdiff_tree_t *tree) {
+  char *dir = bare_xdiff_path_join(root, relative);
+  if (!dir) return -1;
+  
+  uv_fs_t req;
+  int err = uv_fs_scandir(loop, &req, dir, 0, NULL);
+  xdl_free(dir);
+  
+  if (err < 0) goto err;
+  
+  uv_dirent_t entry;
+  
+  while (uv_fs_scandir_next(&req, &entry) != UV_EOF) {
+    char *path = bare_xdiff_path_join(relative, entry.name);
+    if (!path) goto err;
+    
+    uv_dirent_type_t type = entry.type;
+    if (type == UV_DIRENT_UNKNOWN) type = bare_xdiff_tree_type(loop, root, path);
+    
+    if (type == UV_DIRENT_DIR) {
+      err = bare_xdiff_tree_walk(loop, root, path, tree);
+      xdl_free(path);
+      if (err < 0) goto err;
+    } else if (type == UV_DIRENT_FILE) {
+      if (bare_xdiff_tree_push(tree, path) < 0) {
+        xdl_free(path);
+        goto err;
+      }
+    } else {
+      xdl_free(path);
+    }
+  }
+  
+  uv_fs_req_cleanup(&req);
+  return 0;
+
+err:
+  uv_fs_req_cleanup(&req);
+  return -1;
+}
+
+static int
+bare_xdiff_tree_compare(const void *a, const void *b) {
+  return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// List the regular files below root. Symbolic links are not followed.
+int
+bare_xdiff_tree_list(uv_loop_t *loop, const char *root, bare_xdiff_tree_t *tree) {
+  memset(tree, 0, sizeof(bare_xdiff_tree_t));
+  
+  if (bare_xdiff_tree_walk(loop, root, "", tree) < 0) {
+    bare_xdiff_tree_clear(tree);
+    return -1;
+  }
+  
+  if (tree->len > 1) qsort(tree->paths, tree->len, sizeof(char *), bare_xdiff_tree_compare);
+  
+  return 0;
+}
+
+// Free the paths of a tree
+void
+bare_xdiff_tree_clear(bare_xdiff_tree_t *tree) {
+  for (size_t i = 0; i < tree->len; i++) xdl_free(tree->paths[i]);
+  xdl_free(tree->paths);
+  memset(tree, 0, sizeof(bare_xdiff_tree_t));
+}
+
+// Join the sorted files of two trees into the files of a tree diff
+int
+bare_xdiff_tree_files(const bare_xdiff_tree_t *a, const bare_xdiff_tree_t *b, bare_xdiff_tree_file_t **result, size_t *len) {
+  size_t capacity = a->len + b->len;
+  
+  bare_xdiff_tree_file_t *files = xdl_malloc((capacity ? capacity : 1) * sizeof(bare_xdiff_tree_file_t));
+  if (!files) return -1;
+  
+  size_t i = 0, j = 0, count = 0;
+  
+  while (i < a->len || j < b->len) {
+    int order = i == a->len ? 1 : j == b->len ? -1 : strcmp(a->paths[i], b->paths[j]);
+    
+    if (order < 0) {
+      files[count].path = a->paths[i++];
+      files[count].status = BARE_XDIFF_TREE_REMOVED;
+    } else if (order > 0) {
+      files[count].path = b->paths[j++];
+      files[count].status = BARE_XDIFF_TREE_ADDED;
+    } else {
+      files[count].path = a->paths[i++];
+      files[count].status = BARE_XDIFF_TREE_MODIFIED;
+      j++;
+    }
+    
+    count++;
+  }
+  
+  *result = files;
+  *len = count;
+  return 0;
+}
+
+// Map a file into memory for reading. Empty files are not mapped, as neither
+// mmap() nor MapViewOfFile() accept them.
+int
+bare_xdiff_file_map(uv_loop_t *loop, const char *path, bare_xdiff_mapped_file_t *file) {
+  memset(file, 0, sizeof(bare_xdiff_mapped_file_t));
+  file->data = "";
+  
+  uv_fs_t req;
+  uv_file fd = uv_fs_open(loop, &req, path, UV_FS_O_RDONLY, 0, NULL);
+  uv_fs_req_cleanup(&req);
+  
+  if (fd < 0) return -1;
+  
+  int err = uv_fs_fstat(loop, &req, fd, NULL);
+  uint64_t size = req.statbuf.st_size;
+  uv_fs_req_cleanup(&req);
+  
+  if (err < 0 || size > SIZE_MAX) goto err;
+  if (size == 0) goto done;
+
+#if defined(_WIN32)
+  HANDLE mapping = CreateFileMapping((HANDLE)uv_get_osfhandle(fd), NULL, PAGE_READONLY, 0, 0, NULL);
+  if (mapping == NULL) goto err;
+  
+  void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  
+  if (data == NULL) {
+    CloseHandle(mapping);
+    goto err;
+  }
+  
+  file->handle = mapping;
+#else
+  void *data = mmap(NULL, (size_t)size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (data == MAP_FAILED) goto err;
+#endif
+  
+  file->data = data;
+  file->len = (size_t)size;
+
+done:
+  // The mapping stays valid after the file is closed
+  uv_fs_close(loop, &req, fd, NULL);
+  uv_fs_req_cleanup(&req);
+  return 0;
+
+err:
+  uv_fs_close(loop, &req, fd, NULL);
+  uv_fs_req_cleanup(&req);
+  return -1;
+}
+
+// Unmap a file mapped by bare_xdiff_file_map()
+void
+bare_xdiff_file_unmap(bare_xdiff_mapped_file_t *file) {
+  if (file->len == 0) return;
+
+#if defined(_WIN32)
+  UnmapViewOfFile(file->data);
+  CloseHandle((HANDLE)file->handle);
+#else
+  munmap(file->data, file->len);
+#endif
+  
+  file->len = 0;
+}
+
+// Map the file at path below root
+static int
+bare_xdiff_tree_map(uv_loop_t *loop, const char *root, const char *path, bare_xdiff_mapped_file_t *file) {
+  char *full = bare_xdiff_path_join(root, path);
+  if (!full) return -1;
+  
+  int err = bare_xdiff_file_map(loop, full, file);
+  xdl_free(full);
+  
+  return err;
+}
+
+// Diff a file of a tree diff between the roots, mapping both sides. Files
+// only in one tree are diffed against an empty file. Returns 1 if the file
+// changed, with its diff in output, 0 if both sides are equal, -1 if a side
+// could not be read and the error of bare_xdiff_run_diff() if it fails.
+int
+bare_xdiff_tree_diff_file(uv_loop_t *loop, const char *root_a, const char *root_b, const bare_xdiff_tree_file_t *file, const bare_xdiff_diff_options_t *options, bare_xdiff_output_t *output, bare_xdiff_stats_t *stats) {
+  bare_xdiff_mapped_file_t a, b;
+  memset(&a, 0, sizeof(a));
+  memset(&b, 0, sizeof(b));
+  a.data = b.data = "";
+  
+  int ret = -1;
+  
+  if (file->status != BARE_XDIFF_TREE_ADDED && bare_xdiff_tree_map(loop, root_a, file->path, &a) < 0) goto done;
+  if (file->status != BARE_XDIFF_TREE_REMOVED && bare_xdiff_tree_map(loop, root_b, file->path, &b) < 0) goto done;
+  
+  // Files in both trees are compared before diffing, which is cheaper than
+  // hashing them as both have to be read either way
+  if (file->status == BARE_XDIFF_TREE_MODIFIED && a.len == b.len && bare_xdiff_common_prefix(a.data, b.data, a.len) == a.len) {
+    ret = 0;
+    goto done;
+  }
+  
+  mmfile_t mf1 = {a.data, (long)a.len};
+  mmfile_t mf2 = {b.data, (long)b.len};
+  
+  ret = bare_xdiff_run_diff(&mf1, &mf2, options, output, stats);
+  if (ret >= 0) ret = 1;
+
+done:
+  bare_xdiff_file_unmap(&a);
+  bare_xdiff_file_unmap(&b);
+  return ret;
+}
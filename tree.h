@@ -0,0 +1,64 @@
+#ifndef BARE_XDIFF_TREE_H
+#define BARE_XDIFF_TREE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <uv.h>
+
+#include "core.h"
+
+// Status of a file in a tree diff
+#define BARE_XDIFF_TREE_MODIFIED 0
+#define BARE_XDIFF_TREE_ADDED 1
+#define BARE_XDIFF_TREE_REMOVED 2
+
+// Regular files of a directory tree, as paths relative to its root joined by
+// '/' and sorted in byte order
+typedef struct {
+  char **paths;
+  size_t len;
+  size_t capacity;
+} bare_xdiff_tree_t;
+
+// File of a tree diff, pointing into the paths of the trees
+typedef struct {
+  const char *path;
+  int32_t status;
+} bare_xdiff_tree_file_t;
+
+// Read only mapping of a file
+typedef struct {
+  char *data;
+  size_t len;
+  void *handle;  // File mapping object on Windows
+} bare_xdiff_mapped_file_t;
+
+// List the regular files below root. Symbolic links are not followed.
+int
+bare_xdiff_tree_list(uv_loop_t *loop, const char *root, bare_xdiff_tree_t *tree);
+
+// Free the paths of a tree
+void
+bare_xdiff_tree_clear(bare_xdiff_tree_t *tree);
+
+// Join the sorted files of two trees into the files of a tree diff
+int
+bare_xdiff_tree_files(const bare_xdiff_tree_t *a, const bare_xdiff_tree_t *b, bare_xdiff_tree_file_t **result, size_t *len);
+
+// Map a file into memory for reading
+int
+bare_xdiff_file_map(uv_loop_t *loop, const char *path, bare_xdiff_mapped_file_t *file);
+
+// Unmap a file mapped by bare_xdiff_file_map()
+void
+bare_xdiff_file_unmap(bare_xdiff_mapped_file_t *file);
+
+// Diff a file of a tree diff between the roots, mapping both sides. Files
+// only in one tree are diffed against an empty file. Returns 1 if the file
+// changed, with its diff in output, 0 if both sides are equal, -1 if a side
+// could not be read and the error of bare_xdiff_run_diff() if it fails.
+int
+bare_xdiff_tree_diff_file(uv_loop_t *loop, const char *root_a, const char *root_b, const bare_xdiff_tree_file_t *file, const bare_xdiff_diff_options_t *options, bare_xdiff_output_t *output, bare_xdiff_stats_t *stats);
+
+#endif // BARE_XDIFF_TREE_H